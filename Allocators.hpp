@@ -0,0 +1,277 @@
+/**
+ * @file
+ *
+ * @brief Allocators to be passed as last template parameter of algebra::Matrix.
+ *
+ * TrackingAllocator counts the live and peak bytes allocated through it, for
+ * the map nodes and the compressed vectors of all matrices using it, so the
+ * real footprint of a matrix (and the transient peak of compress()) can be
+ * measured.
+ *
+ * Arena provides std::pmr allocators bump-allocating from large slabs, so the
+ * nodes of the coordinate map cost no call to malloc during the assembly and
+ * are released all at once.
+ *
+ * AlignedAllocator aligns every block to a cache line and backs large blocks
+ * with 2 MiB pages (transparent or reserved huge pages), reducing the TLB
+ * misses of the kernels streaming the compressed vectors.
+ *
+ * @author Luca Brambilla <luca13.brambilla@mail.polimi.it>
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <memory_resource>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#ifndef ALLOCATORS_HPP
+#define ALLOCATORS_HPP
+
+namespace algebra{
+
+/**
+ * @brief Counters of live and peak allocated bytes, safe across threads.
+ */
+class MemoryTracker
+{
+public:
+    /**
+     * @brief Register an allocation
+     */
+    void allocate(std::size_t const &bytes)
+    {
+        std::size_t now = live_bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        std::size_t peak = peak_bytes.load(std::memory_order_relaxed);
+        while (now > peak and !peak_bytes.compare_exchange_weak(peak, now, std::memory_order_relaxed));
+        allocation_count.fetch_add(1, std::memory_order_relaxed);
+    };
+
+    /**
+     * @brief Register a deallocation
+     */
+    void deallocate(std::size_t const &bytes)
+    {
+        live_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+    };
+
+    /**
+     * @brief Get bytes currently allocated
+     */
+    std::size_t live() const { return live_bytes.load(std::memory_order_relaxed); };
+
+    /**
+     * @brief Get maximum of the bytes allocated at the same time
+     */
+    std::size_t peak() const { return peak_bytes.load(std::memory_order_relaxed); };
+
+    /**
+     * @brief Get number of allocations
+     */
+    std::size_t allocations() const { return allocation_count.load(std::memory_order_relaxed); };
+
+    /**
+     * @brief Restart the peak from the bytes currently allocated
+     */
+    void reset_peak() { peak_bytes.store(live(), std::memory_order_relaxed); };
+
+private:
+    std::atomic<std::size_t> live_bytes{0};
+    std::atomic<std::size_t> peak_bytes{0};
+    std::atomic<std::size_t> allocation_count{0};
+};
+
+/**
+ * @brief Tracker of the allocations with a given tag.
+ *
+ * @tparam Tag              Tag selecting the tracker
+ */
+template<typename Tag>
+MemoryTracker & memory_tracker()
+{
+    static MemoryTracker t;
+    return t;
+}
+
+/**
+ * @brief Allocator counting the bytes in a MemoryTracker shared by all the
+ * allocators with the same Tag, whatever the allocated type. Different tags
+ * keep separate counts, e.g. one per group of matrices.
+ *
+ * @tparam T                Allocated type
+ * @tparam Tag              Tag selecting the tracker
+ */
+template<typename T, typename Tag = void>
+class TrackingAllocator
+{
+public:
+    typedef T value_type;
+
+    template<typename U>
+    struct rebind { typedef TrackingAllocator<U, Tag> other; };
+
+    TrackingAllocator() = default;
+
+    template<typename U>
+    TrackingAllocator(TrackingAllocator<U, Tag> const &) {};
+
+    T * allocate(std::size_t n)
+    {
+        tracker().allocate(n * sizeof(T));
+        return std::allocator<T>().allocate(n);
+    };
+
+    void deallocate(T *p, std::size_t n)
+    {
+        tracker().deallocate(n * sizeof(T));
+        std::allocator<T>().deallocate(p, n);
+    };
+
+    /**
+     * @brief Tracker shared by the allocators with this Tag
+     */
+    static MemoryTracker & tracker() { return memory_tracker<Tag>(); };
+};
+
+template<typename T, typename U, typename Tag>
+bool operator==(TrackingAllocator<T, Tag> const &, TrackingAllocator<U, Tag> const &) { return true; }
+
+template<typename T, typename U, typename Tag>
+bool operator!=(TrackingAllocator<T, Tag> const &, TrackingAllocator<U, Tag> const &) { return false; }
+
+/**
+ * @brief Arena for the assembly of matrices: memory is bump-allocated from
+ * slabs of growing size and released only by release() or by the destructor,
+ * so deallocations (e.g. of the map nodes consumed by compress()) cost nothing.
+ * Matrices allocating from the arena must not outlive it.
+ *
+ * Usage: Matrix<T, Order, std::pmr::polymorphic_allocator<T>> M(arena.allocator<T>());
+ */
+class Arena
+{
+public:
+    /**
+     * @brief Construct the arena with the size of the first slab.
+     *
+     * @param initial_bytes     size of the first slab
+     */
+    explicit Arena(std::size_t const &initial_bytes=1<<20) : resource(initial_bytes) {};
+
+    Arena(Arena const &) = delete;
+    Arena & operator=(Arena const &) = delete;
+
+    /**
+     * @brief Allocator of the arena for a given type
+     */
+    template<typename T>
+    std::pmr::polymorphic_allocator<T> allocator() { return std::pmr::polymorphic_allocator<T>(&resource); };
+
+    /**
+     * @brief Release all the memory of the arena at once
+     */
+    void release() { resource.release(); };
+
+private:
+    std::pmr::monotonic_buffer_resource resource;
+};
+
+/// Enumerator for the pages backing large blocks of AlignedAllocator
+enum HugePages {Small_pages, Transparent_huge_pages, Explicit_huge_pages};
+
+/**
+ * @brief Allocator aligning blocks to 64 bytes. Blocks of at least 2 MiB are
+ * mapped directly (Linux) at 2 MiB boundaries: with Transparent_huge_pages
+ * the kernel is advised to back them with huge pages (madvise), with
+ * Explicit_huge_pages they are taken from the reserved huge pages
+ * (MAP_HUGETLB), falling back to transparent huge pages if none are available.
+ *
+ * Usage: Matrix<double, Order, AlignedAllocator<double>> M(name);
+ *
+ * @tparam T                Allocated type
+ * @tparam Pages            Pages backing the large blocks
+ */
+template<typename T, HugePages Pages = Transparent_huge_pages>
+class AlignedAllocator
+{
+public:
+    typedef T value_type;
+
+    /// alignment of every block
+    static constexpr std::size_t alignment = 64;
+    /// size of a huge page, blocks from this size are mapped directly
+    static constexpr std::size_t huge_page_bytes = std::size_t(1) << 21;
+
+    template<typename U>
+    struct rebind { typedef AlignedAllocator<U, Pages> other; };
+
+    AlignedAllocator() = default;
+
+    template<typename U>
+    AlignedAllocator(AlignedAllocator<U, Pages> const &) {};
+
+    T * allocate(std::size_t n)
+    {
+        std::size_t bytes = n * sizeof(T);
+#ifdef __linux__
+        if (Pages != Small_pages and bytes >= huge_page_bytes)
+        {
+            std::size_t length = round_up(bytes);
+            void *p = MAP_FAILED;
+            if (Pages == Explicit_huge_pages)
+                p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (p == MAP_FAILED)
+            {
+                // over-map by a huge page, then unmap the slack around the aligned block
+                p = mmap(nullptr, length + huge_page_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (p == MAP_FAILED)
+                    throw std::bad_alloc();
+                char *first = static_cast<char *>(p);
+                char *aligned = first + (huge_page_bytes - reinterpret_cast<std::uintptr_t>(first) % huge_page_bytes) % huge_page_bytes;
+                if (aligned != first)
+                    munmap(first, aligned - first);
+                if (aligned + length != first + length + huge_page_bytes)
+                    munmap(aligned + length, first + huge_page_bytes - aligned);
+                p = aligned;
+                madvise(p, length, MADV_HUGEPAGE);
+            }
+            return static_cast<T *>(p);
+        }
+#endif
+        return static_cast<T *>(::operator new(bytes, std::align_val_t(alignment)));
+    };
+
+    void deallocate(T *p, std::size_t n)
+    {
+        std::size_t bytes = n * sizeof(T);
+#ifdef __linux__
+        if (Pages != Small_pages and bytes >= huge_page_bytes)
+        {
+            munmap(p, round_up(bytes));
+            return;
+        }
+#endif
+        ::operator delete(p, std::align_val_t(alignment));
+    };
+
+private:
+    /// bytes rounded up to whole huge pages
+    static std::size_t round_up(std::size_t const &bytes)
+    {
+        return (bytes + huge_page_bytes - 1) / huge_page_bytes * huge_page_bytes;
+    };
+};
+
+template<typename T, typename U, HugePages Pages>
+bool operator==(AlignedAllocator<T, Pages> const &, AlignedAllocator<U, Pages> const &) { return true; }
+
+template<typename T, typename U, HugePages Pages>
+bool operator!=(AlignedAllocator<T, Pages> const &, AlignedAllocator<U, Pages> const &) { return false; }
+
+} // namespace algebra
+
+#endif
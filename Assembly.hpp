@@ -0,0 +1,300 @@
+/**
+ * @file
+ *
+ * @brief Concurrent assembly of a sparse matrix from many threads.
+ *
+ * Threads add (i, j, v) contributions to their own buffers, with no lock and
+ * no shared state. A parallel finalization counts the contributions of each
+ * row, scatters them, sums the duplicates and builds a compressed
+ * algebra::Matrix directly, without the coordinate map.
+ *
+ * @author Luca Brambilla <luca13.brambilla@mail.polimi.it>
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "Matrix.hpp"
+
+#ifndef ASSEMBLY_HPP
+#define ASSEMBLY_HPP
+
+namespace algebra{
+
+/**
+ * @brief Assembly buffers for a matrix filled concurrently, e.g. by the
+ * elements of a finite element mesh. Duplicated entries are summed.
+ *
+ * @tparam T                Data type
+ * @tparam StorageOrder     Storage ordering of the assembled Matrix
+ * @tparam Alloc            Allocator of the assembled Matrix
+ */
+template<typename T, typename StorageOrder, typename Alloc = std::allocator<T>>
+class ConcurrentAssembler
+{
+public:
+    ConcurrentAssembler(std::size_t const &r, std::size_t const &c, std::size_t const &threads=0,
+                        Alloc const &a=Alloc());
+
+    /**
+     * @brief Add a contribution to element (i, j) from the calling OpenMP
+     * thread. Thread-safe as long as each thread number is used by one thread:
+     * the team must have at most threads() threads, and nested parallel
+     * regions (where thread numbers repeat) are rejected.
+     *
+     * @param i         row index
+     * @param j         column index
+     * @param v         value added
+     */
+    void add(std::size_t const &i, std::size_t const &j, T const &v)
+    {
+#ifdef _OPENMP
+        if (omp_get_level() > 1)
+        {
+            std::cerr << "concurrent assembly: add() called from a nested parallel region, use add_from()" << std::endl;
+            return;
+        }
+        add_from(omp_get_thread_num(), i, j, v);
+#else
+        add_from(0, i, j, v);
+#endif
+    };
+
+    /**
+     * @brief Add a contribution to element (i, j) in the buffer of a given
+     * thread, for threads not managed by OpenMP.
+     *
+     * @param t         thread number, smaller than threads()
+     * @param i         row index
+     * @param j         column index
+     * @param v         value added
+     */
+    void add_from(std::size_t const &t, std::size_t const &i, std::size_t const &j, T const &v)
+    {
+        if (t >= buffers.size())
+        {
+            std::cerr << "concurrent assembly: thread " << t << " beyond the "
+                      << buffers.size() << " buffers, contribution ignored" << std::endl;
+            return;
+        }
+        buffers[t].entries.push_back({i, j, v});
+    };
+
+    void reserve(std::size_t const &per_thread);
+    void clear();
+
+    Matrix<T,StorageOrder,Alloc> finalize(Compression const &c=CSR);
+
+    /**
+     * @brief Get number of thread buffers
+     */
+    std::size_t threads() const { return buffers.size(); };
+
+    /**
+     * @brief Get number of contributions added, duplicates included
+     */
+    std::size_t size() const
+    {
+        std::size_t n = 0;
+        for (auto const &b : buffers)
+            n += b.entries.size();
+        return n;
+    };
+
+private:
+    /// contribution of a thread
+    struct Entry
+    {
+        std::size_t row;
+        std::size_t col;
+        T value;
+    };
+
+    /// buffer of a thread, on its own cache lines
+    struct alignas(64) Buffer
+    {
+        std::vector<Entry> entries;
+    };
+
+    /// contribution scattered to its row, with its origin for a deterministic order
+    struct Scattered
+    {
+        std::size_t col;
+        std::uint64_t origin;
+        T value;
+    };
+
+    std::size_t nrow = 0;
+    std::size_t ncol = 0;
+    std::vector<Buffer> buffers;
+    /// allocator of the assembled matrix
+    Alloc alloc;
+};
+
+/**
+ * @brief Construct the assembly buffers of a matrix with given shape.
+ *
+ * @param r             number of rows
+ * @param c             number of columns
+ * @param threads       number of thread buffers, OpenMP maximum number of threads if 0
+ * @param a             allocator of the assembled matrix
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+ConcurrentAssembler<T,StorageOrder,Alloc>::ConcurrentAssembler(std::size_t const &r, std::size_t const &c,
+                                                              std::size_t const &threads, Alloc const &a) :
+    nrow(r), ncol(c), alloc(a)
+{
+    std::size_t nt = threads;
+#ifdef _OPENMP
+    if (nt == 0)
+        nt = omp_get_max_threads();
+#endif
+    buffers.resize(std::max<std::size_t>(nt, 1));
+}
+
+/**
+ * @brief Reserve space in each thread buffer.
+ *
+ * @param per_thread    expected contributions of each thread
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+void ConcurrentAssembler<T,StorageOrder,Alloc>::reserve(std::size_t const &per_thread)
+{
+    #pragma omp parallel for
+    for (std::size_t t=0; t<buffers.size(); ++t)
+        buffers[t].entries.reserve(per_thread);
+}
+
+/**
+ * @brief Remove all contributions and release the buffers.
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+void ConcurrentAssembler<T,StorageOrder,Alloc>::clear()
+{
+    for (auto &b : buffers)
+        std::vector<Entry>().swap(b.entries);
+}
+
+/**
+ * @brief Build the compressed matrix from the contributions, summing the
+ * duplicates, then clear the buffers.
+ *
+ * Contributions are counted and scattered to their row (column for CSC) in
+ * parallel; then each row is sorted by column and its duplicates summed, in
+ * the order of thread and insertion so that the result does not depend on
+ * the scheduling. Entries summing to zero are kept in the pattern.
+ *
+ * @param c             compression format, CSR or CSC
+ * @return Matrix<T,StorageOrder,Alloc>
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+Matrix<T,StorageOrder,Alloc> ConcurrentAssembler<T,StorageOrder,Alloc>::finalize(Compression const &c)
+{
+    typedef Matrix<T,StorageOrder,Alloc> Mat;
+    if (c != CSR and c != CSC)
+    {
+        std::cerr << "concurrent assembly produces only CSR or CSC matrices" << std::endl;
+        return Mat(nrow, ncol, alloc);
+    }
+
+    // major index: row for CSR, column for CSC
+    bool row_major = (c == CSR);
+    std::size_t nmajor = row_major ? nrow : ncol;
+    std::size_t nt = buffers.size();
+    std::size_t out_of_bounds = 0;
+
+    // count contributions of each major index
+    std::vector<std::size_t> ptr(nmajor+1, 0);
+    #pragma omp parallel for schedule(dynamic) reduction(+:out_of_bounds)
+    for (std::size_t t=0; t<nt; ++t)
+    {
+        for (auto const &e : buffers[t].entries)
+        {
+            if (e.row >= nrow or e.col >= ncol)
+            {
+                ++out_of_bounds;
+                continue;
+            }
+            std::size_t m = row_major ? e.row : e.col;
+            std::atomic_ref<std::size_t>(ptr[m+1]).fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    if (out_of_bounds)
+        std::cerr << "concurrent assembly: " << out_of_bounds << " contributions out of bounds ignored" << std::endl;
+
+    for (std::size_t m=0; m<nmajor; ++m)
+        ptr[m+1] += ptr[m];
+
+    // scatter to the major index
+    std::vector<Scattered> scattered(ptr[nmajor]);
+    std::vector<std::size_t> next(ptr.cbegin(), ptr.cend()-1);
+    #pragma omp parallel for schedule(dynamic)
+    for (std::size_t t=0; t<nt; ++t)
+    {
+        auto const &entries = buffers[t].entries;
+        for (std::size_t k=0; k<entries.size(); ++k)
+        {
+            auto const &e = entries[k];
+            if (e.row >= nrow or e.col >= ncol)
+                continue;
+            std::size_t m = row_major ? e.row : e.col;
+            std::size_t p = std::atomic_ref<std::size_t>(next[m]).fetch_add(1, std::memory_order_relaxed);
+            scattered[p] = { row_major ? e.col : e.row, (static_cast<std::uint64_t>(t) << 40) | k, e.value };
+        }
+    }
+    clear();
+
+    // sort each major index by minor index and origin, sum the duplicates in place
+    std::vector<std::size_t> unique(nmajor+1, 0);
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (std::size_t m=0; m<nmajor; ++m)
+    {
+        auto first = scattered.begin() + ptr[m];
+        auto last = scattered.begin() + ptr[m+1];
+        std::sort(first, last, [](Scattered const &a, Scattered const &b)
+        {
+            return a.col < b.col or (a.col == b.col and a.origin < b.origin);
+        });
+        std::size_t n = 0;
+        for (auto it=first; it!=last; ++it)
+        {
+            if (n and (first+n-1)->col == it->col)
+                (first+n-1)->value += it->value;
+            else
+                *(first + n++) = *it;
+        }
+        unique[m+1] = n;
+    }
+
+    // compressed vectors
+    for (std::size_t m=0; m<nmajor; ++m)
+        unique[m+1] += unique[m];
+    typename Mat::index_vector major(unique.cbegin(), unique.cend(), alloc);
+    typename Mat::index_vector minor(unique[nmajor], 0, alloc);
+    typename Mat::value_vector values(unique[nmajor], T(0), alloc);
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (std::size_t m=0; m<nmajor; ++m)
+    {
+        for (std::size_t k=0; k<unique[m+1]-unique[m]; ++k)
+        {
+            minor[ unique[m]+k ] = scattered[ ptr[m]+k ].col;
+            values[ unique[m]+k ] = scattered[ ptr[m]+k ].value;
+        }
+    }
+
+    if (row_major)
+        return Mat(nrow, ncol, std::move(major), std::move(minor), std::move(values), CSR);
+    return Mat(nrow, ncol, std::move(minor), std::move(major), std::move(values), CSC);
+}
+
+} // namespace algebra
+
+#endif
@@ -0,0 +1,407 @@
+/**
+ * @file
+ *
+ * @brief Storage format autotuner for algebra::Matrix.
+ *
+ * Sparsity features of a CSR matrix (row length statistics, diagonal and
+ * block structure) prune the candidate formats, then the remaining
+ * candidates are converted and timed with repeated matrix-vector products.
+ * The fastest format is applied to the matrix. Decisions are cached on disk,
+ * indexed by a fingerprint of the sparsity pattern, so the same matrix is
+ * tuned only once on the same machine.
+ *
+ * @author Luca Brambilla <luca13.brambilla@mail.polimi.it>
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <fstream>
+#include <sstream>
+
+#include "Matrix.hpp"
+
+#ifndef AUTOTUNER_HPP
+#define AUTOTUNER_HPP
+
+namespace algebra{
+
+/**
+ * @brief Features of the sparsity pattern used to prune the candidate formats.
+ */
+struct SparsityFeatures
+{
+    /// shape and number of stored elements
+    std::size_t nrow = 0;
+    std::size_t ncol = 0;
+    std::size_t nnz = 0;
+    /// row length statistics
+    double row_mean = 0.;
+    double row_variance = 0.;
+    std::size_t row_max = 0;
+    /// number of stored diagonals, and fraction of DIA storage holding elements
+    std::size_t ndiag = 0;
+    double diag_fill = 0.;
+    /// fraction of ELL storage holding elements
+    double ell_fill = 0.;
+};
+
+/**
+ * @brief Parameters of the format autotuner.
+ */
+struct TunerParameters
+{
+    /// block sizes tried for BSR
+    std::vector<std::size_t> blocks = {2, 4};
+    /// ELL, DIA and BSR are not timed if the fraction of useful storage is lower
+    double min_fill = 0.5;
+    /// timed products for each candidate, the median is taken
+    std::size_t repetitions = 11;
+    /// path of the cache file, no cache if empty
+    std::string cache = "";
+};
+
+/**
+ * @brief Format chosen by the autotuner.
+ */
+struct TuningResult
+{
+    Compression format = CSR;
+    /// block size, only meaningful for BSR
+    std::size_t block = 1;
+    /// median time of a product in seconds (0 if read from the cache)
+    double time = 0.;
+    /// number of timed candidates
+    std::size_t candidates = 0;
+    /// decision read from the cache
+    bool cached = false;
+};
+
+/**
+ * @brief Compute the sparsity features of a compressed CSR matrix.
+ *
+ * @param A             Matrix object, compressed CSR
+ * @return SparsityFeatures
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+SparsityFeatures sparsity_features(Matrix<T,StorageOrder,Alloc> const &A)
+{
+    SparsityFeatures f;
+    auto const &IA = A.ia();
+    auto const &JA = A.ja();
+    f.nrow = A.nrows();
+    f.ncol = A.ncols();
+    f.nnz = JA.size();
+    if (f.nrow == 0 or f.nnz == 0)
+        return f;
+
+    // row lengths
+    for (std::size_t i=0; i<f.nrow; ++i)
+    {
+        std::size_t len = IA[i+1] - IA[i];
+        f.row_max = std::max(f.row_max, len);
+        f.row_variance += static_cast<double>(len) * len;
+    }
+    f.row_mean = static_cast<double>(f.nnz) / f.nrow;
+    f.row_variance = f.row_variance / f.nrow - f.row_mean * f.row_mean;
+    f.ell_fill = static_cast<double>(f.nnz) / (f.nrow * f.row_max);
+
+    // diagonals, offset j-i shifted by nrow-1
+    std::vector<char> present(f.nrow + f.ncol, 0);
+    for (std::size_t i=0; i<f.nrow; ++i)
+        for (std::size_t k=IA[i]; k<IA[i+1]; ++k)
+            present[ JA[k] + f.nrow-1 - i ] = 1;
+    f.ndiag = std::count(present.cbegin(), present.cend(), 1);
+    f.diag_fill = static_cast<double>(f.nnz) / (f.ndiag * f.nrow);
+
+    return f;
+}
+
+/**
+ * @brief Fraction of the BSR storage holding elements, for a compressed CSR
+ * matrix and a given block size.
+ *
+ * @param A             Matrix object, compressed CSR
+ * @param b             block size
+ * @return double
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+double block_fill(Matrix<T,StorageOrder,Alloc> const &A, std::size_t const &b)
+{
+    auto const &IA = A.ia();
+    auto const &JA = A.ja();
+    std::size_t nrow = A.nrows();
+    if (b == 0 or JA.empty())
+        return 0.;
+
+    // distinct block columns of each block row
+    std::size_t nblocks = 0;
+    std::vector<std::size_t> cols;
+    for (std::size_t ib=0; ib*b<nrow; ++ib)
+    {
+        cols.clear();
+        for (std::size_t k=IA[ib*b]; k<IA[std::min(nrow, (ib+1)*b)]; ++k)
+            cols.push_back(JA[k] / b);
+        std::sort(cols.begin(), cols.end());
+        nblocks += std::unique(cols.begin(), cols.end()) - cols.begin();
+    }
+    return static_cast<double>(JA.size()) / (nblocks * b * b);
+}
+
+/**
+ * @brief FNV-1a hash of the shape, the sparsity pattern and the data type of a
+ * compressed CSR matrix.
+ *
+ * @param A             Matrix object, compressed CSR
+ * @return std::uint64_t
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+std::uint64_t fingerprint(Matrix<T,StorageOrder,Alloc> const &A)
+{
+    std::uint64_t h = 14695981039346656037ull;
+    auto add = [&h](std::uint64_t v)
+    {
+        for (int byte=0; byte<8; ++byte)
+        {
+            h ^= (v >> (8*byte)) & 0xff;
+            h *= 1099511628211ull;
+        }
+    };
+
+    add(A.nrows());
+    add(A.ncols());
+    add(sizeof(T));
+    add(is_complex<T>::value);
+    for (auto i : A.ia())
+        add(i);
+    for (auto j : A.ja())
+        add(j);
+    return h;
+}
+
+/**
+ * @brief Storage format autotuner: chooses among CSR, CSC, ELL, BSR and DIA
+ * the fastest format for the matrix-vector product of a given matrix.
+ *
+ * @tparam T                Data type
+ * @tparam StorageOrder     Storage ordering of the Matrix
+ * @tparam Alloc            Allocator of the Matrix
+ */
+template<typename T, typename StorageOrder, typename Alloc = std::allocator<T>>
+class FormatTuner
+{
+public:
+    FormatTuner(TunerParameters const &p=TunerParameters()) : param(p) {};
+
+    TuningResult tune(Matrix<T,StorageOrder,Alloc> &A);
+
+    /**
+     * @brief Get the features of the last tuned matrix
+     */
+    SparsityFeatures const & features() const { return feat; };
+
+private:
+    Matrix<T,StorageOrder,Alloc> convert(Matrix<T,StorageOrder,Alloc> const &A, Compression const &c,
+                                         std::size_t const &b) const;
+    double time_product(Matrix<T,StorageOrder,Alloc> const &A);
+    bool read_cache(std::uint64_t const &key, TuningResult &res) const;
+    void write_cache(std::uint64_t const &key, TuningResult const &res) const;
+
+    TunerParameters param;
+    SparsityFeatures feat;
+
+    /// vectors of the timed products
+    std::vector<T> x, y;
+    std::vector<double> times;
+};
+
+/**
+ * @brief Tune the storage format of a compressed CSR matrix and convert the
+ * matrix to the fastest format.
+ *
+ * @param A             Matrix object, compressed CSR, converted in place
+ * @return TuningResult
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+TuningResult FormatTuner<T,StorageOrder,Alloc>::tune(Matrix<T,StorageOrder,Alloc> &A)
+{
+    TuningResult res;
+    if (!A.is_compressed() or A.compression_type() != Compression::CSR)
+    {
+        std::cerr << "format tuning requires a CSR compressed matrix" << std::endl;
+        return res;
+    }
+
+    feat = sparsity_features(A);
+    std::uint64_t key = fingerprint(A);
+
+    if (!read_cache(key, res))
+    {
+        // candidates surviving the pruning, CSR and CSC are always timed
+        std::vector<std::pair<Compression, std::size_t>> candidates{ {CSR, 1}, {CSC, 1} };
+        if (feat.ell_fill >= param.min_fill)
+            candidates.emplace_back(ELL, 1);
+        if (feat.diag_fill >= param.min_fill)
+            candidates.emplace_back(DIA, 1);
+        for (auto b : param.blocks)
+        {
+            if (b > 1 and block_fill(A, b) >= param.min_fill)
+                candidates.emplace_back(BSR, b);
+        }
+
+        x.assign(A.ncols(), T(1));
+        res.time = time_product(A);
+        for (std::size_t c=1; c<candidates.size(); ++c)
+        {
+            auto M = convert(A, candidates[c].first, candidates[c].second);
+            double t = time_product(M);
+            if (t < res.time)
+            {
+                res.time = t;
+                res.format = candidates[c].first;
+                res.block = candidates[c].second;
+            }
+        }
+        res.candidates = candidates.size();
+        write_cache(key, res);
+    }
+
+    if (res.format != CSR)
+        A = convert(A, res.format, res.block);
+
+    return res;
+}
+
+/**
+ * @brief Copy of a compressed CSR matrix in another format. CSC is obtained
+ * transposing the compressed vectors, the other formats from the coordinate
+ * representation.
+ *
+ * @param A             Matrix object, compressed CSR
+ * @param c             compression format
+ * @param b             block size, only for BSR
+ * @return Matrix<T,StorageOrder,Alloc>
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+Matrix<T,StorageOrder,Alloc> FormatTuner<T,StorageOrder,Alloc>::convert(Matrix<T,StorageOrder,Alloc> const &A,
+    Compression const &c, std::size_t const &b) const
+{
+    if (c != CSC)
+    {
+        Matrix<T,StorageOrder,Alloc> M(A);
+        M.uncompress();
+        M.compress(c, b);
+        return M;
+    }
+
+    auto const &IA = A.ia();
+    auto const &JA = A.ja();
+    auto const &AA = A.aa();
+    std::size_t nrow = A.nrows(), ncol = A.ncols();
+
+    // count elements of each column, then scatter row by row: rows stay sorted
+    typename Matrix<T,StorageOrder,Alloc>::index_vector ptr(ncol+1, 0, AA.get_allocator()), rows(JA.size(), 0, AA.get_allocator());
+    typename Matrix<T,StorageOrder,Alloc>::value_vector vals(JA.size(), T(0), AA.get_allocator());
+    for (auto j : JA)
+        ++ptr[j+1];
+    for (std::size_t j=0; j<ncol; ++j)
+        ptr[j+1] += ptr[j];
+    std::vector<std::size_t> next(ptr.cbegin(), ptr.cend()-1);
+    for (std::size_t i=0; i<nrow; ++i)
+    {
+        for (std::size_t k=IA[i]; k<IA[i+1]; ++k)
+        {
+            std::size_t p = next[ JA[k] ]++;
+            rows[p] = i;
+            vals[p] = AA[k];
+        }
+    }
+    return Matrix<T,StorageOrder,Alloc>(nrow, ncol, std::move(rows), std::move(ptr), std::move(vals), CSC);
+}
+
+/**
+ * @brief Median time in seconds of the matrix-vector product, after a first
+ * untimed product.
+ *
+ * @param A             Matrix object, compressed
+ * @return double
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+double FormatTuner<T,StorageOrder,Alloc>::time_product(Matrix<T,StorageOrder,Alloc> const &A)
+{
+    std::size_t reps = std::max<std::size_t>(param.repetitions, 1);
+    times.resize(reps);
+    A.multiply(x, y);
+    for (std::size_t r=0; r<reps; ++r)
+    {
+        auto start = std::chrono::steady_clock::now();
+        A.multiply(x, y);
+        auto end = std::chrono::steady_clock::now();
+        times[r] = std::chrono::duration<double>(end - start).count();
+    }
+    std::nth_element(times.begin(), times.begin() + reps/2, times.end());
+    return times[reps/2];
+}
+
+/**
+ * @brief Look for a decision in the cache file: one line per matrix with
+ * fingerprint (hexadecimal), format and block size.
+ *
+ * @param key           fingerprint of the matrix
+ * @param res           decision, if found
+ * @return true if found
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+bool FormatTuner<T,StorageOrder,Alloc>::read_cache(std::uint64_t const &key, TuningResult &res) const
+{
+    if (param.cache.empty())
+        return false;
+
+    std::ifstream file(param.cache);
+    std::string line;
+    while (getline(file, line))
+    {
+        std::istringstream iss(line);
+        std::uint64_t k;
+        int format;
+        std::size_t b;
+        if (iss >> std::hex >> k >> std::dec >> format >> b and k == key
+            and format >= CSR and format <= DIA)
+        {
+            res.format = static_cast<Compression>(format);
+            res.block = b;
+            res.cached = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Append a decision to the cache file.
+ *
+ * @param key           fingerprint of the matrix
+ * @param res           decision
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+void FormatTuner<T,StorageOrder,Alloc>::write_cache(std::uint64_t const &key, TuningResult const &res) const
+{
+    if (param.cache.empty())
+        return;
+
+    std::ofstream file(param.cache, std::ios::app);
+    if (!file)
+    {
+        std::cerr << "cannot write tuning cache " << param.cache << std::endl;
+        return;
+    }
+    file << std::hex << key << std::dec << " " << res.format << " " << res.block << "\n";
+}
+
+} // namespace algebra
+
+#endif
@@ -0,0 +1,313 @@
+/**
+ * @file
+ *
+ * @brief Matrix-vector products of many small compressed matrices in one call.
+ *
+ * The matrices are split among the threads in ranges of similar number of
+ * elements; a thread that finishes its range steals matrices from the ranges
+ * of the others. MatrixBatch packs the matrices (and their vectors) in
+ * contiguous vectors, so a batch costs no allocation and no dispatch per
+ * matrix.
+ *
+ * @author Luca Brambilla <luca13.brambilla@mail.polimi.it>
+ */
+
+#include <cstddef>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "Matrix.hpp"
+
+#ifndef BATCHED_HPP
+#define BATCHED_HPP
+
+namespace algebra{
+
+/**
+ * @brief Call f(b) for b in [0, n) on all threads with work stealing. Tasks
+ * are split in one contiguous range per thread of similar total cost; each
+ * range is consumed from the front by its owner and, once their own range is
+ * over, by the other threads.
+ *
+ * @param n             number of tasks
+ * @param cost          cost(b), estimated cost of task b
+ * @param f             f(b), task b
+ */
+template<typename Cost, typename F>
+void work_stealing_for(std::size_t const &n, Cost cost, F f)
+{
+    if (n == 0)
+        return;
+
+    std::size_t nt = 1;
+#ifdef _OPENMP
+    nt = std::min<std::size_t>(omp_get_max_threads(), n);
+#endif
+
+    // range of each thread, by prefix sums of the costs
+    std::vector<double> prefix(n+1, 0.);
+    for (std::size_t b=0; b<n; ++b)
+        prefix[b+1] = prefix[b] + cost(b);
+
+    struct alignas(64) Range
+    {
+        std::atomic<std::size_t> next{0};
+        std::size_t end = 0;
+    };
+    std::vector<Range> ranges(nt);
+    for (std::size_t t=0; t<nt; ++t)
+    {
+        // first task whose cost starts after the share of threads before t
+        std::size_t begin = std::lower_bound(prefix.cbegin(), prefix.cend()-1, prefix[n] * t / nt) - prefix.cbegin();
+        ranges[t].next.store(begin, std::memory_order_relaxed);
+        if (t)
+            ranges[t-1].end = begin;
+    }
+    ranges[nt-1].end = n;
+
+    #pragma omp parallel num_threads(nt)
+    {
+        std::size_t t = 0;
+#ifdef _OPENMP
+        t = omp_get_thread_num();
+#endif
+        // own range first, then the others in turn
+        for (std::size_t v=0; v<nt; ++v)
+        {
+            Range &r = ranges[(t+v) % nt];
+            for (std::size_t b=r.next.fetch_add(1, std::memory_order_relaxed); b<r.end;
+                 b=r.next.fetch_add(1, std::memory_order_relaxed))
+                f(b);
+        }
+    }
+}
+
+/**
+ * @brief Products m[b] * x[b] of a batch of compressed matrices, computed in
+ * parallel with work stealing.
+ *
+ * @param m             compressed matrices
+ * @param x             input vectors, x[b] of size m[b].ncols()
+ * @param y             output vectors, resized if needed
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+void batched_multiply(std::vector<Matrix<T,StorageOrder,Alloc>> const &m,
+                      std::vector<std::vector<T>> const &x, std::vector<std::vector<T>> &y)
+{
+    if (x.size() != m.size())
+    {
+        std::cerr << "batch sizes are not compatible: " << m.size() << " matrices, "
+                  << x.size() << " vectors" << std::endl;
+        return;
+    }
+    for (std::size_t b=0; b<m.size(); ++b)
+    {
+        if (x[b].size() != m[b].ncols())
+        {
+            std::cerr << "sizes are not compatible for multiplication of matrix " << b << ": ("
+                      << m[b].nrows() << ", " << m[b].ncols() << ") * (" << x[b].size() << ", 1)" << std::endl;
+            return;
+        }
+    }
+    y.resize(m.size());
+
+    work_stealing_for(m.size(),
+        [&](std::size_t const &b) { return static_cast<double>(m[b].aa().size() + m[b].nrows()); },
+        [&](std::size_t const &b) { m[b].multiply(x[b], y[b]); });
+}
+
+/**
+ * @brief Batch of CSR matrices packed in contiguous vectors. The input and
+ * output vectors of the batch are packed as well: those of matrix b start at
+ * col_offset(b) and row_offset(b).
+ *
+ * @tparam T        Data type
+ */
+template<typename T>
+class MatrixBatch
+{
+public:
+    MatrixBatch() = default;
+
+    template<typename StorageOrder, typename Alloc>
+    bool add(Matrix<T,StorageOrder,Alloc> const &A);
+
+    void multiply(std::vector<T> const &x, std::vector<T> &y) const;
+    void multiply(std::vector<std::vector<T>> const &x, std::vector<std::vector<T>> &y) const;
+
+    /**
+     * @brief Get number of matrices
+     */
+    std::size_t size() const { return rows.size() - 1; };
+
+    /**
+     * @brief Get number of rows of matrix b
+     */
+    std::size_t nrows(std::size_t const &b) const { return rows[b+1] - rows[b]; };
+
+    /**
+     * @brief Get number of columns of matrix b
+     */
+    std::size_t ncols(std::size_t const &b) const { return cols[b+1] - cols[b]; };
+
+    /**
+     * @brief Get first row of matrix b in the packed output vector
+     */
+    std::size_t row_offset(std::size_t const &b) const { return rows[b]; };
+
+    /**
+     * @brief Get first column of matrix b in the packed input vector
+     */
+    std::size_t col_offset(std::size_t const &b) const { return cols[b]; };
+
+    /**
+     * @brief Get size of the packed output vector
+     */
+    std::size_t total_rows() const { return rows.back(); };
+
+    /**
+     * @brief Get size of the packed input vector
+     */
+    std::size_t total_cols() const { return cols.back(); };
+
+    void reserve(std::size_t const &matrices, std::size_t const &total_rows, std::size_t const &nnz);
+
+private:
+    void multiply_one(std::size_t const &b, T const *x, T *y) const;
+
+    /// first row and first column of each matrix, and totals
+    std::vector<std::size_t> rows{0};
+    std::vector<std::size_t> cols{0};
+
+    /// row pointers of all matrices, relative to the first element of the batch
+    std::vector<std::size_t> IA{0};
+    /// column indices, local to each matrix
+    std::vector<std::size_t> JA;
+    std::vector<T> AA;
+};
+
+/**
+ * @brief Reserve space for the matrices to be added.
+ *
+ * @param matrices      number of matrices
+ * @param total_rows    total number of rows
+ * @param nnz           total number of elements
+ */
+template<typename T>
+void MatrixBatch<T>::reserve(std::size_t const &matrices, std::size_t const &total_rows, std::size_t const &nnz)
+{
+    rows.reserve(matrices+1);
+    cols.reserve(matrices+1);
+    IA.reserve(total_rows+1);
+    JA.reserve(nnz);
+    AA.reserve(nnz);
+}
+
+/**
+ * @brief Append a copy of a compressed CSR matrix to the batch.
+ *
+ * @param A             Matrix object, compressed CSR
+ * @return true if the matrix has been added
+ */
+template<typename T>
+template<typename StorageOrder, typename Alloc>
+bool MatrixBatch<T>::add(Matrix<T,StorageOrder,Alloc> const &A)
+{
+    if (!A.is_compressed() or A.compression_type() != CSR)
+    {
+        std::cerr << "batches require CSR compressed matrices" << std::endl;
+        return false;
+    }
+
+    std::size_t base = AA.size();
+    for (std::size_t i=1; i<=A.nrows(); ++i)
+        IA.push_back(base + A.ia()[i]);
+    JA.insert(JA.end(), A.ja().cbegin(), A.ja().cend());
+    AA.insert(AA.end(), A.aa().cbegin(), A.aa().cend());
+    rows.push_back(rows.back() + A.nrows());
+    cols.push_back(cols.back() + A.ncols());
+    return true;
+}
+
+/**
+ * @brief Product of matrix b with its input vector.
+ */
+template<typename T>
+void MatrixBatch<T>::multiply_one(std::size_t const &b, T const *x, T *y) const
+{
+    std::size_t const *ptr = IA.data() + rows[b];
+    for (std::size_t i=0; i<nrows(b); ++i)
+    {
+        T sum = 0;
+        for (std::size_t k=ptr[i]; k<ptr[i+1]; ++k)
+            sum += AA[k] * x[ JA[k] ];
+        y[i] = sum;
+    }
+}
+
+/**
+ * @brief Products of all matrices with packed vectors.
+ *
+ * @param x             packed input vectors, size total_cols()
+ * @param y             packed output vectors, size total_rows()
+ */
+template<typename T>
+void MatrixBatch<T>::multiply(std::vector<T> const &x, std::vector<T> &y) const
+{
+    ALGEBRA_PERF_SCOPE("MatrixBatch::multiply");
+    if (x.size() != total_cols())
+    {
+        std::cerr << "packed vector of size " << x.size() << " instead of " << total_cols() << std::endl;
+        return;
+    }
+    if (y.size() != total_rows())
+        y.resize(total_rows());
+
+    work_stealing_for(size(),
+        [&](std::size_t const &b) { return static_cast<double>(IA[rows[b+1]] - IA[rows[b]] + nrows(b)); },
+        [&](std::size_t const &b) { multiply_one(b, x.data() + cols[b], y.data() + rows[b]); });
+}
+
+/**
+ * @brief Products of all matrices with separate vectors.
+ *
+ * @param x             input vectors, x[b] of size ncols(b)
+ * @param y             output vectors, resized if needed
+ */
+template<typename T>
+void MatrixBatch<T>::multiply(std::vector<std::vector<T>> const &x, std::vector<std::vector<T>> &y) const
+{
+    ALGEBRA_PERF_SCOPE("MatrixBatch::multiply");
+    if (x.size() != size())
+    {
+        std::cerr << "batch sizes are not compatible: " << size() << " matrices, "
+                  << x.size() << " vectors" << std::endl;
+        return;
+    }
+    for (std::size_t b=0; b<size(); ++b)
+    {
+        if (x[b].size() != ncols(b))
+        {
+            std::cerr << "sizes are not compatible for multiplication of matrix " << b << ": ("
+                      << nrows(b) << ", " << ncols(b) << ") * (" << x[b].size() << ", 1)" << std::endl;
+            return;
+        }
+    }
+    y.resize(size());
+    for (std::size_t b=0; b<size(); ++b)
+        y[b].resize(nrows(b));
+
+    work_stealing_for(size(),
+        [&](std::size_t const &b) { return static_cast<double>(IA[rows[b+1]] - IA[rows[b]] + nrows(b)); },
+        [&](std::size_t const &b) { multiply_one(b, x[b].data(), y[b].data()); });
+}
+
+} // namespace algebra
+
+#endif
@@ -0,0 +1,174 @@
+/**
+ * @file
+ *
+ * @brief Minimal benchmark harness: repeated timings of a kernel with an
+ * untimed setup before each repetition, reported as median and 99th
+ * percentile together with the throughput (GFLOP/s) and the effective
+ * bandwidth (GB/s). Results can be written as JSON to track regressions.
+ *
+ * @author Luca Brambilla <luca13.brambilla@mail.polimi.it>
+ */
+
+#include <cstddef>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <string>
+
+#include "Matrix.hpp"
+
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+namespace algebra{
+
+/**
+ * @brief Timings of a kernel on a matrix in a given format.
+ */
+struct BenchmarkRecord
+{
+    std::string matrix;
+    std::string type;
+    std::string format;
+    std::string kernel;
+    /// shape and number of elements of the matrix
+    std::size_t nrow = 0;
+    std::size_t ncol = 0;
+    std::size_t nnz = 0;
+    /// timed repetitions
+    std::size_t repetitions = 0;
+    /// median and 99th percentile of the time of one repetition, in seconds
+    double median = 0.;
+    double p99 = 0.;
+    /// floating point operations and bytes moved by one repetition
+    double flops = 0.;
+    double bytes = 0.;
+
+    /**
+     * @brief Throughput at the median time
+     */
+    double gflops() const { return median > 0 ? flops / median * 1e-9 : 0.; };
+
+    /**
+     * @brief Effective bandwidth at the median time
+     */
+    double gbps() const { return median > 0 ? bytes / median * 1e-9 : 0.; };
+};
+
+/**
+ * @brief Bytes of the compressed vectors of a matrix, or an estimate of the
+ * coordinate representation (index pair and value for each element).
+ *
+ * @param A             Matrix object
+ * @param nnz           number of elements, used for the uncompressed matrix
+ * @return double
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+double storage_bytes(Matrix<T,StorageOrder,Alloc> const &A, std::size_t const &nnz)
+{
+    if (!A.is_compressed())
+        return static_cast<double>(nnz) * (2*sizeof(std::size_t) + sizeof(T));
+    return static_cast<double>(A.ia().size() + A.ja().size()) * sizeof(std::size_t)
+         + static_cast<double>(A.aa().size()) * sizeof(T);
+}
+
+/**
+ * @brief Collection of benchmark records.
+ */
+class BenchmarkSuite
+{
+public:
+    /**
+     * @brief Time a kernel: setup() runs untimed before each call of kernel().
+     * A first untimed call warms up caches and memory pools.
+     *
+     * @param rec           record with names, shape, flops and bytes filled
+     * @param reps          timed repetitions
+     * @param setup         untimed preparation of each repetition
+     * @param kernel        timed kernel
+     * @return BenchmarkRecord const& the record with the timings
+     */
+    template<typename Setup, typename Kernel>
+    BenchmarkRecord const & run(BenchmarkRecord rec, std::size_t const &reps, Setup setup, Kernel kernel)
+    {
+        rec.repetitions = std::max<std::size_t>(reps, 1);
+        times.resize(rec.repetitions);
+
+        setup();
+        kernel();
+        for (std::size_t r=0; r<rec.repetitions; ++r)
+        {
+            setup();
+            auto start = std::chrono::steady_clock::now();
+            kernel();
+            auto end = std::chrono::steady_clock::now();
+            times[r] = std::chrono::duration<double>(end - start).count();
+        }
+
+        // nearest rank percentiles
+        std::sort(times.begin(), times.end());
+        rec.median = times[(rec.repetitions-1) / 2];
+        rec.p99 = times[ (99*rec.repetitions + 99) / 100 - 1 ];
+        records.push_back(rec);
+        return records.back();
+    };
+
+    /**
+     * @brief Get all records
+     */
+    std::vector<BenchmarkRecord> const & results() const { return records; };
+
+    void print(std::ostream &os) const;
+    void write_json(std::ostream &os) const;
+
+private:
+    std::vector<BenchmarkRecord> records;
+    std::vector<double> times;
+};
+
+/**
+ * @brief Print the records as a table.
+ *
+ * @param os            output stream
+ */
+inline void BenchmarkSuite::print(std::ostream &os) const
+{
+    os << std::left << std::setw(20) << "matrix" << std::setw(6) << "fmt"
+       << std::setw(12) << "kernel" << std::right << std::setw(13) << "median [s]"
+       << std::setw(13) << "p99 [s]" << std::setw(10) << "GFLOP/s" << std::setw(10) << "GB/s" << "\n";
+    for (auto const &r : records)
+    {
+        os << std::left << std::setw(20) << r.matrix << std::setw(6) << r.format
+           << std::setw(12) << r.kernel << std::right << std::scientific << std::setprecision(3)
+           << std::setw(13) << r.median << std::setw(13) << r.p99 << std::fixed << std::setprecision(3)
+           << std::setw(10) << r.gflops() << std::setw(10) << r.gbps() << "\n";
+    }
+    os << std::defaultfloat << std::flush;
+}
+
+/**
+ * @brief Write the records as a JSON array of objects, one per record.
+ *
+ * @param os            output stream
+ */
+inline void BenchmarkSuite::write_json(std::ostream &os) const
+{
+    os << "[\n" << std::setprecision(9);
+    for (std::size_t k=0; k<records.size(); ++k)
+    {
+        auto const &r = records[k];
+        os << "  {\"matrix\": \"" << r.matrix << "\", \"type\": \"" << r.type
+           << "\", \"format\": \"" << r.format << "\", \"kernel\": \"" << r.kernel
+           << "\", \"nrow\": " << r.nrow << ", \"ncol\": " << r.ncol << ", \"nnz\": " << r.nnz
+           << ", \"repetitions\": " << r.repetitions << ", \"median_s\": " << r.median
+           << ", \"p99_s\": " << r.p99 << ", \"gflops\": " << r.gflops()
+           << ", \"gbps\": " << r.gbps() << "}" << (k+1 < records.size() ? ",\n" : "\n");
+    }
+    os << "]" << std::endl;
+}
+
+} // namespace algebra
+
+#endif
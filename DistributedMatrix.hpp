@@ -0,0 +1,306 @@
+/**
+ * @file
+ *
+ * @brief Row-partitioned distributed sparse matrix over MPI.
+ *
+ * Each rank owns a contiguous block of rows, read with the Matrix Market
+ * constructor of algebra::Matrix, and the matching block of the vectors.
+ * The entries of each rank are split into a local part, with columns owned
+ * by the rank, and a remote part, with columns owned by other ranks (ghost
+ * entries of x). The matrix-vector product exchanges the ghost entries with
+ * non-blocking communication, overlapped with the product of the local part.
+ *
+ * @author Luca Brambilla <luca13.brambilla@mail.polimi.it>
+ */
+
+#include <cstddef>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <string>
+#include <fstream>
+#include <sstream>
+
+#include <mpi.h>
+
+#include "Matrix.hpp"
+
+#ifndef DISTRIBUTED_MATRIX_HPP
+#define DISTRIBUTED_MATRIX_HPP
+
+namespace algebra{
+
+/**
+ * @brief Distributed sparse matrix with a block of CSR rows on each rank.
+ *
+ * @tparam T                Data type
+ * @tparam StorageOrder     Storage ordering of the local Matrix blocks
+ * @tparam Alloc            Allocator of the local Matrix blocks
+ */
+template<typename T, typename StorageOrder, typename Alloc = std::allocator<T>>
+class DistributedMatrix
+{
+public:
+    DistributedMatrix(std::string const &name, MPI_Comm const &c=MPI_COMM_WORLD);
+
+    void multiply(std::vector<T> const &x, std::vector<T> &y) const;
+
+    /**
+     * @brief Get number of global rows
+     */
+    std::size_t nrows() const { return nrow; };
+
+    /**
+     * @brief Get number of global columns
+     */
+    std::size_t ncols() const { return ncol; };
+
+    /**
+     * @brief Get number of rows owned by this rank
+     */
+    std::size_t local_rows() const { return row_end - row_begin; };
+
+    /**
+     * @brief Get first global row owned by this rank
+     */
+    std::size_t first_row() const { return row_begin; };
+
+    /**
+     * @brief Get number of ghost entries of x received by this rank
+     */
+    std::size_t ghosts() const { return ghost_cols.size(); };
+
+private:
+    /// communicator
+    MPI_Comm comm;
+    /// rank and number of processes
+    int rank = 0;
+    int size = 1;
+
+    /// global shape
+    std::size_t nrow = 0;
+    std::size_t ncol = 0;
+    /// first global row of each rank, size+1 values
+    std::vector<std::size_t> partition;
+    /// rows owned by this rank [row_begin, row_end)
+    std::size_t row_begin = 0;
+    std::size_t row_end = 0;
+
+    /// entries with columns owned by this rank, local numbering
+    Matrix<T,StorageOrder,Alloc> local;
+    /// entries with columns owned by other ranks, ghost numbering
+    Matrix<T,StorageOrder,Alloc> remote;
+
+    /// global column of each ghost entry, sorted (so grouped by owner)
+    std::vector<std::size_t> ghost_cols;
+    /// ranks to receive from, and offsets of their ghost entries
+    std::vector<int> recv_ranks;
+    std::vector<std::size_t> recv_ptr;
+    /// ranks to send to, offsets and local indices of the entries to send
+    std::vector<int> send_ranks;
+    std::vector<std::size_t> send_ptr;
+    std::vector<std::size_t> send_index;
+
+    /// communication buffers
+    mutable std::vector<T> send_buffer;
+    mutable std::vector<T> ghost_buffer;
+    mutable std::vector<MPI_Request> requests;
+};
+
+/**
+ * @brief Construct the distributed matrix reading a block of rows on each
+ * rank from a file in matrix market format, then set up the communication
+ * pattern of the matrix-vector product. The matrix must be square: every
+ * rank rejects other shapes, leaving an empty matrix.
+ *
+ * @param name          String containing the path to the file to read
+ * @param c             MPI communicator
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+DistributedMatrix<T,StorageOrder,Alloc>::DistributedMatrix(std::string const &name, MPI_Comm const &c) :
+    comm(c)
+{
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    // global shape from the header, read by the first rank
+    unsigned long long shape[2] = {0, 0};
+    if (rank == 0)
+    {
+        std::ifstream file(name);
+        std::string line = "%";
+        while (file and line[0] == '%')
+            getline(file, line);
+        std::istringstream iss(line);
+        iss >> shape[0] >> shape[1];
+    }
+    MPI_Bcast(shape, 2, MPI_UNSIGNED_LONG_LONG, 0, comm);
+    nrow = shape[0];
+    ncol = shape[1];
+
+    // rows and vectors share one partition, columns are looked up in it
+    if (nrow != ncol)
+    {
+        if (rank == 0)
+            std::cerr << "distributed matrix must be square, file has shape ("
+                      << nrow << ", " << ncol << ")" << std::endl;
+        nrow = 0;
+        ncol = 0;
+        partition.assign(size+1, 0);
+        return;
+    }
+
+    // balanced block partition of rows, same partition for the vectors
+    partition.resize(size+1);
+    for (int r=0; r<=size; ++r)
+        partition[r] = (nrow * r) / size;
+    row_begin = partition[rank];
+    row_end = partition[rank+1];
+
+    // each rank reads only its own rows
+    Matrix<T,StorageOrder,Alloc> block(name, Row_major, row_begin, row_end);
+    block.compress(Compression::CSR);
+    auto const &IA = block.ia();
+    auto const &JA = block.ja();
+    auto const &AA = block.aa();
+    std::size_t nloc = local_rows();
+
+    // ghost columns: owned by other ranks, sorted and unique
+    for (std::size_t k=0; k<JA.size(); ++k)
+    {
+        if (JA[k] < row_begin or JA[k] >= row_end)
+            ghost_cols.push_back(JA[k]);
+    }
+    std::sort(ghost_cols.begin(), ghost_cols.end());
+    ghost_cols.erase(std::unique(ghost_cols.begin(), ghost_cols.end()), ghost_cols.end());
+
+    // split in local and remote part, columns renumbered
+    auto alloc = AA.get_allocator();
+    typename Matrix<T,StorageOrder,Alloc>::index_vector l_ia(nloc+1, 0, alloc), l_ja(alloc), r_ia(nloc+1, 0, alloc), r_ja(alloc);
+    typename Matrix<T,StorageOrder,Alloc>::value_vector l_aa(alloc), r_aa(alloc);
+    for (std::size_t i=0; i<nloc; ++i)
+    {
+        for (std::size_t k=IA[i]; k<IA[i+1]; ++k)
+        {
+            if (JA[k] >= row_begin and JA[k] < row_end)
+            {
+                l_ja.push_back(JA[k] - row_begin);
+                l_aa.push_back(AA[k]);
+            }
+            else
+            {
+                auto it = std::lower_bound(ghost_cols.cbegin(), ghost_cols.cend(), JA[k]);
+                r_ja.push_back(it - ghost_cols.cbegin());
+                r_aa.push_back(AA[k]);
+            }
+        }
+        l_ia[i+1] = l_ja.size();
+        r_ia[i+1] = r_ja.size();
+    }
+    // ghost columns are sorted, so columns stay sorted in each row of the remote part
+    local = Matrix<T,StorageOrder,Alloc>(nloc, nloc, std::move(l_ia), std::move(l_ja), std::move(l_aa));
+    remote = Matrix<T,StorageOrder,Alloc>(nloc, ghost_cols.size(), std::move(r_ia), std::move(r_ja), std::move(r_aa));
+
+    // receive lists: ghost columns grouped by owner
+    std::vector<int> recv_count(size, 0), send_count(size, 0);
+    for (auto col : ghost_cols)
+    {
+        int owner = std::upper_bound(partition.cbegin(), partition.cend(), col) - partition.cbegin() - 1;
+        ++recv_count[owner];
+    }
+    MPI_Alltoall(recv_count.data(), 1, MPI_INT, send_count.data(), 1, MPI_INT, comm);
+
+    // send lists: indices requested by the other ranks
+    std::vector<int> recv_displ(size+1, 0), send_displ(size+1, 0);
+    for (int r=0; r<size; ++r)
+    {
+        recv_displ[r+1] = recv_displ[r] + recv_count[r];
+        send_displ[r+1] = send_displ[r] + send_count[r];
+    }
+    std::vector<unsigned long long> requested(ghost_cols.cbegin(), ghost_cols.cend());
+    std::vector<unsigned long long> to_send(send_displ[size]);
+    MPI_Alltoallv(requested.data(), recv_count.data(), recv_displ.data(), MPI_UNSIGNED_LONG_LONG,
+                  to_send.data(), send_count.data(), send_displ.data(), MPI_UNSIGNED_LONG_LONG, comm);
+
+    // compact lists, only ranks with something to exchange
+    recv_ptr.push_back(0);
+    send_ptr.push_back(0);
+    for (int r=0; r<size; ++r)
+    {
+        if (recv_count[r])
+        {
+            recv_ranks.push_back(r);
+            recv_ptr.push_back(recv_displ[r+1]);
+        }
+        if (send_count[r])
+        {
+            send_ranks.push_back(r);
+            send_ptr.push_back(send_displ[r+1]);
+        }
+    }
+    send_index.resize(to_send.size());
+    for (std::size_t k=0; k<to_send.size(); ++k)
+        send_index[k] = to_send[k] - row_begin;
+
+    send_buffer.resize(send_index.size());
+    ghost_buffer.resize(ghost_cols.size());
+    requests.resize(recv_ranks.size() + send_ranks.size());
+}
+
+/**
+ * @brief Distributed matrix-vector multiplication y = A x.
+ *
+ * Both vectors are distributed as the rows: each rank passes and receives
+ * only its own block. Ghost entries are received while the local part of
+ * the product is computed, then the remote part is added.
+ *
+ * @param x             local block of the input vector
+ * @param y             local block of the output vector
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+void DistributedMatrix<T,StorageOrder,Alloc>::multiply(std::vector<T> const &x, std::vector<T> &y) const
+{
+    if (x.size() != local_rows())
+    {
+        std::cerr << "rank " << rank << ": local vector size " << x.size()
+                  << " different from local rows " << local_rows() << std::endl;
+        return;
+    }
+
+    // post receives of the ghost entries
+    std::size_t nreq = 0;
+    for (std::size_t r=0; r<recv_ranks.size(); ++r)
+    {
+        MPI_Irecv(ghost_buffer.data() + recv_ptr[r], (recv_ptr[r+1]-recv_ptr[r])*sizeof(T), MPI_BYTE,
+                  recv_ranks[r], 0, comm, &requests[nreq++]);
+    }
+
+    // pack and send the entries needed by the other ranks
+    for (std::size_t k=0; k<send_index.size(); ++k)
+        send_buffer[k] = x[ send_index[k] ];
+    for (std::size_t r=0; r<send_ranks.size(); ++r)
+    {
+        MPI_Isend(send_buffer.data() + send_ptr[r], (send_ptr[r+1]-send_ptr[r])*sizeof(T), MPI_BYTE,
+                  send_ranks[r], 0, comm, &requests[nreq++]);
+    }
+
+    // local part, overlapped with the communication
+    local.multiply(x, y);
+
+    // remote part, once the ghost entries are available
+    MPI_Waitall(nreq, requests.data(), MPI_STATUSES_IGNORE);
+    auto const &IA = remote.ia();
+    auto const &JA = remote.ja();
+    auto const &AA = remote.aa();
+    for (std::size_t i=0; i<local_rows(); ++i)
+    {
+        T sum = 0;
+        for (std::size_t k=IA[i]; k<IA[i+1]; ++k)
+            sum += AA[k] * ghost_buffer[ JA[k] ];
+        y[i] += sum;
+    }
+}
+
+} // namespace algebra
+
+#endif
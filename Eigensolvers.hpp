@@ -0,0 +1,902 @@
+/**
+ * @file
+ *
+ * @brief Eigensolvers for a few extreme eigenpairs of a sparse algebra::Matrix:
+ * thick-restarted Lanczos for symmetric (hermitian) matrices and implicitly
+ * restarted Arnoldi for general matrices.
+ *
+ * Both methods only use the matrix-vector product Matrix::multiply and work
+ * on real and complex data. The Krylov basis is orthogonalized with blocked
+ * classical Gram-Schmidt with reorthogonalization: the projections on all
+ * the basis vectors are computed and subtracted block by block, so the new
+ * vector is read from memory once per pass instead of once per basis vector.
+ *
+ * @author Luca Brambilla <luca13.brambilla@mail.polimi.it>
+ */
+
+#include <cstddef>
+#include <vector>
+#include <iostream>
+#include <cmath>
+#include <complex>
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include <random>
+
+#include "Matrix.hpp"
+
+#ifndef EIGENSOLVERS_HPP
+#define EIGENSOLVERS_HPP
+
+namespace algebra{
+
+/// Enumerator for the part of the spectrum to compute
+enum Spectrum {Largest_magnitude, Largest_real, Smallest_real};
+
+/// Parameters of the eigensolvers
+struct EigenParameters
+{
+    /// number of wanted eigenpairs
+    std::size_t nev = 4;
+    /// dimension of the Krylov subspace, ncv > nev
+    std::size_t ncv = 20;
+    /// maximum number of restarts
+    std::size_t max_restarts = 500;
+    /// tolerance on the relative residual of the Ritz pairs
+    double tol = 1e-10;
+    /// wanted part of the spectrum
+    Spectrum which = Largest_magnitude;
+};
+
+/// Outcome of an eigensolver
+struct EigenResult
+{
+    /// true if all the wanted eigenpairs converged
+    bool converged = false;
+    /// number of converged eigenpairs
+    std::size_t nconv = 0;
+    /// number of restarts performed
+    std::size_t restarts = 0;
+    /// number of matrix-vector products
+    std::size_t products = 0;
+};
+
+/**
+ * @brief Blocked orthogonalization of w against the first k vectors of V,
+ * with one step of reorthogonalization (CGS2). The projection coefficients
+ * are added to h; the norm of the orthogonalized w is returned.
+ *
+ * @param V             basis vectors, orthonormal
+ * @param k             number of basis vectors to use
+ * @param w             vector to orthogonalize
+ * @param h             projection coefficients, size at least k
+ * @param c             work vector, size at least k
+ * @return double
+ */
+template<typename T>
+double block_orthogonalize(std::vector<std::vector<T>> const &V, std::size_t const &k,
+                           std::vector<T> &w, std::vector<T> &h, std::vector<T> &c)
+{
+    constexpr std::size_t block = 256;
+    std::size_t n = w.size();
+    std::fill(h.begin(), h.begin()+k, T(0));
+
+    for (int pass=0; pass<2; ++pass)
+    {
+        std::fill(c.begin(), c.begin()+k, T(0));
+
+        // c = V^H w, block by block
+        #pragma omp parallel
+        {
+            std::vector<T> local(k, T(0));
+
+            #pragma omp for
+            for (std::size_t ib=0; ib<n; ib+=block)
+            {
+                std::size_t ie = std::min(ib+block, n);
+                for (std::size_t j=0; j<k; ++j)
+                {
+                    T s = 0;
+                    for (std::size_t i=ib; i<ie; ++i)
+                        s += conjugate(V[j][i]) * w[i];
+                    local[j] += s;
+                }
+            }
+
+            #pragma omp critical
+            for (std::size_t j=0; j<k; ++j)
+                c[j] += local[j];
+        }
+
+        // w = w - V c, block by block
+        #pragma omp parallel for
+        for (std::size_t ib=0; ib<n; ib+=block)
+        {
+            std::size_t ie = std::min(ib+block, n);
+            for (std::size_t j=0; j<k; ++j)
+                for (std::size_t i=ib; i<ie; ++i)
+                    w[i] -= c[j] * V[j][i];
+        }
+
+        for (std::size_t j=0; j<k; ++j)
+            h[j] += c[j];
+    }
+
+    double nrm = 0.;
+    #pragma omp parallel for reduction(+:nrm)
+    for (std::size_t i=0; i<n; ++i)
+        nrm += std::norm(w[i]);
+    return std::sqrt(nrm);
+}
+
+/**
+ * @brief Eigen-decomposition of a small real symmetric matrix with the cyclic
+ * Jacobi method.
+ *
+ * @param A             matrix, row-major m x m, destroyed
+ * @param m             size
+ * @param eig           eigenvalues
+ * @param Y             eigenvectors, row-major m x m, by columns
+ */
+inline void symmetric_eigen(std::vector<double> &A, std::size_t const &m,
+                            std::vector<double> &eig, std::vector<double> &Y)
+{
+    Y.assign(m*m, 0.);
+    for (std::size_t i=0; i<m; ++i)
+        Y[i*m+i] = 1.;
+
+    for (int sweep=0; sweep<100; ++sweep)
+    {
+        double off = 0.;
+        double tot = 0.;
+        for (std::size_t i=0; i<m; ++i)
+            for (std::size_t j=0; j<m; ++j)
+            {
+                tot += A[i*m+j]*A[i*m+j];
+                if (i != j)
+                    off += A[i*m+j]*A[i*m+j];
+            }
+        if (off <= 1e-30 * tot)
+            break;
+
+        for (std::size_t p=0; p<m; ++p)
+            for (std::size_t q=p+1; q<m; ++q)
+            {
+                double apq = A[p*m+q];
+                if (apq == 0.)
+                    continue;
+                double theta = (A[q*m+q] - A[p*m+p]) / (2.*apq);
+                double t = (theta >= 0. ? 1. : -1.) / (std::abs(theta) + std::sqrt(theta*theta + 1.));
+                double c = 1. / std::sqrt(t*t + 1.);
+                double s = t * c;
+                for (std::size_t k=0; k<m; ++k)
+                {
+                    double akp = A[k*m+p];
+                    double akq = A[k*m+q];
+                    A[k*m+p] = c*akp - s*akq;
+                    A[k*m+q] = s*akp + c*akq;
+                }
+                for (std::size_t k=0; k<m; ++k)
+                {
+                    double apk = A[p*m+k];
+                    double aqk = A[q*m+k];
+                    A[p*m+k] = c*apk - s*aqk;
+                    A[q*m+k] = s*apk + c*aqk;
+                }
+                for (std::size_t k=0; k<m; ++k)
+                {
+                    double ykp = Y[k*m+p];
+                    double ykq = Y[k*m+q];
+                    Y[k*m+p] = c*ykp - s*ykq;
+                    Y[k*m+q] = s*ykp + c*ykq;
+                }
+            }
+    }
+
+    eig.resize(m);
+    for (std::size_t i=0; i<m; ++i)
+        eig[i] = A[i*m+i];
+}
+
+/**
+ * @brief Eigen-decomposition of a small upper Hessenberg matrix: complex Schur
+ * form with the shifted QR algorithm, then eigenvectors by back substitution.
+ *
+ * @param H             matrix, row-major m x m, destroyed
+ * @param m             size
+ * @param eig           eigenvalues
+ * @param Y             eigenvectors, row-major m x m, by columns, unit norm
+ */
+inline void hessenberg_eigen(std::vector<std::complex<double>> &H, std::size_t const &m,
+                             std::vector<std::complex<double>> &eig,
+                             std::vector<std::complex<double>> &Y)
+{
+    using C = std::complex<double>;
+    constexpr double eps = std::numeric_limits<double>::epsilon();
+    auto h = [&](std::size_t i, std::size_t j) -> C & { return H[i*m+j]; };
+
+    std::vector<C> Z(m*m, C(0));
+    for (std::size_t i=0; i<m; ++i)
+        Z[i*m+i] = 1.;
+
+    double hnorm = 0.;
+    for (auto const &v : H)
+        hnorm = std::max(hnorm, std::abs(v));
+
+    std::size_t hi = m ? m-1 : 0;
+    std::size_t iter = 0;
+    while (hi > 0 and iter < 100*m)
+    {
+        // look for a negligible subdiagonal element
+        std::size_t l = hi;
+        while (l > 0 and std::abs(h(l,l-1)) > eps*(std::abs(h(l,l)) + std::abs(h(l-1,l-1)) + eps*hnorm))
+            --l;
+        if (l == hi)
+        {
+            h(hi,hi-1) = 0.;
+            --hi;
+            iter = 0;
+            continue;
+        }
+        ++iter;
+
+        // Wilkinson shift from the trailing 2x2 block, exceptional shift from time to time
+        C a = h(hi-1,hi-1), b = h(hi-1,hi), c = h(hi,hi-1), d = h(hi,hi);
+        C mu;
+        if (iter % 10 == 0)
+        {
+            mu = d + std::abs(c);
+        }
+        else
+        {
+            C tr = 0.5*(a+d);
+            C disc = std::sqrt(0.25*(a-d)*(a-d) + b*c);
+            mu = (std::abs(tr+disc-d) < std::abs(tr-disc-d)) ? tr+disc : tr-disc;
+        }
+
+        // implicit single shift QR step on the active block l..hi
+        C x = h(l,l) - mu;
+        C y = h(l+1,l);
+        for (std::size_t k=l; k<hi; ++k)
+        {
+            if (k > l)
+            {
+                x = h(k,k-1);
+                y = h(k+1,k-1);
+            }
+            double xa = std::abs(x);
+            double r = std::sqrt(xa*xa + std::norm(y));
+            if (r == 0.)
+                continue;
+            double cs;
+            C sn;
+            if (xa == 0.)
+            {
+                cs = 0.;
+                sn = 1.;
+            }
+            else
+            {
+                cs = xa / r;
+                sn = (x/xa) * std::conj(y) / r;
+            }
+
+            // rows k, k+1
+            for (std::size_t j=(k>l ? k-1 : l); j<m; ++j)
+            {
+                C t1 = h(k,j), t2 = h(k+1,j);
+                h(k,j) = cs*t1 + sn*t2;
+                h(k+1,j) = -std::conj(sn)*t1 + cs*t2;
+            }
+            // columns k, k+1
+            std::size_t iend = std::min(k+2, hi);
+            for (std::size_t i=0; i<=iend; ++i)
+            {
+                C t1 = h(i,k), t2 = h(i,k+1);
+                h(i,k) = cs*t1 + std::conj(sn)*t2;
+                h(i,k+1) = -sn*t1 + cs*t2;
+            }
+            for (std::size_t i=0; i<m; ++i)
+            {
+                C t1 = Z[i*m+k], t2 = Z[i*m+k+1];
+                Z[i*m+k] = cs*t1 + std::conj(sn)*t2;
+                Z[i*m+k+1] = -sn*t1 + cs*t2;
+            }
+            if (k > l)
+                h(k+1,k-1) = 0.;
+        }
+    }
+
+    eig.resize(m);
+    for (std::size_t i=0; i<m; ++i)
+        eig[i] = h(i,i);
+
+    // eigenvectors of the triangular factor, then back to the original basis
+    Y.assign(m*m, C(0));
+    std::vector<C> v(m);
+    double small = eps * std::max(hnorm, 1.);
+    for (std::size_t i=0; i<m; ++i)
+    {
+        std::fill(v.begin(), v.end(), C(0));
+        v[i] = 1.;
+        for (std::size_t j=i; j-- > 0; )
+        {
+            C s = 0.;
+            for (std::size_t k=j+1; k<=i; ++k)
+                s += h(j,k) * v[k];
+            C den = h(j,j) - eig[i];
+            if (std::abs(den) < small)
+                den = small;
+            v[j] = -s / den;
+        }
+        double nrm = 0.;
+        for (std::size_t r=0; r<m; ++r)
+        {
+            C s = 0.;
+            for (std::size_t k=0; k<=i; ++k)
+                s += Z[r*m+k] * v[k];
+            Y[r*m+i] = s;
+            nrm += std::norm(s);
+        }
+        nrm = std::sqrt(nrm);
+        for (std::size_t r=0; r<m; ++r)
+            Y[r*m+i] /= nrm;
+    }
+}
+
+/**
+ * @brief Sort indices of the eigenvalues so that the wanted ones come first.
+ */
+template<typename V>
+std::vector<std::size_t> sort_spectrum(std::vector<V> const &eig, Spectrum const &which)
+{
+    std::vector<std::size_t> idx(eig.size());
+    std::iota(idx.begin(), idx.end(), 0);
+    auto key = [&](std::size_t i) -> double
+    {
+        switch (which)
+        {
+        case Spectrum::Largest_magnitude:
+            return -std::abs(eig[i]);
+        case Spectrum::Largest_real:
+            return -std::real(eig[i]);
+        case Spectrum::Smallest_real:
+            return std::real(eig[i]);
+        } // switch(which)
+        return 0.;
+    };
+    std::stable_sort(idx.begin(), idx.end(), [&](std::size_t a, std::size_t b) { return key(a) < key(b); });
+    return idx;
+}
+
+/**
+ * @brief Starting vector of the Krylov basis: random, with a fixed seed so
+ * that results are reproducible, and unit norm.
+ */
+template<typename T>
+void start_vector(std::vector<T> &v)
+{
+    std::mt19937 gen(5489u);
+    std::uniform_real_distribution<double> dist(-1., 1.);
+    double nrm = 0.;
+    for (auto &x : v)
+    {
+        x = dist(gen);
+        nrm += std::norm(x);
+    }
+    nrm = std::sqrt(nrm);
+    for (auto &x : v)
+        x /= nrm;
+}
+
+
+/**
+ * @brief Thick-restarted Lanczos method for symmetric (hermitian) matrices.
+ *
+ * The basis is kept fully orthogonal with blocked Gram-Schmidt; at each
+ * restart the wanted Ritz vectors, plus some more to speed up convergence,
+ * are kept as the start of the new basis.
+ *
+ * @tparam T                Data type
+ * @tparam StorageOrder     Storage ordering of the Matrix
+ * @tparam Alloc            Allocator of the Matrix
+ */
+template<typename T, typename StorageOrder, typename Alloc = std::allocator<T>>
+class Lanczos
+{
+public:
+    Lanczos(EigenParameters const &p = EigenParameters()) : param(p) {};
+
+    EigenResult solve(Matrix<T,StorageOrder,Alloc> const &A);
+
+    /**
+     * @brief Get computed eigenvalues, real, wanted first
+     */
+    std::vector<double> const & eigenvalues() const { return values; };
+
+    /**
+     * @brief Get computed eigenvectors, unit norm
+     */
+    std::vector<std::vector<T>> const & eigenvectors() const { return vectors; };
+
+private:
+    /// solver parameters
+    EigenParameters param;
+    /// eigenvalues
+    std::vector<double> values;
+    /// eigenvectors
+    std::vector<std::vector<T>> vectors;
+    /// Krylov basis, ncv+1 vectors, and work vectors for the restarts
+    std::vector<std::vector<T>> V, X;
+};
+
+/**
+ * @brief Compute the wanted eigenpairs of A.
+ *
+ * @param A             Matrix object, symmetric or hermitian
+ * @return EigenResult
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+EigenResult Lanczos<T,StorageOrder,Alloc>::solve(Matrix<T,StorageOrder,Alloc> const &A)
+{
+    EigenResult res;
+    std::size_t n = A.nrows();
+    if (n != A.ncols() or n == 0)
+    {
+        std::cerr << "eigensolver requires a square matrix" << std::endl;
+        return res;
+    }
+
+    std::size_t nev = std::min(param.nev, n);
+    std::size_t m = std::min(std::max(param.ncv, nev+2), n);
+    if (m <= nev)
+        nev = m-1;
+
+    V.resize(m+1);
+    for (auto &v : V)
+        v.resize(n);
+    X.resize(m);
+    for (auto &x : X)
+        x.resize(n);
+    std::vector<T> w(n), h(m+1), c(m+1);
+    std::vector<double> Tm(m*m, 0.), Tw, theta, Y;
+
+    start_vector(V[0]);
+    std::size_t k = 0;
+    double beta = 0.;
+
+    for (res.restarts=0; res.restarts<=param.max_restarts; ++res.restarts)
+    {
+        // expand the basis from k to m
+        for (std::size_t j=k; j<m; ++j)
+        {
+            A.multiply(V[j], w);
+            ++res.products;
+            beta = block_orthogonalize(V, j+1, w, h, c);
+
+            // projected matrix, real symmetric
+            for (std::size_t i=0; i<=j; ++i)
+            {
+                Tm[i*m+j] = std::real(h[i]);
+                Tm[j*m+i] = std::real(h[i]);
+            }
+            if (j+1 < m)
+            {
+                Tm[(j+1)*m+j] = 0.;
+                Tm[j*m+j+1] = 0.;
+            }
+
+            if (beta == 0.)
+            {
+                // invariant subspace: continue with a random orthogonal vector
+                start_vector(w);
+                double nrm = block_orthogonalize(V, j+1, w, h, c);
+                for (std::size_t i=0; i<n; ++i)
+                    V[j+1][i] = w[i] / nrm;
+            }
+            else
+            {
+                for (std::size_t i=0; i<n; ++i)
+                    V[j+1][i] = w[i] / beta;
+            }
+        }
+
+        // Ritz pairs
+        Tw = Tm;
+        symmetric_eigen(Tw, m, theta, Y);
+        auto idx = sort_spectrum(theta, param.which);
+
+        res.nconv = 0;
+        double anorm = 0.;
+        for (auto t : theta)
+            anorm = std::max(anorm, std::abs(t));
+        for (std::size_t i=0; i<nev; ++i)
+        {
+            double resid = std::abs(beta * Y[(m-1)*m + idx[i]]);
+            if (resid <= param.tol * std::max(anorm, std::numeric_limits<double>::min()))
+                ++res.nconv;
+        }
+        if (res.nconv == nev or res.restarts == param.max_restarts)
+        {
+            res.converged = (res.nconv == nev);
+            break;
+        }
+
+        // thick restart: keep the k wanted (and nearby) Ritz vectors
+        k = std::min(nev + (m-nev)/2, m-1);
+        for (std::size_t l=0; l<k; ++l)
+        {
+            std::fill(X[l].begin(), X[l].end(), T(0));
+            for (std::size_t j=0; j<m; ++j)
+            {
+                double y = Y[j*m + idx[l]];
+                for (std::size_t i=0; i<n; ++i)
+                    X[l][i] += y * V[j][i];
+            }
+        }
+        for (std::size_t l=0; l<k; ++l)
+            V[l].swap(X[l]);
+        V[k].swap(V[m]);
+
+        std::fill(Tm.begin(), Tm.end(), 0.);
+        for (std::size_t l=0; l<k; ++l)
+            Tm[l*m+l] = theta[idx[l]];
+    }
+
+    // eigenpairs
+    Tw = Tm;
+    symmetric_eigen(Tw, m, theta, Y);
+    auto idx = sort_spectrum(theta, param.which);
+    values.resize(nev);
+    vectors.resize(nev);
+    for (std::size_t l=0; l<nev; ++l)
+    {
+        values[l] = theta[idx[l]];
+        vectors[l].assign(n, T(0));
+        for (std::size_t j=0; j<m; ++j)
+        {
+            double y = Y[j*m + idx[l]];
+            for (std::size_t i=0; i<n; ++i)
+                vectors[l][i] += y * V[j][i];
+        }
+    }
+
+    return res;
+}
+
+
+/**
+ * @brief Implicitly restarted Arnoldi method for general matrices.
+ *
+ * At each restart the unwanted Ritz values are used as exact shifts of QR
+ * steps on the projected Hessenberg matrix, which compress the basis to the
+ * wanted subspace. For real matrices complex conjugate shifts are applied in
+ * pairs, so that the basis stays real.
+ *
+ * @tparam T                Data type
+ * @tparam StorageOrder     Storage ordering of the Matrix
+ * @tparam Alloc            Allocator of the Matrix
+ */
+template<typename T, typename StorageOrder, typename Alloc = std::allocator<T>>
+class Arnoldi
+{
+public:
+    Arnoldi(EigenParameters const &p = EigenParameters()) : param(p) {};
+
+    EigenResult solve(Matrix<T,StorageOrder,Alloc> const &A);
+
+    /**
+     * @brief Get computed eigenvalues, wanted first
+     */
+    std::vector<std::complex<double>> const & eigenvalues() const { return values; };
+
+    /**
+     * @brief Get computed eigenvectors, unit norm
+     */
+    std::vector<std::vector<std::complex<double>>> const & eigenvectors() const { return vectors; };
+
+private:
+    /// apply the unwanted shifts to H, accumulating the transformation in Q
+    void apply_shifts(std::vector<T> &H, std::size_t const &m,
+                      std::vector<std::complex<double>> const &shifts, std::vector<T> &Q);
+
+    /// solver parameters
+    EigenParameters param;
+    /// eigenvalues
+    std::vector<std::complex<double>> values;
+    /// eigenvectors
+    std::vector<std::vector<std::complex<double>>> vectors;
+    /// Krylov basis, ncv+1 vectors, and work vectors for the restarts
+    std::vector<std::vector<T>> V, X;
+};
+
+/**
+ * @brief Apply shifted QR steps H = Q^H H Q, one for each shift (two for
+ * complex conjugate pairs of a real matrix).
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+void Arnoldi<T,StorageOrder,Alloc>::apply_shifts(std::vector<T> &H, std::size_t const &m,
+    std::vector<std::complex<double>> const &shifts, std::vector<T> &Q)
+{
+    std::vector<T> M(m*m), Qs(m*m), tmp(m*m), v(m);
+
+    for (std::size_t s=0; s<shifts.size(); ++s)
+    {
+        std::complex<double> mu = shifts[s];
+
+        // shifted matrix M = H - mu I, or (H - mu I)(H - conj(mu) I) for a real pair
+        if constexpr (is_complex<T>::value)
+        {
+            M = H;
+            for (std::size_t i=0; i<m; ++i)
+                M[i*m+i] -= T(mu);
+        }
+        else
+        {
+            if (std::abs(mu.imag()) <= 1e-12 * std::abs(mu))
+            {
+                M = H;
+                for (std::size_t i=0; i<m; ++i)
+                    M[i*m+i] -= mu.real();
+            }
+            else
+            {
+                // conjugate partner applied together, skip it later
+                if (mu.imag() < 0.)
+                    continue;
+                for (std::size_t i=0; i<m; ++i)
+                    for (std::size_t j=0; j<m; ++j)
+                    {
+                        T sum = 0;
+                        for (std::size_t l=0; l<m; ++l)
+                            sum += H[i*m+l] * H[l*m+j];
+                        M[i*m+j] = sum - 2.*mu.real()*H[i*m+j];
+                    }
+                for (std::size_t i=0; i<m; ++i)
+                    M[i*m+i] += std::norm(mu);
+            }
+        }
+
+        // Householder QR of M, Q accumulated in Qs
+        std::fill(Qs.begin(), Qs.end(), T(0));
+        for (std::size_t i=0; i<m; ++i)
+            Qs[i*m+i] = 1.;
+        for (std::size_t c=0; c+1<m; ++c)
+        {
+            double xn = 0.;
+            for (std::size_t i=c; i<m; ++i)
+                xn += std::norm(M[i*m+c]);
+            xn = std::sqrt(xn);
+            if (xn == 0.)
+                continue;
+            T x0 = M[c*m+c];
+            T alpha = (std::abs(x0) == 0.) ? T(-xn) : T(-xn) * x0 / T(std::abs(x0));
+            double vn = 0.;
+            for (std::size_t i=c; i<m; ++i)
+            {
+                v[i] = M[i*m+c] - (i == c ? alpha : T(0));
+                vn += std::norm(v[i]);
+            }
+            vn = std::sqrt(vn);
+            if (vn == 0.)
+                continue;
+            for (std::size_t i=c; i<m; ++i)
+                v[i] /= vn;
+            // M = (I - 2 v v^H) M
+            for (std::size_t j=0; j<m; ++j)
+            {
+                T d = 0;
+                for (std::size_t i=c; i<m; ++i)
+                    d += conjugate(v[i]) * M[i*m+j];
+                for (std::size_t i=c; i<m; ++i)
+                    M[i*m+j] -= 2. * v[i] * d;
+            }
+            // Qs = Qs (I - 2 v v^H)
+            for (std::size_t i=0; i<m; ++i)
+            {
+                T d = 0;
+                for (std::size_t l=c; l<m; ++l)
+                    d += Qs[i*m+l] * v[l];
+                for (std::size_t l=c; l<m; ++l)
+                    Qs[i*m+l] -= 2. * d * conjugate(v[l]);
+            }
+        }
+
+        // H = Qs^H H Qs
+        for (std::size_t i=0; i<m; ++i)
+            for (std::size_t j=0; j<m; ++j)
+            {
+                T sum = 0;
+                for (std::size_t l=0; l<m; ++l)
+                    sum += H[i*m+l] * Qs[l*m+j];
+                tmp[i*m+j] = sum;
+            }
+        for (std::size_t i=0; i<m; ++i)
+            for (std::size_t j=0; j<m; ++j)
+            {
+                T sum = 0;
+                for (std::size_t l=0; l<m; ++l)
+                    sum += conjugate(Qs[l*m+i]) * tmp[l*m+j];
+                H[i*m+j] = (i > j+1) ? T(0) : sum;
+            }
+
+        // Q = Q Qs
+        for (std::size_t i=0; i<m; ++i)
+            for (std::size_t j=0; j<m; ++j)
+            {
+                T sum = 0;
+                for (std::size_t l=0; l<m; ++l)
+                    sum += Q[i*m+l] * Qs[l*m+j];
+                tmp[i*m+j] = sum;
+            }
+        Q.swap(tmp);
+    }
+}
+
+/**
+ * @brief Compute the wanted eigenpairs of A.
+ *
+ * @param A             Matrix object
+ * @return EigenResult
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+EigenResult Arnoldi<T,StorageOrder,Alloc>::solve(Matrix<T,StorageOrder,Alloc> const &A)
+{
+    using C = std::complex<double>;
+    EigenResult res;
+    std::size_t n = A.nrows();
+    if (n != A.ncols() or n == 0)
+    {
+        std::cerr << "eigensolver requires a square matrix" << std::endl;
+        return res;
+    }
+
+    std::size_t nev = std::min(param.nev, n);
+    std::size_t m = std::min(std::max(param.ncv, nev+3), n);
+    if (m <= nev+1)
+        nev = (m > 2) ? m-2 : 1;
+
+    V.resize(m+1);
+    for (auto &v : V)
+        v.resize(n);
+    X.resize(m+1);
+    for (auto &x : X)
+        x.resize(n);
+    std::vector<T> w(n), h(m+1), c(m+1);
+    // projected Hessenberg matrix m x m, row-major, and restart transformation
+    std::vector<T> H(m*m, T(0)), Q(m*m);
+    std::vector<C> Hc(m*m), theta, Y;
+
+    start_vector(V[0]);
+    std::size_t k = 0;
+    double beta = 0.;
+
+    for (res.restarts=0; res.restarts<=param.max_restarts; ++res.restarts)
+    {
+        // expand the basis from k to m
+        for (std::size_t j=k; j<m; ++j)
+        {
+            A.multiply(V[j], w);
+            ++res.products;
+            beta = block_orthogonalize(V, j+1, w, h, c);
+
+            for (std::size_t i=0; i<=j; ++i)
+                H[i*m+j] = h[i];
+            if (j+1 < m)
+                H[(j+1)*m+j] = beta;
+
+            if (beta == 0.)
+            {
+                // invariant subspace: continue with a random orthogonal vector
+                start_vector(w);
+                double nrm = block_orthogonalize(V, j+1, w, h, c);
+                for (std::size_t i=0; i<n; ++i)
+                    V[j+1][i] = w[i] / nrm;
+                if (j+1 < m)
+                    H[(j+1)*m+j] = 0.;
+            }
+            else
+            {
+                for (std::size_t i=0; i<n; ++i)
+                    V[j+1][i] = w[i] / beta;
+            }
+        }
+
+        // Ritz pairs
+        for (std::size_t i=0; i<m*m; ++i)
+            Hc[i] = H[i];
+        hessenberg_eigen(Hc, m, theta, Y);
+        auto idx = sort_spectrum(theta, param.which);
+
+        res.nconv = 0;
+        double hnorm = 0.;
+        for (auto const &t : theta)
+            hnorm = std::max(hnorm, std::abs(t));
+        for (std::size_t i=0; i<nev; ++i)
+        {
+            double resid = std::abs(beta * Y[(m-1)*m + idx[i]]);
+            if (resid <= param.tol * std::max(hnorm, std::numeric_limits<double>::min()))
+                ++res.nconv;
+        }
+        if (res.nconv == nev or res.restarts == param.max_restarts)
+        {
+            res.converged = (res.nconv == nev);
+            break;
+        }
+
+        // number of kept vectors: do not split a complex conjugate pair of a real matrix
+        k = nev;
+        if constexpr (!is_complex<T>::value)
+        {
+            if (k < m-1 and std::abs(theta[idx[k-1]].imag()) > 0. and
+                std::abs(theta[idx[k-1]] - std::conj(theta[idx[k]])) <= 1e-10 * std::abs(theta[idx[k]]))
+                ++k;
+        }
+
+        // exact shifts: unwanted Ritz values
+        std::vector<C> shifts;
+        for (std::size_t i=k; i<m; ++i)
+            shifts.push_back(theta[idx[i]]);
+        std::fill(Q.begin(), Q.end(), T(0));
+        for (std::size_t i=0; i<m; ++i)
+            Q[i*m+i] = 1.;
+        apply_shifts(H, m, shifts, Q);
+
+        // new residual f = V Q e_{k+1} H(k,k-1) + beta v_m Q(m-1,k-1)
+        for (std::size_t l=0; l<=k; ++l)
+        {
+            std::fill(X[l].begin(), X[l].end(), T(0));
+            for (std::size_t j=0; j<m; ++j)
+            {
+                T q = Q[j*m+l];
+                for (std::size_t i=0; i<n; ++i)
+                    X[l][i] += q * V[j][i];
+            }
+        }
+        T sigma = beta * Q[(m-1)*m + k-1];
+        double fn = 0.;
+        for (std::size_t i=0; i<n; ++i)
+        {
+            w[i] = H[k*m+k-1] * X[k][i] + sigma * V[m][i];
+            fn += std::norm(w[i]);
+        }
+        fn = std::sqrt(fn);
+        for (std::size_t l=0; l<k; ++l)
+            V[l].swap(X[l]);
+        for (std::size_t i=0; i<n; ++i)
+            V[k][i] = w[i] / fn;
+
+        // truncated Hessenberg matrix
+        for (std::size_t i=0; i<m; ++i)
+            for (std::size_t j=0; j<m; ++j)
+                if (j >= k or i > k)
+                    H[i*m+j] = 0.;
+        H[k*m+k-1] = fn;
+    }
+
+    // eigenpairs
+    for (std::size_t i=0; i<m*m; ++i)
+        Hc[i] = H[i];
+    hessenberg_eigen(Hc, m, theta, Y);
+    auto idx = sort_spectrum(theta, param.which);
+    values.resize(nev);
+    vectors.resize(nev);
+    for (std::size_t l=0; l<nev; ++l)
+    {
+        values[l] = theta[idx[l]];
+        vectors[l].assign(n, C(0));
+        for (std::size_t j=0; j<m; ++j)
+        {
+            C y = Y[j*m + idx[l]];
+            for (std::size_t i=0; i<n; ++i)
+                vectors[l][i] += y * C(V[j][i]);
+        }
+    }
+
+    return res;
+}
+
+} // namespace algebra
+
+#endif
@@ -0,0 +1,369 @@
+/**
+ * @file
+ *
+ * @brief CSR matrix with dictionary-encoded values and delta-encoded column
+ * indices, for matrices with few distinct values and clustered columns.
+ *
+ * Each value is stored as an 8 or 16-bit index into a dictionary of the
+ * distinct values; the columns of each row are stored as the first column and
+ * the 8, 16 or 32-bit differences between consecutive columns, the width being
+ * chosen row by row. The product decodes both on the fly.
+ *
+ * @author Luca Brambilla <luca13.brambilla@mail.polimi.it>
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <limits>
+#include <complex>
+
+#include "Matrix.hpp"
+
+#ifndef ENCODED_MATRIX_HPP
+#define ENCODED_MATRIX_HPP
+
+namespace algebra{
+
+/**
+ * @brief Compressed CSR matrix with encoded values and column indices.
+ *
+ * @tparam T        Data type
+ */
+template<typename T>
+class EncodedMatrix
+{
+public:
+    EncodedMatrix() = default;
+
+    /**
+     * @brief Construct from a compressed CSR matrix, see encode().
+     */
+    template<typename StorageOrder, typename Alloc>
+    explicit EncodedMatrix(Matrix<T,StorageOrder,Alloc> const &A) { encode(A); };
+
+    template<typename StorageOrder, typename Alloc>
+    bool encode(Matrix<T,StorageOrder,Alloc> const &A);
+
+    void multiply(std::vector<T> const &v, std::vector<T> &res) const;
+
+    /**
+     * @brief Get number of rows
+     */
+    std::size_t nrows() const { return nrow; };
+
+    /**
+     * @brief Get number of columns
+     */
+    std::size_t ncols() const { return ncol; };
+
+    /**
+     * @brief Get number of elements
+     */
+    std::size_t nnz() const { return row_ptr.empty() ? 0 : row_ptr.back(); };
+
+    /**
+     * @brief Get bytes of a CSR matrix with the same shape and elements
+     */
+    std::size_t csr_bytes() const { return (nrow+1)*sizeof(std::size_t) + nnz()*(sizeof(std::size_t) + sizeof(T)); };
+
+    /**
+     * @brief Get distinct values
+     */
+    std::vector<T> const & dictionary() const { return values; };
+
+    /**
+     * @brief Get bytes of the encoded vectors
+     */
+    std::size_t bytes() const
+    {
+        return values.size()*sizeof(T) + codes8.size() + codes16.size()*2
+             + row_ptr.size()*4 + first_col.size()*4 + width.size()
+             + delta_ptr.size()*4 + deltas8.size() + deltas16.size()*2 + deltas32.size()*4;
+    };
+
+private:
+    /// number of elements decoded at once
+    static constexpr std::size_t chunk = 64;
+
+    template<typename C>
+    T row_product(std::size_t const &i, C const *codes, T const *x) const;
+
+    template<typename D, typename C>
+    T row_product(std::size_t const &i, D const *deltas, C const *codes, T const *x) const;
+
+    std::size_t nrow = 0;
+    std::size_t ncol = 0;
+
+    /// distinct values, and indices of the values of the elements (8 or 16 bits)
+    std::vector<T> values;
+    std::vector<std::uint8_t> codes8;
+    std::vector<std::uint16_t> codes16;
+
+    /// first element of each row
+    std::vector<std::uint32_t> row_ptr;
+    /// first column of each row
+    std::vector<std::uint32_t> first_col;
+    /// bytes of the column differences of each row
+    std::vector<std::uint8_t> width;
+    /// first difference of each row, in the vector of its width
+    std::vector<std::uint32_t> delta_ptr;
+    std::vector<std::uint8_t> deltas8;
+    std::vector<std::uint16_t> deltas16;
+    std::vector<std::uint32_t> deltas32;
+};
+
+/**
+ * @brief Order of the values in the dictionary, real and imaginary parts
+ * compared lexicographically for complex values.
+ */
+template<typename T>
+bool dictionary_less(T const &a, T const &b)
+{
+    if constexpr (is_complex<T>::value)
+        return a.real() < b.real() or (a.real() == b.real() and a.imag() < b.imag());
+    else
+        return a < b;
+}
+
+/**
+ * @brief Encode a compressed CSR matrix. Fails, leaving the matrix empty, if
+ * it has more than 65536 distinct values, more than 2^32 columns or elements,
+ * or if the encoding is not smaller than the CSR storage (e.g. for very short
+ * rows, dominated by the 13 bytes of data of each row).
+ *
+ * @param A             Matrix object, compressed CSR
+ * @return true if the matrix has been encoded
+ */
+template<typename T>
+template<typename StorageOrder, typename Alloc>
+bool EncodedMatrix<T>::encode(Matrix<T,StorageOrder,Alloc> const &A)
+{
+    *this = EncodedMatrix();
+
+    if (!A.is_compressed() or A.compression_type() != CSR)
+    {
+        std::cerr << "encoding requires a CSR compressed matrix" << std::endl;
+        return false;
+    }
+    if (A.ncols() > std::numeric_limits<std::uint32_t>::max() or
+        A.aa().size() > std::numeric_limits<std::uint32_t>::max())
+    {
+        std::cerr << "too many columns or elements for the encoding" << std::endl;
+        return false;
+    }
+
+    auto const &IA = A.ia();
+    auto const &JA = A.ja();
+    auto const &AA = A.aa();
+    std::size_t n = AA.size();
+
+    // dictionary of the distinct values
+    std::vector<T> dict(AA.cbegin(), AA.cend());
+    std::sort(dict.begin(), dict.end(), dictionary_less<T>);
+    dict.erase(std::unique(dict.begin(), dict.end()), dict.end());
+    if (dict.size() > (1u << 16))
+    {
+        std::cerr << "too many distinct values for the dictionary: " << dict.size() << std::endl;
+        return false;
+    }
+
+    nrow = A.nrows();
+    ncol = A.ncols();
+    values = std::move(dict);
+    bool small = (values.size() <= (1u << 8));
+    if (small)
+        codes8.resize(n);
+    else
+        codes16.resize(n);
+
+    #pragma omp parallel for
+    for (std::size_t k=0; k<n; ++k)
+    {
+        std::size_t c = std::lower_bound(values.cbegin(), values.cend(), AA[k], dictionary_less<T>) - values.cbegin();
+        if (small)
+            codes8[k] = static_cast<std::uint8_t>(c);
+        else
+            codes16[k] = static_cast<std::uint16_t>(c);
+    }
+
+    // width of the column differences of each row
+    row_ptr.assign(IA.cbegin(), IA.cend());
+    first_col.resize(nrow, 0);
+    width.resize(nrow, 1);
+    delta_ptr.resize(nrow, 0);
+    for (std::size_t i=0; i<nrow; ++i)
+    {
+        std::size_t max_delta = 0;
+        for (std::size_t k=IA[i]+1; k<IA[i+1]; ++k)
+            max_delta = std::max(max_delta, JA[k] - JA[k-1]);
+        if (IA[i] < IA[i+1])
+            first_col[i] = static_cast<std::uint32_t>(JA[IA[i]]);
+
+        std::size_t count = (IA[i] < IA[i+1]) ? IA[i+1] - IA[i] - 1 : 0;
+        if (max_delta <= std::numeric_limits<std::uint8_t>::max())
+        {
+            delta_ptr[i] = static_cast<std::uint32_t>(deltas8.size());
+            deltas8.resize(deltas8.size() + count);
+        }
+        else if (max_delta <= std::numeric_limits<std::uint16_t>::max())
+        {
+            width[i] = 2;
+            delta_ptr[i] = static_cast<std::uint32_t>(deltas16.size());
+            deltas16.resize(deltas16.size() + count);
+        }
+        else
+        {
+            width[i] = 4;
+            delta_ptr[i] = static_cast<std::uint32_t>(deltas32.size());
+            deltas32.resize(deltas32.size() + count);
+        }
+    }
+
+    #pragma omp parallel for schedule(dynamic, 256)
+    for (std::size_t i=0; i<nrow; ++i)
+    {
+        for (std::size_t k=IA[i]+1; k<IA[i+1]; ++k)
+        {
+            std::size_t d = JA[k] - JA[k-1];
+            std::size_t p = delta_ptr[i] + k - IA[i] - 1;
+            switch (width[i])
+            {
+            case 1:
+                deltas8[p] = static_cast<std::uint8_t>(d);
+                break;
+            case 2:
+                deltas16[p] = static_cast<std::uint16_t>(d);
+                break;
+            default:
+                deltas32[p] = static_cast<std::uint32_t>(d);
+                break;
+            } // switch(width[i])
+        }
+    }
+
+    if (bytes() >= csr_bytes())
+    {
+        std::cerr << "encoding not smaller than CSR (" << bytes() << " bytes instead of "
+                  << csr_bytes() << "), matrix not encoded" << std::endl;
+        *this = EncodedMatrix();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Product of row i with x, dispatching on the width of its differences.
+ */
+template<typename T>
+template<typename C>
+T EncodedMatrix<T>::row_product(std::size_t const &i, C const *codes, T const *x) const
+{
+    switch (width[i])
+    {
+    case 1:
+        return row_product(i, deltas8.data(), codes, x);
+    case 2:
+        return row_product(i, deltas16.data(), codes, x);
+    default:
+        return row_product(i, deltas32.data(), codes, x);
+    } // switch(width[i])
+}
+
+/**
+ * @brief Product of row i with x. Chunks of columns are rebuilt with a SIMD
+ * prefix sum of the differences, then multiplied with the decoded values.
+ */
+template<typename T>
+template<typename D, typename C>
+T EncodedMatrix<T>::row_product(std::size_t const &i, D const *deltas, C const *codes, T const *x) const
+{
+    std::size_t first = row_ptr[i];
+    std::size_t n = row_ptr[i+1] - first;
+    if (n == 0)
+        return T(0);
+
+    T const *dict = values.data();
+    D const *d = deltas + delta_ptr[i];
+    C const *c = codes + first + 1;
+
+    std::size_t col = first_col[i];
+    T sum = dict[ codes[first] ] * x[col];
+
+    std::size_t cols[chunk];
+    for (std::size_t s=0; s<n-1; s+=chunk)
+    {
+        std::size_t m = std::min(chunk, n-1-s);
+
+        #pragma omp simd reduction(inscan, +:col)
+        for (std::size_t t=0; t<m; ++t)
+        {
+            col += d[s+t];
+            #pragma omp scan inclusive(col)
+            cols[t] = col;
+        }
+
+        if constexpr (is_complex<T>::value)
+        {
+            for (std::size_t t=0; t<m; ++t)
+                sum += dict[ c[s+t] ] * x[ cols[t] ];
+        }
+        else
+        {
+            #pragma omp simd reduction(+:sum)
+            for (std::size_t t=0; t<m; ++t)
+                sum += dict[ c[s+t] ] * x[ cols[t] ];
+        }
+    }
+    return sum;
+}
+
+/**
+ * @brief Matrix-vector product, decoding values and columns on the fly.
+ *
+ * @param v             Standard vector, size ncols()
+ * @param res           Output vector, size nrows()
+ */
+template<typename T>
+void EncodedMatrix<T>::multiply(std::vector<T> const &v, std::vector<T> &res) const
+{
+    ALGEBRA_PERF_SCOPE("EncodedMatrix::multiply");
+    if (res.size() != nrow)
+        res.resize(nrow);
+
+    T const *x = v.data();
+    bool small = codes16.empty();
+
+    #pragma omp parallel for schedule(dynamic, 256)
+    for (std::size_t i=0; i<nrow; ++i)
+        res[i] = small ? row_product(i, codes8.data(), x) : row_product(i, codes16.data(), x);
+}
+
+/**
+ * @brief Matrix-vector product.
+ *
+ * @param m             EncodedMatrix object
+ * @param v             Standard vector
+ * @return std::vector<T>
+ */
+template<typename T>
+std::vector<T> operator*(EncodedMatrix<T> const &m, std::vector<T> const &v)
+{
+    if (m.ncols() != v.size())
+    {
+        std::cerr << "sizes are not compatible for multiplication: ("
+            << m.nrows() << ", " << m.ncols() << ") * (" << v.size() << ", 1)"
+            << std::endl;
+        return std::vector<T>();
+    }
+
+    std::vector<T> res(m.nrows());
+    m.multiply(v, res);
+    return res;
+}
+
+} // namespace algebra
+
+#endif
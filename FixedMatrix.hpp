@@ -0,0 +1,354 @@
+/**
+ * @file
+ *
+ * @brief Small sparse matrices whose shape and pattern are known at compile
+ * time, e.g. stencils and element matrices applied many times.
+ *
+ * The pattern is a template parameter: the product unrolls into straight-line
+ * code with the column indices as constants, so only the values (stored in a
+ * std::array) and the vector are loaded.
+ *
+ * @author Luca Brambilla <luca13.brambilla@mail.polimi.it>
+ */
+
+#include <cstddef>
+#include <array>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <utility>
+#include <cmath>
+#include <stdexcept>
+
+#include "Matrix.hpp"
+
+#ifndef FIXED_MATRIX_HPP
+#define FIXED_MATRIX_HPP
+
+namespace algebra{
+
+/**
+ * @brief CSR pattern of an R x C matrix with N elements, usable as template
+ * argument: ia holds the R+1 row pointers, ja the sorted columns of each row.
+ */
+template<std::size_t R, std::size_t C, std::size_t N>
+struct Pattern
+{
+    static constexpr std::size_t rows = R;
+    static constexpr std::size_t cols = C;
+    static constexpr std::size_t nnz = N;
+
+    std::array<std::size_t, R+1> ia;
+    std::array<std::size_t, N> ja;
+
+    /**
+     * @brief Check pointers and columns: increasing, in bounds, consistent with N.
+     */
+    constexpr bool valid() const
+    {
+        if (ia[0] != 0 or ia[R] != N)
+            return false;
+        for (std::size_t i=0; i<R; ++i)
+        {
+            if (ia[i] > ia[i+1])
+                return false;
+            for (std::size_t k=ia[i]; k<ia[i+1]; ++k)
+            {
+                if (ja[k] >= C or (k > ia[i] and ja[k] <= ja[k-1]))
+                    return false;
+            }
+        }
+        return true;
+    };
+
+    /**
+     * @brief Position of element (i, j) in the values, N if not in the pattern.
+     */
+    constexpr std::size_t find(std::size_t const &i, std::size_t const &j) const
+    {
+        for (std::size_t k=ia[i]; k<ia[i+1]; ++k)
+        {
+            if (ja[k] == j)
+                return k;
+        }
+        return N;
+    };
+};
+
+/**
+ * @brief Number of true entries of a mask, to size make_pattern().
+ */
+template<std::size_t R, std::size_t C>
+constexpr std::size_t nonzeros(std::array<std::array<bool, C>, R> const &mask)
+{
+    std::size_t n = 0;
+    for (auto const &row : mask)
+        for (bool b : row)
+            n += b;
+    return n;
+}
+
+/**
+ * @brief Pattern of the true entries of a mask. N must be the number of true
+ * entries: otherwise the function throws, which fails constant evaluation.
+ *
+ * Usage: constexpr auto P = make_pattern<nonzeros(mask)>(mask);
+ */
+template<std::size_t N, std::size_t R, std::size_t C>
+constexpr Pattern<R, C, N> make_pattern(std::array<std::array<bool, C>, R> const &mask)
+{
+    if (nonzeros(mask) != N)
+        throw std::invalid_argument("make_pattern: N differs from the number of true entries of the mask");
+
+    Pattern<R, C, N> p{};
+    std::size_t k = 0;
+    for (std::size_t i=0; i<R; ++i)
+    {
+        p.ia[i] = k;
+        for (std::size_t j=0; j<C; ++j)
+        {
+            if (mask[i][j])
+                p.ja[k++] = j;
+        }
+    }
+    p.ia[R] = k;
+    return p;
+}
+
+/**
+ * @brief Sparse matrix with a pattern fixed at compile time, with the
+ * interface of algebra::Matrix for products, access and norms.
+ *
+ * @tparam T        Data type
+ * @tparam P        Pattern, an algebra::Pattern constant
+ */
+template<typename T, auto P>
+class FixedMatrix
+{
+public:
+    static_assert(P.valid(), "invalid pattern: pointers or columns not increasing or out of bounds");
+
+    static constexpr std::size_t R = decltype(P)::rows;
+    static constexpr std::size_t C = decltype(P)::cols;
+    static constexpr std::size_t N = decltype(P)::nnz;
+
+    typedef std::array<std::size_t,2> indexes;
+
+    constexpr FixedMatrix() : values{} {};
+
+    /**
+     * @brief Construct from the values in the order of the pattern.
+     */
+    constexpr explicit FixedMatrix(std::array<T, N> const &v) : values(v) {};
+
+    template<typename StorageOrder, typename Alloc>
+    explicit FixedMatrix(Matrix<T,StorageOrder,Alloc> const &A);
+
+    /**
+     * @brief Get number of rows
+     */
+    static constexpr std::size_t nrows() { return R; };
+
+    /**
+     * @brief Get number of columns
+     */
+    static constexpr std::size_t ncols() { return C; };
+
+    /**
+     * @brief Get number of elements in the pattern
+     */
+    static constexpr std::size_t nnz() { return N; };
+
+    /**
+     * @brief Get values in the order of the pattern
+     */
+    constexpr std::array<T, N> & aa() { return values; };
+    constexpr std::array<T, N> const & aa() const { return values; };
+
+    /**
+     * @brief Element (I, J), checked at compile time to be in the pattern.
+     */
+    template<std::size_t I, std::size_t J>
+    constexpr T & value()
+    {
+        static_assert(I < R and J < C and P.find(I, J) != N, "element not in the pattern");
+        return values[P.find(I, J)];
+    };
+
+    constexpr T operator[](indexes const &ind) const;
+
+    /**
+     * @brief Product with fixed size arrays, unrolled over rows and elements.
+     *
+     * @param x         input, size ncols()
+     * @param y         output, size nrows()
+     */
+    constexpr void multiply(std::array<T, C> const &x, std::array<T, R> &y) const
+    {
+        apply(x.data(), y.data());
+    };
+
+    /**
+     * @brief Product with a vector, unrolled over rows and elements.
+     *
+     * @param v         Standard vector, size ncols()
+     * @param res       Output vector, size nrows()
+     */
+    void multiply(std::vector<T> const &v, std::vector<T> &res) const
+    {
+        if (v.size() != C)
+        {
+            std::cerr << "sizes are not compatible for multiplication: ("
+                << R << ", " << C << ") * (" << v.size() << ", 1)" << std::endl;
+            return;
+        }
+        if (res.size() != R)
+            res.resize(R);
+        apply(v.data(), res.data());
+    };
+
+    double norm_one() const;
+    double norm_infty() const;
+    double norm_frob() const;
+    double norm(Norm const &n) const;
+
+private:
+    /**
+     * @brief Product of row I: sum of the elements of the row as a fold
+     * expression, with constant positions and columns.
+     */
+    template<std::size_t I>
+    constexpr T row(T const *x) const
+    {
+        constexpr std::size_t first = P.ia[I];
+        return [&]<std::size_t... K>(std::index_sequence<K...>)
+        {
+            return (T(0) + ... + (values[first+K] * x[ P.ja[first+K] ]));
+        }(std::make_index_sequence<P.ia[I+1] - first>{});
+    };
+
+    constexpr void apply(T const *x, T *y) const
+    {
+        [&]<std::size_t... I>(std::index_sequence<I...>)
+        {
+            ((y[I] = row<I>(x)), ...);
+        }(std::make_index_sequence<R>{});
+    };
+
+    std::array<T, N> values;
+};
+
+/**
+ * @brief Construct from a matrix of the same shape, taking its elements at the
+ * positions of the pattern. Elements outside the pattern are ignored.
+ *
+ * @param A             Matrix object
+ */
+template<typename T, auto P>
+template<typename StorageOrder, typename Alloc>
+FixedMatrix<T,P>::FixedMatrix(Matrix<T,StorageOrder,Alloc> const &A) : values{}
+{
+    if (A.nrows() != R or A.ncols() != C)
+    {
+        std::cerr << "matrix of size (" << A.nrows() << ", " << A.ncols()
+                  << ") does not match the pattern (" << R << ", " << C << ")" << std::endl;
+        return;
+    }
+    bool row_major = (A.order() == Row_major);
+    for (std::size_t i=0; i<R; ++i)
+        for (std::size_t k=P.ia[i]; k<P.ia[i+1]; ++k)
+            values[k] = row_major ? A[{i, P.ja[k]}] : A[{P.ja[k], i}];
+}
+
+/**
+ * @brief Element (i, j), 0 if not in the pattern.
+ *
+ * @param ind           {row, column}
+ * @return T
+ */
+template<typename T, auto P>
+constexpr T FixedMatrix<T,P>::operator[](indexes const &ind) const
+{
+    if (ind[0] >= R or ind[1] >= C)
+        return T(0);
+    std::size_t k = P.find(ind[0], ind[1]);
+    return (k == N) ? T(0) : values[k];
+}
+
+/**
+ * @brief Compute the 1-norm of the matrix.
+ */
+template<typename T, auto P>
+double FixedMatrix<T,P>::norm_one() const
+{
+    std::array<double, C> sums{};
+    for (std::size_t k=0; k<N; ++k)
+        sums[ P.ja[k] ] += std::abs(values[k]);
+    return C ? *std::max_element(sums.cbegin(), sums.cend()) : 0.;
+}
+
+/**
+ * @brief Compute the infinity norm of the matrix.
+ */
+template<typename T, auto P>
+double FixedMatrix<T,P>::norm_infty() const
+{
+    double res = 0.;
+    for (std::size_t i=0; i<R; ++i)
+    {
+        double sum = 0.;
+        for (std::size_t k=P.ia[i]; k<P.ia[i+1]; ++k)
+            sum += std::abs(values[k]);
+        res = std::max(res, sum);
+    }
+    return res;
+}
+
+/**
+ * @brief Compute the Frobenius norm of the matrix.
+ */
+template<typename T, auto P>
+double FixedMatrix<T,P>::norm_frob() const
+{
+    double res = 0.;
+    for (auto const &v : values)
+        res += std::abs(v) * std::abs(v);
+    return std::sqrt(res);
+}
+
+/**
+ * @brief Given an enumerator, return the desired norm.
+ */
+template<typename T, auto P>
+double FixedMatrix<T,P>::norm(Norm const &n) const
+{
+    switch (n)
+    {
+    case Norm::One:
+        return norm_one();
+    case Norm::Infinity:
+        return norm_infty();
+    case Norm::Frobenius:
+        return norm_frob();
+    } // switch(n)
+    return 0.;
+}
+
+/**
+ * @brief Matrix-vector product.
+ *
+ * @param m             FixedMatrix object
+ * @param v             Standard vector
+ * @return std::vector<T>
+ */
+template<typename T, auto P>
+std::vector<T> operator*(FixedMatrix<T,P> const &m, std::vector<T> const &v)
+{
+    std::vector<T> res(m.nrows());
+    m.multiply(v, res);
+    return res;
+}
+
+} // namespace algebra
+
+#endif
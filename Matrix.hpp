@@ -12,11 +12,19 @@
 #include <iostream>
 #include <cmath>
 #include <complex>
+#include <algorithm>
+#include <type_traits>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <charconv>
 
 #include <string>
 #include <fstream>
 #include <sstream>
 
+#include "PerfCounters.hpp"
+
 #ifndef MATRIX_HPP
 #define MATRIX_HPP
 
@@ -31,19 +39,130 @@ constexpr double ZERO_TOL = 1e-8;
 enum Order {Column_major, Row_major};
 /// Enumerator for the norm computation
 enum Norm {One, Infinity, Frobenius};
-/// Enumerator for compression (Compressed Sparse Row, Compressed Sparse Column)
-enum Compression {CSR, CSC};
+/**
+ * @brief Enumerator for compression: Compressed Sparse Row, Compressed Sparse
+ * Column, ELLPACK, Block Sparse Row, Diagonal
+ */
+enum Compression {CSR, CSC, ELL, BSR, DIA};
+
+/// Type trait to detect complex data types
+template<typename T>
+struct is_complex : std::false_type {};
+
+template<typename T>
+struct is_complex<std::complex<T>> : std::true_type {};
+
+/**
+ * @brief Complex conjugate of a value, returning the same data type also for
+ * real numbers (std::conj always returns a std::complex).
+ *
+ * @param v         input value
+ * @return T
+ */
+template<typename T>
+T conjugate(T const &v)
+{
+    if constexpr (is_complex<T>::value)
+        return std::conj(v);
+    else
+        return v;
+}
+
+/**
+ * @brief Product of two values. Complex values are multiplied with the
+ * textbook formula, skipping the NaN and infinity recovery of operator*
+ * (a call to __muldc3 on the slow path) that prevents vectorization.
+ *
+ * @param a         first factor
+ * @param b         second factor
+ * @return T
+ */
+template<typename T>
+T fast_multiply(T const &a, T const &b)
+{
+    if constexpr (is_complex<T>::value)
+        return T(a.real()*b.real() - a.imag()*b.imag(), a.real()*b.imag() + a.imag()*b.real());
+    else
+        return a * b;
+}
+
+/**
+ * @brief Squared magnitude of a value, re^2 + im^2 for complex numbers.
+ *
+ * @param v         input value
+ * @return double
+ */
+template<typename T>
+double magnitude2(T const &v)
+{
+    if constexpr (is_complex<T>::value)
+        return static_cast<double>(v.real())*v.real() + static_cast<double>(v.imag())*v.imag();
+    else
+        return static_cast<double>(v)*v;
+}
+
+/**
+ * @brief Magnitude of a value: for complex numbers the square root of
+ * magnitude2(), without the overflow and underflow guards of std::abs (hypot),
+ * exact unless the parts exceed about 1e154 or are below 1e-154.
+ *
+ * @param v         input value
+ * @return double
+ */
+template<typename T>
+double magnitude(T const &v)
+{
+    if constexpr (is_complex<T>::value)
+        return std::sqrt(magnitude2(v));
+    else
+        return std::abs(static_cast<double>(v));
+}
+
+/**
+ * @brief Memory used by a Matrix, in bytes, broken down by component.
+ */
+struct MemoryUsage
+{
+    /// number of nodes of the coordinate map, and estimate of their size
+    std::size_t coo_nodes = 0;
+    std::size_t coo_bytes = 0;
+    /// capacity of the compressed vectors
+    std::size_t ia_bytes = 0;
+    std::size_t ja_bytes = 0;
+    std::size_t aa_bytes = 0;
+    /// the Matrix object itself
+    std::size_t object_bytes = 0;
+
+    /**
+     * @brief Total bytes
+     */
+    std::size_t total() const { return coo_bytes + ia_bytes + ja_bytes + aa_bytes + object_bytes; };
+};
+
+/**
+ * @brief Print the memory usage, one component per line.
+ */
+inline std::ostream & operator<<(std::ostream &os, MemoryUsage const &m)
+{
+    os << "COO map:  " << m.coo_bytes << " bytes (" << m.coo_nodes << " nodes)\n"
+       << "IA:       " << m.ia_bytes << " bytes\n"
+       << "JA:       " << m.ja_bytes << " bytes\n"
+       << "AA:       " << m.aa_bytes << " bytes\n"
+       << "object:   " << m.object_bytes << " bytes\n"
+       << "total:    " << m.total() << " bytes";
+    return os;
+}
 
 // forward declaration matrix class
-template <typename T, typename StorageOrder>
+template <typename T, typename StorageOrder, typename Alloc = std::allocator<T>>
 class Matrix;
 
 // forward declaration of friend function inside class template
-template<typename T, typename StorageOrder>
-std::vector<T> operator*( Matrix<T, StorageOrder> const &m, std::vector<T> const &v );
+template<typename T, typename StorageOrder, typename Alloc>
+std::vector<T> operator*( Matrix<T, StorageOrder, Alloc> const &m, std::vector<T> const &v );
 
-template<typename T, typename StorageOrder>
-Matrix<T,StorageOrder> operator*( Matrix<T,StorageOrder> const &m1, Matrix<T,StorageOrder> const &m2);
+template<typename T, typename StorageOrder, typename Alloc>
+Matrix<T,StorageOrder,Alloc> operator*( Matrix<T,StorageOrder,Alloc> const &m1, Matrix<T,StorageOrder,Alloc> const &m2);
 
 /**
  * @brief Template class for sparse matrices. Template parameters are the data type 
@@ -56,8 +175,9 @@ Matrix<T,StorageOrder> operator*( Matrix<T,StorageOrder> const &m1, Matrix<T,Sto
  * 
  * @tparam T                Data type
  * @tparam StorageOrder     Enumerator for storage ordering: column major or row major
+ * @tparam Alloc            Allocator of the values, rebound for indices and map nodes
  */
-template <typename T, typename StorageOrder>
+template <typename T, typename StorageOrder, typename Alloc>
 class Matrix
 {
 public:
@@ -66,41 +186,118 @@ public:
     /// type used for reading from a full matrix
     typedef std::vector<std::vector<T>> fullmatrix;
     // type uncompressed data in coordinate representation
-    typedef std::map<indexes,T> coo_matrix;
+    typedef std::map<indexes, T, std::less<indexes>,
+        typename std::allocator_traits<Alloc>::template rebind_alloc<std::pair<const indexes,T>>> coo_matrix;
+    /// type of the compressed index vectors
+    typedef std::vector<std::size_t,
+        typename std::allocator_traits<Alloc>::template rebind_alloc<std::size_t>> index_vector;
+    /// type of the compressed values vector
+    typedef std::vector<T, Alloc> value_vector;
+    /// move assignment steals the storage, without allocating
+    static constexpr bool nothrow_move_assignment =
+        std::allocator_traits<Alloc>::propagate_on_container_move_assignment::value or
+        std::allocator_traits<Alloc>::is_always_equal::value;
 
 public:
     // constructors
     Matrix();
 
-    Matrix(std::size_t const& r, size_t const& c);
+    explicit Matrix(Alloc const &a);
+
+    Matrix(std::size_t const& r, size_t const& c, Alloc const &a=Alloc());
 
     Matrix(fullmatrix const &m, Order const &o=Row_major);
+
+    Matrix(std::size_t const& r, size_t const& c, T const *data,
+           Order const &layout=Row_major, Compression const &comp=CSR);
     
     Matrix(Matrix const &m);
+
+    Matrix(Matrix &&m) noexcept;
+
+    Matrix & operator=(Matrix const &m);
+
+    /**
+     * @brief Move assignment, noexcept only if the allocators are moved with
+     * the data or always equal: otherwise (e.g. std::pmr allocators with
+     * different resources) elements are copied and may throw.
+     */
+    Matrix & operator=(Matrix &&m) noexcept(nothrow_move_assignment);
     
-    Matrix(std::string const &name, Order const &o=Row_major);
+    Matrix(std::string const &name, Order const &o=Row_major,
+           std::size_t const &first=0, std::size_t const &last=std::numeric_limits<std::size_t>::max(),
+           Alloc const &a=Alloc());
+
+    Matrix(std::istream &in, Order const &o=Row_major,
+           std::size_t const &first=0, std::size_t const &last=std::numeric_limits<std::size_t>::max(),
+           Alloc const &a=Alloc());
+
+    Matrix(std::size_t const& r, size_t const& c, index_vector ia,
+           index_vector ja, value_vector aa, Compression const &comp=CSR);
 
     // getters
     
     /**
      * @brief Get number of columns
      */
-    std::size_t ncols() { return ncol; };
+    std::size_t ncols() const { return ncol; };
 
     /**
      * @brief Get number of rows
      */
-    std::size_t nrows() { return nrow; };
+    std::size_t nrows() const { return nrow; };
+
+    /**
+     * @brief Get the storage ordering
+     */
+    Order order() const { return ordering; };
+
+    /**
+     * @brief Get the compression format (meaningful only if compressed)
+     */
+    Compression compression_type() const { return compression; };
+
+    /**
+     * @brief Get the block size of the BSR format
+     */
+    std::size_t block_size() const { return block; };
+
+    /**
+     * @brief Get the compressed index vector IA: row pointers for CSR,
+     * row indices for CSC, row lengths for ELL, block row pointers for BSR,
+     * shifted diagonal offsets for DIA.
+     */
+    index_vector const & ia() const { return IA; };
+
+    /**
+     * @brief Get the compressed index vector JA: column indices for CSR and
+     * ELL, column pointers for CSC, block columns for BSR, empty for DIA.
+     */
+    index_vector const & ja() const { return JA; };
+
+    /**
+     * @brief Get the compressed values vector AA.
+     */
+    value_vector const & aa() const { return AA; };
+
+    /**
+     * @brief Get the allocator of the values, to build matrices sharing it
+     */
+    Alloc get_allocator() const { return AA.get_allocator(); };
 
     // utilities
     void resize(std::size_t const& r, size_t const& c);
     void print() const;
+    void save_mtx(std::string const &name) const;
 
     // compression utilities
-    void compress(Compression const &c);
+    void compress(Compression const &c, std::size_t const &b=4);
     void uncompress();
     bool is_compressed() const;
 
+    // memory
+    MemoryUsage memory_usage() const;
+
     // norms
     double norm_one() const;
     double norm_infty() const;
@@ -108,8 +305,11 @@ public:
     double norm(Norm const &n) const;
 
     // operations
-    friend std::vector<T> operator*<T,StorageOrder>(Matrix<T,StorageOrder> const &m, std::vector<T> const &v );
-    friend Matrix<T,StorageOrder> operator*<T,StorageOrder>( Matrix<T,StorageOrder> const &m1, Matrix const &m2);
+    Matrix & operator*=(T const &alpha);
+    Matrix & axpy(T const &alpha, Matrix const &B);
+    void multiply(std::vector<T> const &v, std::vector<T> &res) const;
+    friend std::vector<T> operator*<T,StorageOrder,Alloc>(Matrix<T,StorageOrder,Alloc> const &m, std::vector<T> const &v );
+    friend Matrix<T,StorageOrder,Alloc> operator*<T,StorageOrder,Alloc>( Matrix<T,StorageOrder,Alloc> const &m1, Matrix const &m2);
 
     // access operator
     T operator[] (indexes const &i) const;
@@ -117,6 +317,15 @@ public:
 
     
 private:
+    template<typename F>
+    void for_each_stored(F f, std::size_t const &first=0,
+                         std::size_t const &last=std::numeric_limits<std::size_t>::max()) const;
+    void read_mtx(std::istream &in, std::size_t const &first, std::size_t const &last);
+    void write_entries(std::ostream &os, bool const &mtx) const;
+    static void append_value(std::string &buf, T const &v, bool const &mtx);
+    std::size_t stored_position(indexes const &ind) const;
+    static void shrink_consumed(index_vector &ind, value_vector &val, std::size_t const &size);
+
     /// Storage ordering
     Order ordering = Order::Row_major;
     /// Compression format
@@ -129,11 +338,16 @@ private:
     coo_matrix dynamic_data;
 
     /// Vector containing row indices for compressed representation
-    std::vector<size_t> IA;
+    index_vector IA;
     /// Vector containing column indices for compressed representation
-    std::vector<size_t> JA;
+    index_vector JA;
     /// Vector containing values for compressed representation
-    std::vector<T> AA;
+    value_vector AA;
+
+    /// number of slots per row of the ELL format
+    std::size_t width = 0;
+    /// size of the square blocks of the BSR format
+    std::size_t block = 1;
 
     /// number of matrix columns
     std::size_t ncol = 0;
@@ -146,10 +360,92 @@ private:
  * 
  * @param r         number of rows
  * @param c         number of columns
+ * @param a         allocator
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+Matrix<T, StorageOrder, Alloc>::Matrix(std::size_t const& r, size_t const& c, Alloc const &a) :
+    dynamic_data(a), IA(a), JA(a), AA(a), ncol(c), nrow(r) {}
+
+/**
+ * @brief Construct a new empty Matrix object with no rows and columns
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+Matrix<T, StorageOrder, Alloc>::Matrix() {}
+
+/**
+ * @brief Construct a new empty Matrix object whose map nodes and vectors are
+ * allocated by a given allocator, e.g. a std::pmr::polymorphic_allocator on
+ * a monotonic buffer.
+ *
+ * @param a         allocator
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+Matrix<T, StorageOrder, Alloc>::Matrix(Alloc const &a) :
+    dynamic_data(a), IA(a), JA(a), AA(a) {}
+
+
+/**
+ * @brief Construct a new compressed Matrix directly from its compressed vectors.
+ *
+ * For CSR, ia holds r+1 row pointers and ja the column indices (sorted in
+ * each row); for CSC, ja holds c+1 column pointers and ia the row indices
+ * (sorted in each column). The ordering is row-major for CSR and column-major
+ * for CSC. If the vectors are not consistent with the shape (sizes, pointers,
+ * indices out of bounds) or comp is not CSR or CSC, the error is reported and
+ * the matrix is left empty and uncompressed.
+ * 
+ * @param r         number of rows
+ * @param c         number of columns
+ * @param ia        vector IA
+ * @param ja        vector JA
+ * @param aa        vector of values AA
+ * @param comp      compression format
  */
-template<typename T, typename StorageOrder>
-Matrix<T, StorageOrder>::Matrix(std::size_t const& r, size_t const& c) :
-    nrow(r), ncol(c) {}
+template<typename T, typename StorageOrder, typename Alloc>
+Matrix<T, StorageOrder, Alloc>::Matrix(std::size_t const& r, size_t const& c, index_vector ia,
+                                index_vector ja, value_vector aa, Compression const &comp) :
+    ordering(comp == CSR ? Row_major : Column_major), compression(comp), compressed(true),
+    IA(std::move(ia)), JA(std::move(ja)), AA(std::move(aa)), ncol(c), nrow(r)
+{
+    // on failure the matrix is left empty and uncompressed
+    auto fail = [&](char const *msg)
+    {
+        std::cerr << msg << std::endl;
+        IA.clear();
+        JA.clear();
+        AA.clear();
+        compressed = false;
+        nrow = ncol = 0;
+    };
+
+    if (comp != CSR and comp != CSC)
+    {
+        fail("only CSR and CSC can be built from compressed vectors");
+        return;
+    }
+    index_vector const &ptr = (comp == CSR) ? IA : JA;
+    index_vector const &ind = (comp == CSR) ? JA : IA;
+    std::size_t major = (comp == CSR) ? nrow : ncol;
+    std::size_t minor = (comp == CSR) ? ncol : nrow;
+    if (ptr.size() != major+1 or ind.size() != AA.size() or ptr[0] != 0 or ptr[major] != AA.size())
+    {
+        fail("compressed vectors are not consistent with the shape");
+        return;
+    }
+    for (std::size_t m=0; m<major; ++m)
+    {
+        if (ptr[m] > ptr[m+1])
+        {
+            fail("compressed pointers are not increasing");
+            return;
+        }
+    }
+    if (std::any_of(ind.cbegin(), ind.cend(), [&](std::size_t const &k){ return k >= minor; }))
+    {
+        fail("compressed indices out of bounds");
+        return;
+    }
+}
 
 
 
@@ -160,33 +456,35 @@ Matrix<T, StorageOrder>::Matrix(std::size_t const& r, size_t const& c) :
  * @param m         input matrix
  * @param o         ordering
  */
-template<typename T, typename StorageOrder>
-Matrix<T, StorageOrder>::Matrix(const fullmatrix &m,
+template<typename T, typename StorageOrder, typename Alloc>
+Matrix<T, StorageOrder, Alloc>::Matrix(const fullmatrix &m,
                                 Order const &o)
 {
-
-    ncol = m[0].size();
+    ordering = o;
     nrow = m.size();
+    ncol = nrow ? m[0].size() : 0;
+
+    for (std::size_t i=0; i<nrow; ++i)
+    {
+        // error in output
+        if (m[i].size() != ncol)
+        {
+            std::cerr << "number of elements in columns is not consistent" << std::endl;
+            return;
+        }
+    }
 
     switch (ordering){
     case Row_major:
     {
+        // rows first, columns second: keys are inserted in order
         for (std::size_t i=0; i<nrow; ++i)
         {
-            // error in output
-            if (m[i].size() != ncol)
-            {
-                std::cerr << "number of elements in columns is not consistent" << std::endl;
-                return;
-            }
-
-            // initialize - loop over all elements
             for (std::size_t j = 0; j<ncol; ++j)
             {
-                // rows first, columns second
                 if (std::abs(m[i][j]) > ZERO_TOL)
                 {
-                    dynamic_data.insert( { {i,j}, m[i][j]} );
+                    dynamic_data.emplace_hint(dynamic_data.end(), indexes{i,j}, m[i][j]);
                 }
             }
         }
@@ -195,22 +493,14 @@ Matrix<T, StorageOrder>::Matrix(const fullmatrix &m,
 
     case Column_major:
     {
-        for (std::size_t i=0; i<nrow; ++i)
+        // columns first, rows second: keys are inserted in order
+        for (std::size_t j=0; j<ncol; ++j)
         {
-            // error in output
-            if (m[i].size() != ncol)
-            {
-                std::cerr << "number of elements in columns is not consistent" << std::endl;
-                return;
-            }
-
-            // initialize - loop over all elements
-            for (std::size_t j = 0; j<ncol; ++j)
+            for (std::size_t i = 0; i<nrow; ++i)
             {
-                // columns first, rows second
-                if (std::abs(m[j][i]) > ZERO_TOL)
+                if (std::abs(m[i][j]) > ZERO_TOL)
                 {
-                    dynamic_data.insert( { {j,i}, m[j][i]} );
+                    dynamic_data.emplace_hint(dynamic_data.end(), indexes{j,i}, m[i][j]);
                 }
             }
         }
@@ -223,18 +513,116 @@ Matrix<T, StorageOrder>::Matrix(const fullmatrix &m,
 
 
 /**
- * @brief Construct a new Matrix object reading from a file in matrix market format.
+ * @brief Construct a new compressed Matrix from a contiguous dense buffer,
+ * keeping the values above ZERO_TOL.
+ *
+ * Rows (columns for CSC) are scanned in parallel twice: the first pass counts
+ * the values above the tolerance with vectorized compares, the second fills
+ * the compressed vectors at the offsets given by the counts. Scans are
+ * contiguous when the layout of the buffer matches the format (row-major for
+ * CSR, column-major for CSC), strided otherwise.
  *
- * Assume reading only real matrices (not complex).
+ * @param r         number of rows
+ * @param c         number of columns
+ * @param data      dense values, r*c
+ * @param layout    layout of the buffer: Row_major (a_ij at i*c+j) or Column_major (a_ij at j*r+i)
+ * @param comp      compression format, CSR or CSC
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+Matrix<T, StorageOrder, Alloc>::Matrix(std::size_t const& r, size_t const& c, T const *data,
+                                       Order const &layout, Compression const &comp) :
+    ordering(comp == CSR ? Row_major : Column_major), compression(comp), compressed(true), ncol(c), nrow(r)
+{
+    if (comp != CSR and comp != CSC)
+    {
+        std::cerr << "dense buffers can be compressed only to CSR or CSC" << std::endl;
+        compressed = false;
+        return;
+    }
+
+    // major index is the row for CSR, the column for CSC
+    std::size_t nmajor = (comp == CSR) ? nrow : ncol;
+    std::size_t nminor = (comp == CSR) ? ncol : nrow;
+    // distance between consecutive elements along the minor and major index
+    bool contiguous = (comp == CSR) == (layout == Row_major);
+    std::size_t minor_stride = contiguous ? 1 : nmajor;
+    std::size_t major_stride = contiguous ? nminor : 1;
+
+    // values above tolerance, compared on |v|^2 to avoid square roots
+    constexpr double tol2 = ZERO_TOL * ZERO_TOL;
+
+    // count values of each major index
+    index_vector &ptr = (comp == CSR) ? IA : JA;
+    index_vector &ind = (comp == CSR) ? JA : IA;
+    ptr.assign(nmajor+1, 0);
+    #pragma omp parallel for schedule(static)
+    for (std::size_t m=0; m<nmajor; ++m)
+    {
+        T const *line = data + m*major_stride;
+        std::size_t count = 0;
+        if (contiguous)
+        {
+            #pragma omp simd reduction(+:count)
+            for (std::size_t k=0; k<nminor; ++k)
+                count += (magnitude2(line[k]) > tol2);
+        }
+        else
+        {
+            for (std::size_t k=0; k<nminor; ++k)
+                count += (magnitude2(line[k*minor_stride]) > tol2);
+        }
+        ptr[m+1] = count;
+    }
+
+    for (std::size_t m=0; m<nmajor; ++m)
+        ptr[m+1] += ptr[m];
+
+    // fill indices and values at the offsets of each major index
+    ind.resize(ptr[nmajor]);
+    AA.resize(ptr[nmajor]);
+    #pragma omp parallel for schedule(static)
+    for (std::size_t m=0; m<nmajor; ++m)
+    {
+        T const *line = data + m*major_stride;
+        std::size_t p = ptr[m];
+        for (std::size_t k=0; k<nminor; ++k)
+        {
+            T v = line[k*minor_stride];
+            if (magnitude2(v) > tol2)
+            {
+                ind[p] = k;
+                AA[p] = v;
+                ++p;
+            }
+        }
+    }
+}
+
+
+/**
+ * @brief Construct a new Matrix object reading from a file in matrix market format.
  *
- * Assume reading in coordinate representation with row-major ordering.
+ * Real, integer and complex coordinate files are supported. For a complex
+ * file read into a real matrix only the real part is kept. Symmetric,
+ * skew-symmetric and hermitian files store only the lower triangle, which
+ * is mirrored while reading.
+ * 
+ * A range of rows [first, last) can be selected to load only a block of
+ * rows, as for a row-partitioned distributed matrix: rows are then numbered
+ * from first, and the number of rows is last-first.
  * 
  * @param name        String containing the path to the file to read.
  * @param o           Desired ordering in which to store the data. 
+ * @param first       First row to read
+ * @param last        Row after the last one to read
+ * @param a           Allocator of the map nodes and vectors
  */
-template<typename T, typename StorageOrder>
-Matrix<T, StorageOrder>::Matrix(std::string const &name, Order const &o)
+template<typename T, typename StorageOrder, typename Alloc>
+Matrix<T, StorageOrder, Alloc>::Matrix(std::string const &name, Order const &o,
+                                std::size_t const &first, std::size_t const &last, Alloc const &a) :
+    dynamic_data(a), IA(a), JA(a), AA(a)
 {
+    ALGEBRA_PERF_SCOPE("Matrix::load");
     ordering = o;
 
     // open the file
@@ -245,13 +633,58 @@ Matrix<T, StorageOrder>::Matrix(std::string const &name, Order const &o)
         std::cerr << "Error opening file!" << std::endl;
         return;
     }
-    
-    // read first commented lines
+
+    read_mtx(file, first, last);
+
+    // close the file
+    file.close();
+}
+
+/**
+ * @brief Construct a new Matrix object reading matrix market data from a
+ * stream, e.g. a file already read in memory. See the constructor from a file.
+ *
+ * @param in          Input stream in matrix market format
+ * @param o           Desired ordering in which to store the data.
+ * @param first       First row to read
+ * @param last        Row after the last one to read
+ * @param a           Allocator of the map nodes and vectors
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+Matrix<T, StorageOrder, Alloc>::Matrix(std::istream &in, Order const &o,
+                                std::size_t const &first, std::size_t const &last, Alloc const &a) :
+    dynamic_data(a), IA(a), JA(a), AA(a)
+{
+    ALGEBRA_PERF_SCOPE("Matrix::load");
+    ordering = o;
+    read_mtx(in, first, last);
+}
+
+/**
+ * @brief Read the header and the elements of a matrix market stream into the
+ * map, with the current ordering.
+ *
+ * @param in          Input stream in matrix market format
+ * @param first       First row to read
+ * @param last        Row after the last one to read
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+void Matrix<T, StorageOrder, Alloc>::read_mtx(std::istream &in, std::size_t const &first, std::size_t const &last)
+{
+    Order o = ordering;
+
+    // read header line with field and symmetry
     std::string line;
-    getline(file, line);
+    getline(in, line);
+    bool complex_field = (line.find("complex") != std::string::npos);
+    bool symmetric = (line.find("symmetric") != std::string::npos);
+    bool skew = (line.find("skew-symmetric") != std::string::npos);
+    bool hermitian = (line.find("hermitian") != std::string::npos);
+
+    // read first commented lines
     while(line[0] == '%' )
     {
-        getline(file, line);
+        getline(in, line);
     }
 
     // read number of rows and columns
@@ -260,60 +693,74 @@ Matrix<T, StorageOrder>::Matrix(std::string const &name, Order const &o)
     iss >> nrow >> ncol >> ndata;
     //std::cout << nrow << " " << ncol << " " << ndata << std::endl;
 
+    // selected block of rows
+    std::size_t row_last = std::min(last, nrow);
+    std::size_t row_first = std::min(first, row_last);
+    nrow = row_last - row_first;
+    auto selected = [&](std::size_t row) { return row >= row_first and row < row_last; };
+
     // hold data for each line
     std::size_t i;  // row index
     std::size_t j;  // column index
     T num;
 
-    switch (o) {
-    case Order::Row_major:
+    // read each line from the file
+    while (getline(in, line))
     {
-        // read each line from the file
-        while (getline(file, line))
+        // string stream from the line
+        std::istringstream iss(line);
+
+        // read data from the line
+        double re = 0.;
+        double im = 0.;
+        if ( !(iss >> i >> j >> re) or (complex_field and !(iss >> im)) )
         {
-            // string stream from the line
-            std::istringstream iss(line);
+            std::cerr << "Error reading line: " << line << std::endl;
+            continue;
+        }
 
-            // read data from the line
-            if (iss >> i >> j >> num) {
-                // store value if above tolerance
-                if (std::abs(num) > ZERO_TOL)
-                {
-                    // row-column index, indices start from 0
-                    dynamic_data.insert( { {i-1,j-1}, num} );
-                }
-            }
-            else {
-                std::cerr << "Error reading line: " << line << std::endl;
-            }
+        if constexpr (is_complex<T>::value)
+            num = T(re, im);
+        else
+            num = re;
+
+        // store value if above tolerance
+        if (std::abs(num) <= ZERO_TOL)
+            continue;
+
+        // mirrored value for symmetric storage
+        T mirror = num;
+        if (skew)
+            mirror = -num;
+        else if (hermitian)
+            mirror = conjugate(num);
+
+        // indices start from 0, rows numbered from the first selected one
+        bool mirrored = (symmetric or hermitian) and i != j;
+        bool keep = selected(i-1);
+        bool keep_mirror = mirrored and selected(j-1);
+
+        switch (o) {
+        case Order::Row_major:
+        {
+            // row-column index
+            if (keep)
+                dynamic_data.insert( { {i-1-row_first,j-1}, num} );
+            if (keep_mirror)
+                dynamic_data.insert( { {j-1-row_first,i-1}, mirror} );
+            break;
         }
-    }
-    case Order::Column_major:
-    {
-        // read each line from the file
-        while (getline(file, line))
+        case Order::Column_major:
         {
-            // string stream from the line
-            std::istringstream iss(line);
-
-            // read data from the line
-            if (iss >> i >> j >> num) {
-                // store value if above tolerance
-                if (std::abs(num) > ZERO_TOL)
-                {
-                    // column-row index, indices start from 0
-                    dynamic_data.insert( { {j-1,i-1}, num} );
-                }
-            }
-            else {
-                std::cerr << "Error reading line: " << line << std::endl;
-            }
+            // column-row index
+            if (keep)
+                dynamic_data.insert( { {j-1,i-1-row_first}, num} );
+            if (keep_mirror)
+                dynamic_data.insert( { {i-1,j-1-row_first}, mirror} );
+            break;
         }
+        } // switch(ordering)
     }
-    } // switch(ordering)
-
-    // close the file
-    file.close();
 }
 
 /**
@@ -321,22 +768,101 @@ Matrix<T, StorageOrder>::Matrix(std::string const &name, Order const &o)
  * 
  * @param m             Matrix object
  */
-template<typename T, typename StorageOrder>
-Matrix<T, StorageOrder>::Matrix(Matrix const &m) :
+template<typename T, typename StorageOrder, typename Alloc>
+Matrix<T, StorageOrder, Alloc>::Matrix(Matrix const &m) :
     ordering(m.ordering), compression(m.compression), compressed(m.compressed),
     dynamic_data(m.dynamic_data), IA(m.IA), JA(m.JA), AA(m.AA),
-    ncol(m.ncol), nrow(m.nrow)
+    width(m.width), block(m.block), ncol(m.ncol), nrow(m.nrow)
 {}
 
 
+/**
+ * @brief Move constructor: takes the data of the moved matrix, left empty
+ * with shape (0, 0).
+ *
+ * @param m         Matrix object
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+Matrix<T, StorageOrder, Alloc>::Matrix(Matrix &&m) noexcept :
+    ordering(m.ordering), compression(m.compression), compressed(m.compressed),
+    dynamic_data(std::move(m.dynamic_data)), IA(std::move(m.IA)), JA(std::move(m.JA)), AA(std::move(m.AA)),
+    width(m.width), block(m.block), ncol(m.ncol), nrow(m.nrow)
+{
+    m.compressed = false;
+    m.width = 0;
+    m.block = 1;
+    m.ncol = 0;
+    m.nrow = 0;
+}
+
+
+/**
+ * @brief Copy assignment.
+ *
+ * @param m         Matrix object
+ * @return Matrix&
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+Matrix<T, StorageOrder, Alloc> & Matrix<T, StorageOrder, Alloc>::operator=(Matrix const &m)
+{
+    if (this != &m)
+    {
+        ordering = m.ordering;
+        compression = m.compression;
+        compressed = m.compressed;
+        dynamic_data = m.dynamic_data;
+        IA = m.IA;
+        JA = m.JA;
+        AA = m.AA;
+        width = m.width;
+        block = m.block;
+        ncol = m.ncol;
+        nrow = m.nrow;
+    }
+    return *this;
+}
+
+
+/**
+ * @brief Move assignment: the data of this matrix is released, the moved
+ * matrix is left empty with shape (0, 0).
+ *
+ * @param m         Matrix object
+ * @return Matrix&
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+Matrix<T, StorageOrder, Alloc> & Matrix<T, StorageOrder, Alloc>::operator=(Matrix &&m) noexcept(nothrow_move_assignment)
+{
+    if (this != &m)
+    {
+        ordering = m.ordering;
+        compression = m.compression;
+        compressed = std::exchange(m.compressed, false);
+        dynamic_data = std::move(m.dynamic_data);
+        IA = std::move(m.IA);
+        JA = std::move(m.JA);
+        AA = std::move(m.AA);
+        width = std::exchange(m.width, 0);
+        block = std::exchange(m.block, 1);
+        ncol = std::exchange(m.ncol, 0);
+        nrow = std::exchange(m.nrow, 0);
+        m.dynamic_data.clear();
+        m.IA.clear();
+        m.JA.clear();
+        m.AA.clear();
+    }
+    return *this;
+}
+
+
 /**
  * @brief Reshape the matrix passing the new number of rows and columns.
  * 
  * @param r         new number of rows
  * @param c         new number of columns
  */
-template<typename T, typename StorageOrder>
-void Matrix<T, StorageOrder>::resize(std::size_t const& r, size_t const& c)
+template<typename T, typename StorageOrder, typename Alloc>
+void Matrix<T, StorageOrder, Alloc>::resize(std::size_t const& r, size_t const& c)
 {
     if (compressed)
     {
@@ -384,8 +910,8 @@ void Matrix<T, StorageOrder>::resize(std::size_t const& r, size_t const& c)
  * 
  * @return bool
  */
-template<typename T, typename StorageOrder>
-bool Matrix<T, StorageOrder>::is_compressed() const
+template<typename T, typename StorageOrder, typename Alloc>
+bool Matrix<T, StorageOrder, Alloc>::is_compressed() const
 {
     if (compressed)
         return true;
@@ -397,20 +923,39 @@ bool Matrix<T, StorageOrder>::is_compressed() const
  * @brief Pass from a coordinate representation to a compressed representation.
  *
  * Possible representations are:
- * - Compressed Sparse Row (CSR)
- * - Compressed Sparse Column (CSC) 
- * 
+ * - Compressed Sparse Row (CSR): IA holds nrow+1 row pointers, JA the column
+ *   indices and AA the values
+ * - Compressed Sparse Column (CSC): JA holds ncol+1 column pointers, IA the row
+ *   indices and AA the values
+ * - ELLPACK (ELL): IA holds the nrow row lengths, JA and AA the columns and
+ *   values of each row padded to the longest row, stored slot by slot (slot s
+ *   of row i at s*nrow+i); padding has column 0 and value 0
+ * - Block Sparse Row (BSR): IA holds the block row pointers, JA the block
+ *   columns and AA the dense b x b blocks, row-major; the last block row and
+ *   column are padded with zeros
+ * - Diagonal (DIA): IA holds the sorted offsets of the stored diagonals shifted
+ *   by nrow-1 (offset j-i), AA nrow values per diagonal (a_{i,i+off} at
+ *   k*nrow+i), JA is empty
+ *
+ * ELL, BSR and DIA require row-major ordering.
+ *
+ * Nodes of the coordinate map are extracted and freed as soon as they are
+ * consumed, so the peak memory stays close to the larger of the two
+ * representations (the padded formats allocate their vectors in advance).
+ *
+ * @param c             compression format
+ * @param b             block size, only for BSR
  */
-template<typename T, typename StorageOrder>
-void Matrix<T, StorageOrder>::compress(Compression const &c)
+template<typename T, typename StorageOrder, typename Alloc>
+void Matrix<T, StorageOrder, Alloc>::compress(Compression const &c, std::size_t const &b)
 {
+    ALGEBRA_PERF_SCOPE("Matrix::compress");
     if (compressed)
     {
         std::cout << "Matrix is already compressed" << std::endl;
         return;
     }
 
-
     switch (c)
     {
     case Compression::CSR:
@@ -421,37 +966,26 @@ void Matrix<T, StorageOrder>::compress(Compression const &c)
             return;
         }
 
-        // keep track of row index change and element
-        std::size_t temp_ind = dynamic_data.cbegin()->first[0];
-        // first element row
-        IA.push_back(temp_ind);
+        IA.assign(nrow+1, 0);
 
-        for (auto it=dynamic_data.cbegin(); it!=dynamic_data.cend(); ++it)
+        // map is sorted by row, then column: values and columns are in order
+        // each node is freed as soon as it is consumed
+        while (!dynamic_data.empty())
         {
-            //std::cout << it->first[0] << " " << std::next(it)->first[0];
-            //* value
-            AA.push_back(it->second);
+            auto node = dynamic_data.extract(dynamic_data.begin());
+            //* count elements in each row
+            ++IA[node.key()[0]+1];
             //* column
-            JA.push_back(it->first[1]);
-            
-            // index of new row
-            if(it->first[0] != temp_ind)
-            {
-                temp_ind = it->first[0];
-
-                // add same element to empty rows
-                auto it_tmp = std::prev(it);
-                for( std::size_t k=it_tmp->first[0]+1; k<temp_ind; ++k )
-                {
-                    IA.push_back(AA.size()-1);
-                }
+            JA.push_back(node.key()[1]);
+            //* value
+            AA.push_back(node.mapped());
+        }
 
-                //* rows
-                temp_ind = it->first[0];
-                IA.push_back(AA.size()-1);
-            }
+        //* rows: cumulative sum of the counts
+        for (std::size_t i=0; i<nrow; ++i)
+        {
+            IA[i+1] += IA[i];
         }
-        IA.push_back(AA.size()-1);
 
         break;
     }
@@ -464,36 +998,145 @@ void Matrix<T, StorageOrder>::compress(Compression const &c)
             return;
         }
 
-        // keep track of row index change and element
-        std::size_t temp_ind = dynamic_data.cbegin()->first[1];
-        // first element row
-        JA.push_back(temp_ind);
+        JA.assign(ncol+1, 0);
 
-        for (auto it=dynamic_data.cbegin(); it!=dynamic_data.cend(); ++it)
+        // map is sorted by column, then row: values and rows are in order
+        // each node is freed as soon as it is consumed
+        while (!dynamic_data.empty())
         {
+            auto node = dynamic_data.extract(dynamic_data.begin());
+            //* count elements in each column
+            ++JA[node.key()[0]+1];
+            //* row
+            IA.push_back(node.key()[1]);
             //* value
-            AA.push_back(it->second);
-            //* column
-            IA.push_back(it->first[0]);
-            
-            // index of new row
-            if(it->first[1] != temp_ind)
-            {
-                temp_ind = it->first[1];
+            AA.push_back(node.mapped());
+        }
 
-                // add same element to empty rows
-                auto it_tmp = std::prev(it);
-                for( std::size_t k=it_tmp->first[1]+1; k<temp_ind; ++k )
-                {
-                    JA.push_back(AA.size()-1);
-                }
+        //* columns: cumulative sum of the counts
+        for (std::size_t j=0; j<ncol; ++j)
+        {
+            JA[j+1] += JA[j];
+        }
+
+        break;
+    }
+
+    case Compression::ELL:
+    {
+        if (ordering != Order::Row_major)
+        {
+            std::cerr << "only compress to ELL if row-major ordering" << std::endl;
+            return;
+        }
+
+        //* row lengths and number of slots
+        IA.assign(nrow, 0);
+        for (auto it=dynamic_data.cbegin(); it!=dynamic_data.cend(); ++it)
+        {
+            ++IA[it->first[0]];
+        }
+        width = nrow ? *std::max_element(IA.cbegin(), IA.cend()) : 0;
 
-                //* rows
-                temp_ind = it->first[1];
-                JA.push_back(AA.size()-1);
+        //* slot by slot: consecutive rows are contiguous for each slot
+        JA.assign(nrow*width, 0);
+        AA.assign(nrow*width, T(0));
+        std::size_t row = nrow, slot = 0;
+        while (!dynamic_data.empty())
+        {
+            auto node = dynamic_data.extract(dynamic_data.begin());
+            if (node.key()[0] != row)
+            {
+                row = node.key()[0];
+                slot = 0;
             }
+            JA[slot*nrow + row] = node.key()[1];
+            AA[slot*nrow + row] = node.mapped();
+            ++slot;
+        }
+
+        break;
+    }
+
+    case Compression::BSR:
+    {
+        if (ordering != Order::Row_major)
+        {
+            std::cerr << "only compress to BSR if row-major ordering" << std::endl;
+            return;
+        }
+        if (b == 0)
+        {
+            std::cerr << "BSR block size must be positive" << std::endl;
+            return;
+        }
+
+        std::size_t nbrow = (nrow + b - 1) / b;
+        IA.assign(nbrow+1, 0);
+        JA.clear();
+
+        //* block columns of each block row, sorted and unique
+        auto it = dynamic_data.cbegin();
+        for (std::size_t ib=0; ib<nbrow; ++ib)
+        {
+            std::size_t first = JA.size();
+            for (; it!=dynamic_data.cend() and it->first[0] < (ib+1)*b; ++it)
+            {
+                JA.push_back(it->first[1] / b);
+            }
+            std::sort(JA.begin()+first, JA.end());
+            JA.erase(std::unique(JA.begin()+first, JA.end()), JA.end());
+            IA[ib+1] = JA.size();
+        }
+
+        //* values in dense blocks
+        AA.assign(JA.size()*b*b, T(0));
+        while (!dynamic_data.empty())
+        {
+            auto node = dynamic_data.extract(dynamic_data.begin());
+            std::size_t i = node.key()[0], j = node.key()[1];
+            auto first = JA.cbegin() + IA[i/b];
+            auto last = JA.cbegin() + IA[i/b+1];
+            std::size_t k = std::lower_bound(first, last, j/b) - JA.cbegin();
+            AA[k*b*b + (i%b)*b + j%b] = node.mapped();
+        }
+
+        break;
+    }
+
+    case Compression::DIA:
+    {
+        if (ordering != Order::Row_major)
+        {
+            std::cerr << "only compress to DIA if row-major ordering" << std::endl;
+            return;
+        }
+
+        //* stored diagonals, offset j-i shifted by nrow-1
+        std::vector<std::size_t> position(nrow+ncol, 0);
+        for (auto it=dynamic_data.cbegin(); it!=dynamic_data.cend(); ++it)
+        {
+            position[it->first[1] + nrow-1 - it->first[0]] = 1;
+        }
+        IA.clear();
+        JA.clear();
+        for (std::size_t d=0; d<position.size(); ++d)
+        {
+            if (position[d])
+            {
+                position[d] = IA.size();
+                IA.push_back(d);
+            }
+        }
+
+        //* values diagonal by diagonal, indexed by row
+        AA.assign(IA.size()*nrow, T(0));
+        while (!dynamic_data.empty())
+        {
+            auto node = dynamic_data.extract(dynamic_data.begin());
+            std::size_t d = node.key()[1] + nrow-1 - node.key()[0];
+            AA[position[d]*nrow + node.key()[0]] = node.mapped();
         }
-        JA.push_back(AA.size()-1);
 
         break;
     }
@@ -503,17 +1146,121 @@ void Matrix<T, StorageOrder>::compress(Compression const &c)
     // compressed flag
     compressed = true;
     compression = c;
-    // clear memory
-    dynamic_data.clear();
+    block = (c == Compression::BSR) ? b : 1;
+    // vectors grown while the map was released: trim the extra capacity
+    IA.shrink_to_fit();
+    JA.shrink_to_fit();
+    AA.shrink_to_fit();
+}
+
+
+/**
+ * @brief Call f(i, j, k) for each element stored in compressed format, with
+ * row i, column j and position k in AA. Elements are visited row by row in
+ * column order, except for CSC (column by column). Padding of ELL is skipped,
+ * as well as zeros of BSR and DIA, where stored zeros cannot be told apart
+ * from padding.
+ *
+ * @param f             callable taking row, column and position in AA
+ * @param first         first row (column for CSC) to visit
+ * @param last          row (column for CSC) after the last one to visit
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+template<typename F>
+void Matrix<T, StorageOrder, Alloc>::for_each_stored(F f, std::size_t const &first, std::size_t const &last) const
+{
+    std::size_t end = std::min(last, (compression == Compression::CSC) ? ncol : nrow);
+
+    switch (compression)
+    {
+    case Compression::CSR:
+    {
+        for (std::size_t i=first; i<end; ++i)
+            for (std::size_t k=IA[i]; k<IA[i+1]; ++k)
+                f(i, JA[k], k);
+        break;
+    }
+    case Compression::CSC:
+    {
+        for (std::size_t j=first; j<end; ++j)
+            for (std::size_t k=JA[j]; k<JA[j+1]; ++k)
+                f(IA[k], j, k);
+        break;
+    }
+    case Compression::ELL:
+    {
+        for (std::size_t i=first; i<end; ++i)
+            for (std::size_t s=0; s<IA[i]; ++s)
+                f(i, JA[s*nrow+i], s*nrow+i);
+        break;
+    }
+    case Compression::BSR:
+    {
+        for (std::size_t i=first; i<end; ++i)
+        {
+            std::size_t ib = i / block;
+            for (std::size_t k=IA[ib]; k<IA[ib+1]; ++k)
+            {
+                std::size_t pos = k*block*block + (i%block)*block;
+                for (std::size_t c=0; c<block and JA[k]*block+c<ncol; ++c)
+                {
+                    if (AA[pos+c] != T(0))
+                        f(i, JA[k]*block+c, pos+c);
+                }
+            }
+        }
+        break;
+    }
+    case Compression::DIA:
+    {
+        for (std::size_t i=first; i<end; ++i)
+        {
+            for (std::size_t k=0; k<IA.size(); ++k)
+            {
+                // column j = i + IA[k] - (nrow-1), inside the matrix
+                std::size_t j = i + IA[k];
+                if (j < nrow-1 or j-(nrow-1) >= ncol)
+                    continue;
+                if (AA[k*nrow+i] != T(0))
+                    f(i, j-(nrow-1), k*nrow+i);
+            }
+        }
+        break;
+    }
+    } // switch(compression)
+}
+
+
+/**
+ * @brief Drop the consumed tail of the index and value vectors, releasing the
+ * memory when less than half of the capacity is in use.
+ *
+ * @param ind           index vector
+ * @param val           value vector
+ * @param size          number of elements still to consume
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+void Matrix<T, StorageOrder, Alloc>::shrink_consumed(index_vector &ind, value_vector &val, std::size_t const &size)
+{
+    ind.resize(size);
+    val.resize(size);
+    if (2*size < val.capacity())
+    {
+        ind.shrink_to_fit();
+        val.shrink_to_fit();
+    }
 }
 
 
 /**
  * @brief Pass from a compressed representation to the coordinate representation.
+ *
+ * CSR and CSC are consumed from the end, releasing the vectors while the map
+ * grows. Explicitly stored zeros of the BSR and DIA formats are not restored.
  * 
  */
-template<typename T, typename StorageOrder>
-void Matrix<T, StorageOrder>::uncompress()
+template<typename T, typename StorageOrder, typename Alloc>
+void Matrix<T, StorageOrder, Alloc>::uncompress()
 {
     if (!compressed)
     {
@@ -525,164 +1272,260 @@ void Matrix<T, StorageOrder>::uncompress()
     {
     case Compression::CSR:
     {
-        if (ordering != Order::Row_major)
+        // insert elements in map from the last, already sorted: hint at the begin
+        for (std::size_t i=nrow; i-- > 0; )
         {
-            std::cerr << "only decompress from CSR if column-major ordering" << std::endl;
-            return;
-        }
-
-        // sizes of arrays
-        std::size_t i_sz = IA.size();
-        std::size_t j_sz = JA.size();
-
-        // insert elements in map
-        for (std::size_t i=0; i<i_sz; ++i)
-        {
-            // use I vector to loop from index i to i+1 in vector J and data
-            for (std::size_t j=IA[i]; j<IA[i+1]; ++j)
+            // use IA vector to loop from index i+1 to i in vector JA and data
+            for (std::size_t k=IA[i+1]; k-- > IA[i]; )
             {
-                // {col,     row}, data
-                dynamic_data.insert( { {i, JA[j]}, AA[j]} );
+                // {row, col}, data
+                dynamic_data.emplace_hint(dynamic_data.begin(), indexes{i, JA[k]}, AA[k]);
             }
+            shrink_consumed(JA, AA, IA[i]);
         }
-
-        // insert last element
-        dynamic_data.insert( { {nrow-1, JA[j_sz-1]}, AA[j_sz-1]} );
+        break;
     }
 
     case Compression::CSC:
     {
-        if (ordering != Order::Column_major)
-        {
-            std::cerr << "only decompress from CSC if column-major ordering" << std::endl;
-            return;
-        }
-
-        // sizes of arrays
-        std::size_t i_sz = IA.size();
-        std::size_t j_sz = JA.size();
-
-        // insert elements in map
-        for (std::size_t j=0; j<j_sz; ++j)
+        // insert elements in map from the last, already sorted: hint at the begin
+        for (std::size_t j=ncol; j-- > 0; )
         {
-            // use I vector to loop from index i to i+1 in vector J and data
-            for (std::size_t i=IA[j]; i<IA[j+1]; ++i)
+            // use JA vector to loop from index j+1 to j in vector IA and data
+            for (std::size_t k=JA[j+1]; k-- > JA[j]; )
             {
-                // {col,     row}, data
-                dynamic_data.insert( { {j, JA[i]}, AA[i]} );
+                // {col, row}, data
+                dynamic_data.emplace_hint(dynamic_data.begin(), indexes{j, IA[k]}, AA[k]);
             }
+            shrink_consumed(IA, AA, JA[j]);
         }
+        break;
+    }
 
-        // insert last element
-        dynamic_data.insert( { {nrow-1, JA[i_sz-1]}, AA[i_sz-1]} );
-        
+    case Compression::ELL:
+    case Compression::BSR:
+    case Compression::DIA:
+    {
+        // visited row by row in column order: hint at the end
+        for_each_stored([this](std::size_t i, std::size_t j, std::size_t k)
+        {
+            dynamic_data.emplace_hint(dynamic_data.end(), indexes{i, j}, AA[k]);
+        });
         break;
     }
 
     } //switch(compression)
 
+    compressed = false;
+    width = 0;
+    block = 1;
+
+    // release the memory of the compressed representation
     AA.clear();
     JA.clear();
     IA.clear();
+    AA.shrink_to_fit();
+    JA.shrink_to_fit();
+    IA.shrink_to_fit();
 
 }
 
 
 /**
- * @brief Print in coordinate representation
- * 
- * @tparam T 
- * @tparam StorageOrder 
+ * @brief Append a value to a text buffer: real numbers in the shortest form
+ * that reads back exactly, complex numbers as "(re,im)", or "re im" for the
+ * matrix market format.
+ *
+ * @param buf           text buffer
+ * @param v             value
+ * @param mtx           matrix market format
  */
-template<typename T, typename StorageOrder>
-void Matrix<T, StorageOrder>::print() const
+template<typename T, typename StorageOrder, typename Alloc>
+void Matrix<T, StorageOrder, Alloc>::append_value(std::string &buf, T const &v, bool const &mtx)
 {
-    // print if not compressed
-    if (!compressed)
+    char tmp[64];
+    auto number = [&](auto x)
     {
-        // std::cout << "print uncompressed" << std::endl;
-        for (auto it=dynamic_data.cbegin(); it!=dynamic_data.cend(); ++it)
+        auto res = std::to_chars(tmp, tmp+sizeof(tmp), x);
+        buf.append(tmp, res.ptr);
+    };
+
+    if constexpr (is_complex<T>::value)
+    {
+        if (!mtx)
+            buf += '(';
+        number(v.real());
+        buf += mtx ? ' ' : ',';
+        number(v.imag());
+        if (!mtx)
+            buf += ')';
+    }
+    else
+        number(v);
+}
+
+
+/**
+ * @brief Write all the elements as text, one per line. The rows (columns for
+ * column-major and CSC) are split in chunks formatted in parallel into their
+ * own buffers, then the buffers are written in order with one large write
+ * each.
+ *
+ * @param os            output stream
+ * @param mtx           matrix market format: 1-based "row col value" lines;
+ *                      otherwise 0-based "i\t j: \tvalue" lines, with i the
+ *                      first index of the storage ordering (as print())
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+void Matrix<T, StorageOrder, Alloc>::write_entries(std::ostream &os, bool const &mtx) const
+{
+    // elements per chunk and chunks formatted at the same time
+    constexpr std::size_t chunk_size = 1 << 15;
+    constexpr std::size_t batch = 32;
+
+    // major index: first index of the keys, column for CSC, row otherwise
+    std::size_t nmajor = compressed ? ((compression == Compression::CSC) ? ncol : nrow)
+                                    : (dynamic_data.empty() ? 0 : dynamic_data.crbegin()->first[0]+1);
+    std::size_t nnz = compressed ? AA.size() : dynamic_data.size();
+    std::size_t nchunks = std::max<std::size_t>(std::min(nnz / chunk_size, nmajor), 1);
+
+    // chunk bounds, balanced on the elements for CSR and CSC
+    std::vector<std::size_t> bound(nchunks+1);
+    for (std::size_t c=0; c<=nchunks; ++c)
+    {
+        bound[c] = nmajor * c / nchunks;
+        if (compressed and (compression == Compression::CSR or compression == Compression::CSC))
         {
-            std::cout << it->first[0] << "\t " << it->first[1] << ": \t" << it->second << std::endl;
+            auto const &ptr = (compression == Compression::CSR) ? IA : JA;
+            bound[c] = std::lower_bound(ptr.cbegin(), ptr.cbegin()+nmajor, nnz * c / nchunks) - ptr.cbegin();
         }
-        return;
     }
+    bound[nchunks] = nmajor;
 
-    // print if compressed format
-    // std::cout << "print compressed" << std::endl;
-
-    switch(compression)
+    auto put = [mtx](std::string &buf, std::size_t a, std::size_t b, T const &v)
     {
-    case Compression::CSR:
+        char tmp[24];
+        buf.append(tmp, std::to_chars(tmp, tmp+sizeof(tmp), mtx ? a+1 : a).ptr);
+        buf += mtx ? " " : "\t ";
+        buf.append(tmp, std::to_chars(tmp, tmp+sizeof(tmp), mtx ? b+1 : b).ptr);
+        buf += mtx ? " " : ": \t";
+        append_value(buf, v, mtx);
+        buf += '\n';
+    };
+
+    std::vector<std::string> buffers(std::min(batch, nchunks));
+    for (std::size_t first=0; first<nchunks; first+=batch)
     {
-        //* i = row index
-        std::size_t i=0;
+        std::size_t nb = std::min(batch, nchunks-first);
 
-        //* i_sz = dimension of row index vector
-        std::size_t i_sz = IA.size();
-
-        //* j index along element vector
-        for(std::size_t j=0; j<JA.size(); )
+        #pragma omp parallel for schedule(dynamic)
+        for (std::size_t c=0; c<nb; ++c)
         {
+            auto &buf = buffers[c];
+            buf.clear();
+            std::size_t lo = bound[first+c], hi = bound[first+c+1];
 
-            // if index of element vector equal to next element, then new row
-            // index of element vector must be different from last element
-            if ( (j == IA[i+1]) and (j!=IA[i_sz-1]) ) 
+            if (!compressed)
             {
-                ++i;
+                // keys are {row, col} if row-major, {col, row} if column-major
+                bool swap = mtx and ordering == Order::Column_major;
+                auto it = dynamic_data.lower_bound(indexes{lo, 0});
+                auto end = (hi == nmajor) ? dynamic_data.cend() : dynamic_data.lower_bound(indexes{hi, 0});
+                for (; it!=end; ++it)
+                {
+                    put(buf, it->first[swap ? 1 : 0], it->first[swap ? 0 : 1], it->second);
+                }
             }
-
-            // if next index is the same, then it is an empty row
-            if (IA[i+1] == IA[i])
+            else
             {
-                ++i;
-                continue;
+                // print() shows CSC column by column, column first
+                bool swap = !mtx and compression == Compression::CSC;
+                for_each_stored([&](std::size_t i, std::size_t j, std::size_t k)
+                {
+                    put(buf, swap ? j : i, swap ? i : j, AA[k]);
+                }, lo, hi);
             }
-
-            std::cout << i << "\t " << JA[j] << ": \t" << AA[j] << std::endl;
-
-            ++j;
         }
-        return;
-    }
-    case Compression::CSC:
-    {
-        //* j = column index
-        std::size_t j=0;
-
-        //* j_sz = dimension of column index vector
-        std::size_t j_sz = JA.size();
 
-        //* i index along element vector
-        for(std::size_t i=0; i<JA.size(); )
+        for (std::size_t c=0; c<nb; ++c)
         {
+            os.write(buffers[c].data(), buffers[c].size());
+        }
+    }
+    os.flush();
+}
 
-            // if index of element vector equal to next element, then new column
-            // index of element vector must be different from last element
-            if ( (i == JA[j+1]) and (i!=IA[j_sz-1]) ) 
-            {
-                ++j;
-            }
-
-            // if next index is the same, then it is an empty row
-            if (IA[j+1] == IA[j])
-            {
-                ++j;
-                continue;
-            }
 
-            std::cout << j << "\t " << IA[i] << ": \t" << AA[i] << std::endl;
+/**
+ * @brief Print in coordinate representation, one element per line (first index
+ * of the storage ordering, second index, value). Output is formatted in
+ * parallel buffers and written in large blocks.
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+void Matrix<T, StorageOrder, Alloc>::print() const
+{
+    write_entries(std::cout, false);
+}
 
-            ++i;
-        }
 
+/**
+ * @brief Save the matrix in matrix market format (coordinate, general), from
+ * any state. Indices are 1-based rows and columns whatever the ordering.
+ *
+ * @param name          String containing the path to the file to write
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+void Matrix<T, StorageOrder, Alloc>::save_mtx(std::string const &name) const
+{
+    std::ofstream file(name, std::ios::binary);
+    if (!file.is_open())
+    {
+        std::cerr << "Error opening file " << name << std::endl;
         return;
     }
 
-    } //switch(ordering)
+    // number of elements: padding and zeros of the blocks are not written
+    std::size_t nnz = dynamic_data.size();
+    if (compressed)
+    {
+        nnz = 0;
+        for_each_stored([&nnz](std::size_t, std::size_t, std::size_t) { ++nnz; });
+    }
+
+    file << "%%MatrixMarket matrix coordinate " << (is_complex<T>::value ? "complex" : "real")
+         << " general\n" << nrow << " " << ncol << " " << nnz << "\n";
+    write_entries(file, true);
 
+    if (!file)
+    {
+        std::cerr << "Error writing file " << name << std::endl;
+    }
+}
 
 
+/**
+ * @brief Memory used by the matrix, by component. Vectors are counted by
+ * capacity. The size of a map node is estimated as the value plus the
+ * red-black tree links (parent, left, right and color), plus the allocator
+ * header, rounded to the alignment of the allocations: the real size depends
+ * on the allocator, use TrackingAllocator for an exact count.
+ *
+ * @return MemoryUsage
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+MemoryUsage Matrix<T, StorageOrder, Alloc>::memory_usage() const
+{
+    constexpr std::size_t align = alignof(std::max_align_t);
+    constexpr std::size_t node = sizeof(typename coo_matrix::value_type) + 4*sizeof(void*) + sizeof(std::size_t);
+
+    MemoryUsage m;
+    m.coo_nodes = dynamic_data.size();
+    m.coo_bytes = m.coo_nodes * ((node + align - 1) / align * align);
+    m.ia_bytes = IA.capacity() * sizeof(std::size_t);
+    m.ja_bytes = JA.capacity() * sizeof(std::size_t);
+    m.aa_bytes = AA.capacity() * sizeof(T);
+    m.object_bytes = sizeof(*this);
+    return m;
 }
 
 
@@ -691,8 +1534,8 @@ void Matrix<T, StorageOrder>::print() const
  * 
  * @return double 
  */
-template<typename T, typename StorageOrder>
-double Matrix<T, StorageOrder>::norm_one() const
+template<typename T, typename StorageOrder, typename Alloc>
+double Matrix<T, StorageOrder, Alloc>::norm_one() const
 {
     double res=0.0;
     std::vector<double> sums(ncol);
@@ -706,7 +1549,7 @@ double Matrix<T, StorageOrder>::norm_one() const
         // save sum of each row
         for(auto it = dynamic_data.cbegin(); it != dynamic_data.cend(); ++it)
         {
-            sums[it->first[1]] += std::abs(it->second);
+            sums[it->first[1]] += magnitude(it->second);
         }
 
         // find maximum among all elements of sums
@@ -720,20 +1563,19 @@ double Matrix<T, StorageOrder>::norm_one() const
     }
 
 
-    switch (compression)
-    {
-    case Compression::CSR:
-    {
-        // std::cout << "CSR norm-1" << std::endl;
-        break;
-    }
-    case Compression::CSC:
+    else
     {
-        // std::cout << "CSC norm-1" << std::endl;
-        break;
-    }
+        // sum of each column, any compression format
+        for_each_stored([&](std::size_t, std::size_t j, std::size_t k)
+        {
+            sums[j] += magnitude(AA[k]);
+        });
 
-    } //switch(compression)
+        for(std::size_t j = 0; j < sums.size(); ++j)
+        {
+            res = std::max(res, sums[j]);
+        }
+    }
 
     return res;
 }
@@ -744,16 +1586,16 @@ double Matrix<T, StorageOrder>::norm_one() const
  * 
  * @return double 
  */
-template<typename T, typename StorageOrder>
-double Matrix<T, StorageOrder>::norm_infty() const
+template<typename T, typename StorageOrder, typename Alloc>
+double Matrix<T, StorageOrder, Alloc>::norm_infty() const
 {
     double res=0.0;
     double sum=0.0;
-    std::size_t id_tmp = dynamic_data.begin()->first[0];
     // max of sum by rows
 
-    if (!compressed)
+    if (!compressed and !dynamic_data.empty())
     {
+        std::size_t id_tmp = dynamic_data.begin()->first[0];
         //std::cout << "COO infinity norm" << std::endl;
 
         for(auto it = dynamic_data.cbegin(); it != dynamic_data.cend(); ++it)
@@ -770,7 +1612,7 @@ double Matrix<T, StorageOrder>::norm_infty() const
             }
             
             // update sum
-            sum += std::abs(it->second);
+            sum += magnitude(it->second);
         }
 
         // check last sum for maximum
@@ -781,20 +1623,20 @@ double Matrix<T, StorageOrder>::norm_infty() const
     }
 
 
-    switch(compression)
-    {
-    case Compression::CSR:
+    else if (compressed)
     {
-        // std::cout << "CSR infinity norm" << std::endl;
-        break;
-    }
-    case Compression::CSC:
-    {
-        // std::cout << "CSC infinity norm" << std::endl;
-        break;
-    }
+        // sum of each row, any compression format
+        std::vector<double> sums(nrow);
+        for_each_stored([&](std::size_t i, std::size_t, std::size_t k)
+        {
+            sums[i] += magnitude(AA[k]);
+        });
 
-    } //switch(compression)
+        for(std::size_t i = 0; i < sums.size(); ++i)
+        {
+            res = std::max(res, sums[i]);
+        }
+    }
 
     return res;
 }
@@ -805,8 +1647,8 @@ double Matrix<T, StorageOrder>::norm_infty() const
  * 
  * @return double 
  */
-template<typename T, typename StorageOrder>
-double Matrix<T, StorageOrder>::norm_frob() const
+template<typename T, typename StorageOrder, typename Alloc>
+double Matrix<T, StorageOrder, Alloc>::norm_frob() const
 {
     double res=0.0;
 
@@ -817,33 +1659,16 @@ double Matrix<T, StorageOrder>::norm_frob() const
         // sum of all elements squared
         for(auto it = dynamic_data.cbegin(); it != dynamic_data.cend(); ++it)
         {
-            res += std::abs(it->second) * std::abs(it->second);
+            res += magnitude2(it->second);
         }
         return std::sqrt(res);
     }
 
-    switch (ordering) {
-    
-    case Compression::CSR:
+    // all compression formats: padding of ELL, BSR and DIA is zero
+    for(auto it = AA.cbegin(); it != AA.cend(); ++it)
     {
-        // std::cout << "CSR Frobenius norm" << std::endl;
-        for(auto it = AA.cbegin(); it != AA.cend(); ++it)
-        {
-            res += std::abs(*it) * std::abs(*it);
-        }
-        break;
+        res += magnitude2(*it);
     }
-    case Compression::CSC:
-    {
-        // std::cout << "CSC Frobenius norm" << std::endl;
-        for(auto it = AA.cbegin(); it != AA.cend(); ++it)
-        {
-            res += std::abs(*it) * std::abs(*it);
-        }
-        break;
-    }
-
-    } // switch(ordering)
 
     return std::sqrt(res);
 }
@@ -859,8 +1684,8 @@ double Matrix<T, StorageOrder>::norm_frob() const
  * @param n             Enumerator indicating the desired norm
  * @return double 
  */
-template<typename T, typename StorageOrder>
-double Matrix<T, StorageOrder>::norm(Norm const &n) const
+template<typename T, typename StorageOrder, typename Alloc>
+double Matrix<T, StorageOrder, Alloc>::norm(Norm const &n) const
 {
     double res = 0.;
 
@@ -892,8 +1717,8 @@ double Matrix<T, StorageOrder>::norm(Norm const &n) const
  * @param i 
  * @return T 
  */
-template<typename T, typename StorageOrder>
-T Matrix<T, StorageOrder>::operator[] (indexes const &ind) const
+template<typename T, typename StorageOrder, typename Alloc>
+T Matrix<T, StorageOrder, Alloc>::operator[] (indexes const &ind) const
 {
     T res = 0;
     if (!compressed)
@@ -901,9 +1726,10 @@ T Matrix<T, StorageOrder>::operator[] (indexes const &ind) const
         // std::cout << "COO subscript copy" << std::endl;
 
         // check if present
-        if (dynamic_data.count(ind))
+        auto it = dynamic_data.find(ind);
+        if (it != dynamic_data.cend())
         {
-            return dynamic_data.at(ind);
+            return it->second;
         }
 
         // if out of bounds error
@@ -921,19 +1747,56 @@ T Matrix<T, StorageOrder>::operator[] (indexes const &ind) const
     case Compression::CSR:
     {
         //std::cout << "CSR subscript copy" << std::endl;
-        
-        // first element of selected row
-        std::size_t elem_first = IA[ ind[0] ];
-        res = AA[ elem_first + ind[1]];
+        if (ind[0] >= nrow)
+        {
+            std::cerr << "out of bound index" << std::endl;
+            break;
+        }
+
+        // columns of selected row are sorted
+        auto first = JA.cbegin() + IA[ ind[0] ];
+        auto last = JA.cbegin() + IA[ ind[0]+1 ];
+        auto it = std::lower_bound(first, last, ind[1]);
+        if (it != last and *it == ind[1])
+        {
+            res = AA[ it - JA.cbegin() ];
+        }
         break;
     }
     case Compression::CSC:
     {
         // std::cout << "CSC subscript copy" << std::endl;
+        if (ind[0] >= ncol)
+        {
+            std::cerr << "out of bound index" << std::endl;
+            break;
+        }
+
+        // rows of selected column are sorted
+        auto first = IA.cbegin() + JA[ ind[0] ];
+        auto last = IA.cbegin() + JA[ ind[0]+1 ];
+        auto it = std::lower_bound(first, last, ind[1]);
+        if (it != last and *it == ind[1])
+        {
+            res = AA[ it - IA.cbegin() ];
+        }
+        break;
+    }
+    case Compression::ELL:
+    case Compression::BSR:
+    case Compression::DIA:
+    {
+        if (ind[0] >= nrow or ind[1] >= ncol)
+        {
+            std::cerr << "out of bound index" << std::endl;
+            break;
+        }
 
-        // first element of selected row
-        std::size_t elem_first = JA[ ind[0] ];
-        res = AA[ elem_first + ind[1]];
+        std::size_t k = stored_position(ind);
+        if (k < AA.size())
+        {
+            res = AA[k];
+        }
         break;
     }
 
@@ -944,24 +1807,31 @@ T Matrix<T, StorageOrder>::operator[] (indexes const &ind) const
 
 
 /**
- * @brief Subscript operator for access assign
+ * @brief Subscript operator for access assign.
+ *
+ * In compressed state only existing elements can be modified: the pattern
+ * cannot change.
  * 
  * @param i         Indices as a std::array<std::size_t>
  * @return T& 
  */
-template<typename T, typename StorageOrder>
-T& Matrix<T, StorageOrder>::operator[] (indexes const &ind)
+template<typename T, typename StorageOrder, typename Alloc>
+T& Matrix<T, StorageOrder, Alloc>::operator[] (indexes const &ind)
 {
 
-    if (!compression)
+    if (!compressed)
     {
         // std::cout << "COO subscript reference" << std::endl;
         // cannot tell if access for assignment or copy for non-const Matrix
 
-        // if out of bounds error
-        if (ind[0]>nrow or ind[1]>ncol)
+        // if out of bounds error, enlarge the matrix to hold the new element
+        std::size_t r = (ordering == Order::Row_major) ? ind[0] : ind[1];
+        std::size_t c = (ordering == Order::Row_major) ? ind[1] : ind[0];
+        if (r>=nrow or c>=ncol)
         {
             std::cerr << "out of bound index - assigning out of bounds" << std::endl;
+            nrow = std::max(nrow, r+1);
+            ncol = std::max(ncol, c+1);
         }
 
         // add new element if not present
@@ -969,106 +1839,304 @@ T& Matrix<T, StorageOrder>::operator[] (indexes const &ind)
     }
 
 
-    switch (ordering)
+    switch (compression)
     {
     
     case Compression::CSR:
     {
         //std::cout << "CSR subscript reference" << std::endl;
 
-        // first element of selected row
-        std::size_t elem_first = IA[ ind[0] ];
-        return AA[ elem_first + ind[1]];
+        // columns of selected row are sorted
+        if (ind[0] < nrow)
+        {
+            auto first = JA.cbegin() + IA[ ind[0] ];
+            auto last = JA.cbegin() + IA[ ind[0]+1 ];
+            auto it = std::lower_bound(first, last, ind[1]);
+            if (it != last and *it == ind[1])
+            {
+                return AA[ it - JA.cbegin() ];
+            }
+        }
+        break;
     }
     case Compression::CSC:
     {
         //std::cout << "CSC subscript reference" << std::endl;
 
-        // first element of selected column
-        std::size_t elem_first = JA[ ind[0] ];
-        return AA[ elem_first + ind[1]];
+        // rows of selected column are sorted
+        if (ind[0] < ncol)
+        {
+            auto first = IA.cbegin() + JA[ ind[0] ];
+            auto last = IA.cbegin() + JA[ ind[0]+1 ];
+            auto it = std::lower_bound(first, last, ind[1]);
+            if (it != last and *it == ind[1])
+            {
+                return AA[ it - IA.cbegin() ];
+            }
+        }
         break;
     }
+    case Compression::ELL:
+    case Compression::BSR:
+    case Compression::DIA:
+    {
+        //std::cout << "ELL, BSR, DIA subscript reference" << std::endl;
 
-    } // switch(ordering)
+        // padding zeros of BSR and DIA are part of the pattern
+        if (ind[0] < nrow and ind[1] < ncol)
+        {
+            std::size_t k = stored_position(ind);
+            if (k < AA.size())
+            {
+                return AA[k];
+            }
+        }
+        break;
+    }
+
+    } // switch(compression)
 
+    std::cerr << "cannot add new element to compressed matrix" << std::endl;
+    static T dummy;
+    dummy = 0;
+    return dummy;
 }
 
 /**
- * @brief Matrix-vector multiplication.
- * 
- * @param m             Matrix object
- * @param v             Standard vector
- * @return std::vector<T> 
+ * @brief Position in AA of an element of the ELL, BSR or DIA formats, AA.size()
+ * if the element is not stored. Indices must be inside the matrix.
+ *
+ * @param ind       Indices {row, col}
+ * @return std::size_t
  */
-template<typename T, typename StorageOrder>
-std::vector<T> operator*(Matrix<T,StorageOrder> const &m, std::vector<T> const &v )
+template<typename T, typename StorageOrder, typename Alloc>
+std::size_t Matrix<T, StorageOrder, Alloc>::stored_position(indexes const &ind) const
 {
+    std::size_t i = ind[0], j = ind[1];
 
-    std::size_t v_sz = v.size();
-    if ( m.ncol != v_sz )
+    switch (compression)
     {
-        std::cerr << "sizes are not compatible for multiplication: (" 
-            << m.nrow << ", " << m.ncol << ") * (" << v.size() << ", 1)"
-            << std::endl;
-        
-        std::vector<T> res;
-        return res;
+    case Compression::ELL:
+    {
+        // few slots per row: linear search
+        for (std::size_t s=0; s<IA[i]; ++s)
+        {
+            if (JA[s*nrow+i] == j)
+                return s*nrow+i;
+        }
+        break;
+    }
+    case Compression::BSR:
+    {
+        // block columns of the block row are sorted
+        auto first = JA.cbegin() + IA[i/block];
+        auto last = JA.cbegin() + IA[i/block+1];
+        auto it = std::lower_bound(first, last, j/block);
+        if (it != last and *it == j/block)
+            return (it - JA.cbegin())*block*block + (i%block)*block + j%block;
+        break;
+    }
+    case Compression::DIA:
+    {
+        // stored diagonals are sorted
+        auto it = std::lower_bound(IA.cbegin(), IA.cend(), j + nrow-1 - i);
+        if (it != IA.cend() and *it == j + nrow-1 - i)
+            return (it - IA.cbegin())*nrow + i;
+        break;
     }
+    case Compression::CSR:
+    case Compression::CSC:
+        break;
+    } // switch(compression)
 
-    std::vector<T> res(m.nrow);
+    return AA.size();
+}
+
+/**
+ * @brief Matrix-vector multiplication storing the result in a given vector.
+ *
+ * The output vector is resized only if needed, so repeated products on
+ * vectors of the right size never allocate memory.
+ * 
+ * @param v             Standard vector, size ncol
+ * @param res           Output vector, size nrow
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+void Matrix<T, StorageOrder, Alloc>::multiply(std::vector<T> const &v, std::vector<T> &res) const
+{
+    ALGEBRA_PERF_SCOPE("Matrix::multiply");
+    if (res.size() != nrow)
+    {
+        res.resize(nrow);
+    }
 
-    if (!m.compressed)
+    if (!compressed)
     {
         // std::cout << "COO matrix-vector multiplication" << std::endl;
+        std::fill(res.begin(), res.end(), T(0));
 
-        for (auto it=m.dynamic_data.cbegin(); it!=m.dynamic_data.cend(); ++it)
+        // keys are {row, col} if row-major, {col, row} if column-major
+        std::size_t r = (ordering == Order::Row_major) ? 0 : 1;
+
+        for (auto it=dynamic_data.cbegin(); it!=dynamic_data.cend(); ++it)
         {
             // row index
-            size_t i = it->first[0];
+            size_t i = it->first[r];
             // column index
-            size_t j = it->first[1];
-            // matrix value
-            T val_ij = it->second;
+            size_t j = it->first[1-r];
 
             // partial multiplication
-            res[i] += val_ij * v[j];
+            res[i] += fast_multiply(it->second, v[j]);
         }
-        return res;
+        return;
     }
 
-    switch (m.compression) {
+    switch (compression) {
 
     case Compression::CSR:
     {
         // std::cout << "CSR matrix-vector multiplication" << std::endl;
 
-        // sizes of arrays
-        std::size_t i_sz = m.IA.size();
-        std::size_t j_sz = m.JA.size();
-        
-        // i index of vector IA, loop over IA
-        for (std::size_t i=0; i<i_sz-1; ++i)
+        // i index of vector IA, loop over rows
+        for (std::size_t i=0; i<nrow; ++i)
         {
-            std::size_t k = m.IA[i];
-            // loop from index i to i+1 of IA in vector JA and AA
-            for (std::size_t j=0; k+j<m.IA[i+1]; ++j)
+            if constexpr (is_complex<T>::value)
             {
-                // {col, row}
-                res[i] += m.AA[k+j] * v[j];
-
-                // std::cout << i << ", " << j
-                //        << m.AA[k+j] << " " << v[j] << std::endl;
+                // real and imaginary parts accumulated separately, vectorized
+                typename T::value_type re = 0, im = 0;
+                #pragma omp simd reduction(+:re,im)
+                for (std::size_t k=IA[i]; k<IA[i+1]; ++k)
+                {
+                    T a = AA[k], x = v[ JA[k] ];
+                    re += a.real()*x.real() - a.imag()*x.imag();
+                    im += a.real()*x.imag() + a.imag()*x.real();
+                }
+                res[i] = T(re, im);
+            }
+            else
+            {
+                T sum = 0;
+                // loop from index i to i+1 of IA in vector JA and AA
+                for (std::size_t k=IA[i]; k<IA[i+1]; ++k)
+                {
+                    sum += AA[k] * v[ JA[k] ];
+                }
+                res[i] = sum;
             }
         }
-        // last sum on last element
-        res[ res.size()-1 ] += m.AA[j_sz-1] * v[v_sz-1];
         break;
     }
     case Compression::CSC:
+    {
         // std::cout << "CSC matrix-vector multiplication" << std::endl;
+        std::fill(res.begin(), res.end(), T(0));
+
+        // j index of vector JA, loop over columns
+        for (std::size_t j=0; j<ncol; ++j)
+        {
+            T vj = v[j];
+            // loop from index j to j+1 of JA in vector IA and AA
+            for (std::size_t k=JA[j]; k<JA[j+1]; ++k)
+            {
+                res[ IA[k] ] += fast_multiply(AA[k], vj);
+            }
+        }
+        break;
+    }
+    case Compression::ELL:
+    {
+        // std::cout << "ELL matrix-vector multiplication" << std::endl;
+        std::fill(res.begin(), res.end(), T(0));
+
+        // slot by slot, contiguous over the rows: padding adds 0 * v[0]
+        for (std::size_t s=0; s<width; ++s)
+        {
+            std::size_t const *cols = JA.data() + s*nrow;
+            T const *vals = AA.data() + s*nrow;
+            for (std::size_t i=0; i<nrow; ++i)
+            {
+                res[i] += fast_multiply(vals[i], v[ cols[i] ]);
+            }
+        }
+        break;
+    }
+    case Compression::BSR:
+    {
+        // std::cout << "BSR matrix-vector multiplication" << std::endl;
+        std::size_t b = block;
+
+        // ib index of vector IA, loop over block rows
+        for (std::size_t ib=0; ib*b<nrow; ++ib)
+        {
+            std::size_t rows = std::min(b, nrow - ib*b);
+            T *out = res.data() + ib*b;
+            std::fill(out, out+rows, T(0));
+            for (std::size_t k=IA[ib]; k<IA[ib+1]; ++k)
+            {
+                // dense block, clipped to the matrix on the last block column
+                std::size_t cols = std::min(b, ncol - JA[k]*b);
+                T const *in = v.data() + JA[k]*b;
+                T const *blk = AA.data() + k*b*b;
+                for (std::size_t r=0; r<rows; ++r)
+                {
+                    T sum = 0;
+                    for (std::size_t c=0; c<cols; ++c)
+                    {
+                        sum += fast_multiply(blk[r*b+c], in[c]);
+                    }
+                    out[r] += sum;
+                }
+            }
+        }
+        break;
+    }
+    case Compression::DIA:
+    {
+        // std::cout << "DIA matrix-vector multiplication" << std::endl;
+        std::fill(res.begin(), res.end(), T(0));
+
+        // k index of vector IA, loop over diagonals with offset j-i
+        for (std::size_t k=0; k<IA.size(); ++k)
+        {
+            // rows [first, last) of the diagonal inside the matrix
+            std::size_t first = (IA[k] < nrow-1) ? nrow-1 - IA[k] : 0;
+            std::size_t last = std::min(nrow, ncol + nrow-1 - IA[k]);
+            std::ptrdiff_t off = static_cast<std::ptrdiff_t>(IA[k]) - static_cast<std::ptrdiff_t>(nrow-1);
+            T const *vals = AA.data() + k*nrow;
+            for (std::size_t i=first; i<last; ++i)
+            {
+                res[i] += fast_multiply(vals[i], v[i+off]);
+            }
+        }
         break;
     }
+    } // switch(compression)
+}
+
+/**
+ * @brief Matrix-vector multiplication.
+ * 
+ * @param m             Matrix object
+ * @param v             Standard vector
+ * @return std::vector<T> 
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+std::vector<T> operator*(Matrix<T,StorageOrder,Alloc> const &m, std::vector<T> const &v )
+{
+
+    std::size_t v_sz = v.size();
+    if ( m.ncol != v_sz )
+    {
+        std::cerr << "sizes are not compatible for multiplication: (" 
+            << m.nrow << ", " << m.ncol << ") * (" << v.size() << ", 1)"
+            << std::endl;
+        
+        std::vector<T> res;
+        return res;
+    }
+
+    std::vector<T> res(m.nrow);
+    m.multiply(v, res);
 
     return res;
 }
@@ -1080,12 +2148,12 @@ std::vector<T> operator*(Matrix<T,StorageOrder> const &m, std::vector<T> const &
  * 
  * @param m1            First Matrix object
  * @param m2            Second Matrix object
- * @return Matrix<T,StorageOrder> 
+ * @return Matrix<T,StorageOrder,Alloc> 
  */
-template<typename T, typename StorageOrder>
-Matrix<T,StorageOrder> operator*(Matrix<T,StorageOrder> const &m1, Matrix<T,StorageOrder> const &m2 )
+template<typename T, typename StorageOrder, typename Alloc>
+Matrix<T,StorageOrder,Alloc> operator*(Matrix<T,StorageOrder,Alloc> const &m1, Matrix<T,StorageOrder,Alloc> const &m2 )
 {
-    Matrix<T,StorageOrder> res;
+    Matrix<T,StorageOrder,Alloc> res;
 
     // check all different orderings if equal for m1 and m2
     if (m1.ordering == m2.ordering)
@@ -1106,11 +2174,194 @@ Matrix<T,StorageOrder> operator*(Matrix<T,StorageOrder> const &m1, Matrix<T,Stor
     case Compression::CSC:
         // std::cout << "CSC matrix-matrix multiplication" << std::endl;
         break;
+    default:
+        break;
     }
 
     return res;
 }
 
+/**
+ * @brief Scale all the elements, in any state.
+ *
+ * @param alpha         scaling factor
+ * @return Matrix&
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+Matrix<T, StorageOrder, Alloc> & Matrix<T, StorageOrder, Alloc>::operator*=(T const &alpha)
+{
+    if (!compressed)
+    {
+        for (auto it=dynamic_data.begin(); it!=dynamic_data.end(); ++it)
+        {
+            it->second *= alpha;
+        }
+        return *this;
+    }
+
+    // all formats: padding is zero
+    #pragma omp parallel for
+    for (std::size_t k=0; k<AA.size(); ++k)
+    {
+        AA[k] *= alpha;
+    }
+    return *this;
+}
+
+/**
+ * @brief Linear combination alpha A + beta B of two matrices compressed in the
+ * same format, CSR or CSC, with the same shape.
+ *
+ * Sorted rows (columns for CSC) are merged in two parallel phases: the first
+ * counts the elements of each merged row, the second fills them at the
+ * offsets given by the counts. The coordinate map is never used. Elements
+ * cancelling out are kept in the pattern. The result uses the allocator of A.
+ *
+ * @param alpha         coefficient of A
+ * @param A             first Matrix object
+ * @param beta          coefficient of B
+ * @param B             second Matrix object
+ * @return Matrix<T,StorageOrder,Alloc> compressed in the same format
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+Matrix<T,StorageOrder,Alloc> add(T const &alpha, Matrix<T,StorageOrder,Alloc> const &A,
+                                 T const &beta, Matrix<T,StorageOrder,Alloc> const &B)
+{
+    using index_vector = typename Matrix<T,StorageOrder,Alloc>::index_vector;
+    using value_vector = typename Matrix<T,StorageOrder,Alloc>::value_vector;
+
+    Compression comp = A.compression_type();
+    if (!A.is_compressed() or !B.is_compressed() or comp != B.compression_type()
+        or (comp != CSR and comp != CSC))
+    {
+        std::cerr << "addition requires two CSR or two CSC compressed matrices" << std::endl;
+        return Matrix<T,StorageOrder,Alloc>(A.get_allocator());
+    }
+    if (A.nrows() != B.nrows() or A.ncols() != B.ncols())
+    {
+        std::cerr << "sizes are not compatible for addition: (" << A.nrows() << ", " << A.ncols()
+                  << ") + (" << B.nrows() << ", " << B.ncols() << ")" << std::endl;
+        return Matrix<T,StorageOrder,Alloc>(A.get_allocator());
+    }
+
+    // pointers and indices along the major index: rows for CSR, columns for CSC
+    bool row_major = (comp == CSR);
+    std::size_t n = row_major ? A.nrows() : A.ncols();
+    auto const &pa = row_major ? A.ia() : A.ja();
+    auto const &ia = row_major ? A.ja() : A.ia();
+    auto const &pb = row_major ? B.ia() : B.ja();
+    auto const &ib = row_major ? B.ja() : B.ia();
+    auto const &va = A.aa();
+    auto const &vb = B.aa();
+
+    // first phase: size of each merged row
+    index_vector ptr(n+1, 0, A.get_allocator());
+    #pragma omp parallel for schedule(dynamic, 256)
+    for (std::size_t m=0; m<n; ++m)
+    {
+        std::size_t ka = pa[m], kb = pb[m], count = 0;
+        while (ka < pa[m+1] and kb < pb[m+1])
+        {
+            std::size_t a = ia[ka], b = ib[kb];
+            ka += (a <= b);
+            kb += (b <= a);
+            ++count;
+        }
+        ptr[m+1] = count + (pa[m+1]-ka) + (pb[m+1]-kb);
+    }
+
+    for (std::size_t m=0; m<n; ++m)
+        ptr[m+1] += ptr[m];
+
+    // second phase: merge indices and values
+    index_vector ind(ptr[n], 0, A.get_allocator());
+    value_vector val(ptr[n], T(0), A.get_allocator());
+    #pragma omp parallel for schedule(dynamic, 256)
+    for (std::size_t m=0; m<n; ++m)
+    {
+        std::size_t ka = pa[m], kb = pb[m], p = ptr[m];
+        while (ka < pa[m+1] or kb < pb[m+1])
+        {
+            if (kb == pb[m+1] or (ka < pa[m+1] and ia[ka] < ib[kb]))
+            {
+                ind[p] = ia[ka];
+                val[p++] = alpha * va[ka++];
+            }
+            else if (ka == pa[m+1] or ib[kb] < ia[ka])
+            {
+                ind[p] = ib[kb];
+                val[p++] = beta * vb[kb++];
+            }
+            else
+            {
+                ind[p] = ia[ka];
+                val[p++] = alpha * va[ka++] + beta * vb[kb++];
+            }
+        }
+    }
+
+    if (row_major)
+        return Matrix<T,StorageOrder,Alloc>(A.nrows(), A.ncols(), std::move(ptr), std::move(ind), std::move(val), CSR);
+    return Matrix<T,StorageOrder,Alloc>(A.nrows(), A.ncols(), std::move(ind), std::move(ptr), std::move(val), CSC);
+}
+
+/**
+ * @brief Update A = A + alpha B, for matrices compressed in the same format,
+ * CSR or CSC (see add()).
+ *
+ * @param alpha         coefficient of B
+ * @param B             Matrix object
+ * @return Matrix&
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+Matrix<T, StorageOrder, Alloc> & Matrix<T, StorageOrder, Alloc>::axpy(T const &alpha, Matrix const &B)
+{
+    auto res = add(T(1), *this, alpha, B);
+    if (res.is_compressed())
+        *this = std::move(res);
+    return *this;
+}
+
+/**
+ * @brief Sum of two matrices compressed in the same format (see add()).
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+Matrix<T,StorageOrder,Alloc> operator+(Matrix<T,StorageOrder,Alloc> const &A, Matrix<T,StorageOrder,Alloc> const &B)
+{
+    return add(T(1), A, T(1), B);
+}
+
+/**
+ * @brief Difference of two matrices compressed in the same format (see add()).
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+Matrix<T,StorageOrder,Alloc> operator-(Matrix<T,StorageOrder,Alloc> const &A, Matrix<T,StorageOrder,Alloc> const &B)
+{
+    return add(T(1), A, T(-1), B);
+}
+
+/**
+ * @brief Diagonal matrix alpha I of size n, compressed in CSR, e.g. to build
+ * shifted operators A - sigma I.
+ *
+ * @param n             size
+ * @param alpha         diagonal value
+ * @param a             allocator of the matrix
+ * @return Matrix<T,StorageOrder,Alloc>
+ */
+template<typename T, typename StorageOrder, typename Alloc = std::allocator<T>>
+Matrix<T,StorageOrder,Alloc> identity(std::size_t const &n, T const &alpha=T(1), Alloc const &a=Alloc())
+{
+    typename Matrix<T,StorageOrder,Alloc>::index_vector ptr(n+1, 0, a), ind(n, 0, a);
+    typename Matrix<T,StorageOrder,Alloc>::value_vector val(n, alpha, a);
+    for (std::size_t i=0; i<n; ++i)
+    {
+        ptr[i+1] = i+1;
+        ind[i] = i;
+    }
+    return Matrix<T,StorageOrder,Alloc>(n, n, std::move(ptr), std::move(ind), std::move(val), CSR);
+}
+
 } // namespace algebra
 
 #endif
\ No newline at end of file
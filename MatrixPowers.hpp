@@ -0,0 +1,208 @@
+/**
+ * @file
+ *
+ * @brief Matrix powers kernel: x, Ax, A^2 x, ..., A^s x of a CSR matrix with
+ * one pass over the matrix, for s-step Krylov methods and polynomial
+ * preconditioners.
+ *
+ * Rows are split in blocks whose rows fit in cache for all the s levels. For
+ * each block the ghost zone is computed once: the rows outside the block
+ * needed at level p-1 by the rows of level p, back to level 1, minus those
+ * already computed by the previous blocks. The block then computes its s
+ * levels while its part of the matrix is still in cache, so IA, JA and AA are
+ * streamed about once instead of s times on matrices with local couplings
+ * (e.g. banded ones).
+ *
+ * @author Luca Brambilla <luca13.brambilla@mail.polimi.it>
+ */
+
+#include <cstddef>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+#include "Matrix.hpp"
+
+#ifndef MATRIX_POWERS_HPP
+#define MATRIX_POWERS_HPP
+
+namespace algebra{
+
+/**
+ * @brief Schedule of the matrix powers kernel of a compressed CSR matrix. The
+ * matrix must outlive the object and keep its pattern.
+ *
+ * @tparam T                Data type
+ * @tparam StorageOrder     Storage ordering of the Matrix
+ * @tparam Alloc            Allocator of the Matrix
+ */
+template<typename T, typename StorageOrder, typename Alloc = std::allocator<T>>
+class MatrixPowers
+{
+public:
+    MatrixPowers(Matrix<T,StorageOrder,Alloc> const &A, std::size_t const &s, std::size_t const &cache_bytes=1<<18);
+
+    void compute(std::vector<T> const &x, std::vector<std::vector<T>> &basis) const;
+
+    /**
+     * @brief Get number of powers
+     */
+    std::size_t steps() const { return s; };
+
+    /**
+     * @brief Get number of blocks of rows
+     */
+    std::size_t blocks() const { return block_ptr.size() - 1; };
+
+    /**
+     * @brief Get number of rows in the ghost zones, computed ahead of their block
+     */
+    std::size_t ghost_rows() const { return ghost; };
+
+private:
+    Matrix<T,StorageOrder,Alloc> const *mat = nullptr;
+    std::size_t s = 0;
+    std::size_t ghost = 0;
+
+    /// rows of the ghost zones, by block and level: level p of block b in [ghost_ptr[b*s+p-1], ghost_ptr[b*s+p])
+    std::vector<std::size_t> ghosts;
+    std::vector<std::size_t> ghost_ptr{0};
+    /// rows of each block: block b computes rows [block_ptr[b], block_ptr[b+1]) at all levels
+    std::vector<std::size_t> block_ptr{0};
+};
+
+/**
+ * @brief Build the schedule: blocks of rows and their ghost zones. Each block
+ * computes its own rows at all levels, a ghost row is computed by the first
+ * block needing it. Rows computed as ghosts of an earlier block (couplings to
+ * later rows) are computed again by their own block, with the same result.
+ *
+ * @param A             Matrix object, compressed CSR
+ * @param s             number of powers
+ * @param cache_bytes   bytes of the matrix and of the vectors of a block kept in cache
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+MatrixPowers<T,StorageOrder,Alloc>::MatrixPowers(Matrix<T,StorageOrder,Alloc> const &A,
+    std::size_t const &s, std::size_t const &cache_bytes) : s(s)
+{
+    if (!A.is_compressed() or A.compression_type() != CSR)
+    {
+        std::cerr << "matrix powers require a CSR compressed matrix" << std::endl;
+        return;
+    }
+    if (A.nrows() != A.ncols())
+    {
+        std::cerr << "matrix powers require a square matrix" << std::endl;
+        return;
+    }
+    mat = &A;
+
+    auto const &IA = A.ia();
+    auto const &JA = A.ja();
+    std::size_t n = A.nrows();
+    if (n == 0 or s == 0)
+        return;
+
+    // rows per block: matrix rows and vector entries of all levels in cache
+    double row_bytes = static_cast<double>(A.aa().size()) / n * (sizeof(T) + sizeof(std::size_t))
+                     + sizeof(std::size_t) + (s+1) * sizeof(T);
+    std::size_t block_rows = std::max<std::size_t>(cache_bytes / (s * row_bytes), 1);
+
+    // done[p-1][i]: row i of level p already computed by a previous block
+    std::vector<std::vector<bool>> done(s, std::vector<bool>(n, false));
+    std::vector<std::vector<std::size_t>> need(s);
+
+    for (std::size_t first=0; first<n; first+=block_rows)
+    {
+        std::size_t last = std::min(first + block_rows, n);
+        block_ptr.push_back(last);
+
+        // level p-1: rows outside the block needed by its rows and ghosts of level p
+        need[s-1].clear();
+        for (std::size_t p=s-1; p>0; --p)
+        {
+            need[p-1].clear();
+            auto add_columns = [&](std::size_t const &i)
+            {
+                for (std::size_t k=IA[i]; k<IA[i+1]; ++k)
+                {
+                    std::size_t j = JA[k];
+                    if ((j < first or j >= last) and !done[p-1][j])
+                    {
+                        done[p-1][j] = true;
+                        need[p-1].push_back(j);
+                    }
+                }
+            };
+            for (std::size_t i=first; i<last; ++i)
+                add_columns(i);
+            for (auto i : need[p])
+                add_columns(i);
+            std::sort(need[p-1].begin(), need[p-1].end());
+        }
+
+        for (std::size_t p=0; p<s; ++p)
+        {
+            for (std::size_t i=first; i<last; ++i)
+                done[p][i] = true;
+            ghost += need[p].size();
+            ghosts.insert(ghosts.end(), need[p].cbegin(), need[p].cend());
+            ghost_ptr.push_back(ghosts.size());
+        }
+    }
+}
+
+/**
+ * @brief Compute the basis x, Ax, ..., A^s x.
+ *
+ * @param x             Standard vector, size nrows()
+ * @param basis         output, basis[p] = A^p x for p in [0, s]
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+void MatrixPowers<T,StorageOrder,Alloc>::compute(std::vector<T> const &x, std::vector<std::vector<T>> &basis) const
+{
+    ALGEBRA_PERF_SCOPE("MatrixPowers::compute");
+    if (!mat)
+        return;
+    if (x.size() != mat->ncols())
+    {
+        std::cerr << "sizes are not compatible for multiplication: ("
+            << mat->nrows() << ", " << mat->ncols() << ") * (" << x.size() << ", 1)"
+            << std::endl;
+        return;
+    }
+
+    basis.resize(s+1);
+    basis[0] = x;
+    for (std::size_t p=1; p<=s; ++p)
+        basis[p].resize(mat->nrows());
+
+    auto const &IA = mat->ia();
+    auto const &JA = mat->ja();
+    auto const &AA = mat->aa();
+
+    auto row = [&](std::size_t const &i, T const *v, T *res)
+    {
+        T sum = 0;
+        for (std::size_t k=IA[i]; k<IA[i+1]; ++k)
+            sum += AA[k] * v[ JA[k] ];
+        res[i] = sum;
+    };
+
+    for (std::size_t b=0; b<blocks(); ++b)
+    {
+        for (std::size_t p=1; p<=s; ++p)
+        {
+            T const *v = basis[p-1].data();
+            T *res = basis[p].data();
+            for (std::size_t r=ghost_ptr[b*s+p-1]; r<ghost_ptr[b*s+p]; ++r)
+                row(ghosts[r], v, res);
+            for (std::size_t i=block_ptr[b]; i<block_ptr[b+1]; ++i)
+                row(i, v, res);
+        }
+    }
+}
+
+} // namespace algebra
+
+#endif
@@ -0,0 +1,338 @@
+/**
+ * @file
+ *
+ * @brief Non-owning views of a block of rows of a compressed CSR
+ * algebra::Matrix, and gather-based extraction of general submatrices.
+ *
+ * A view only stores a pointer to the parent and a row range: products and
+ * norms run directly on the parent vectors IA, JA and AA.
+ *
+ * @author Luca Brambilla <luca13.brambilla@mail.polimi.it>
+ */
+
+#include <cstddef>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+#include "Matrix.hpp"
+
+#ifndef MATRIX_VIEW_HPP
+#define MATRIX_VIEW_HPP
+
+namespace algebra{
+
+/**
+ * @brief View of the rows [first, last) of a compressed CSR matrix, with all
+ * its columns. The parent must outlive the view and must not be uncompressed
+ * or modified in its pattern while the view is used.
+ *
+ * @tparam T                Data type
+ * @tparam StorageOrder     Storage ordering of the Matrix
+ * @tparam Alloc            Allocator of the Matrix
+ */
+template<typename T, typename StorageOrder, typename Alloc = std::allocator<T>>
+class RowRangeView
+{
+public:
+    RowRangeView(Matrix<T,StorageOrder,Alloc> const &A, std::size_t const &first, std::size_t const &last);
+
+    /**
+     * @brief Get number of rows of the view
+     */
+    std::size_t nrows() const { return row_last - row_first; };
+
+    /**
+     * @brief Get number of columns of the view
+     */
+    std::size_t ncols() const { return mat ? mat->ncols() : 0; };
+
+    /**
+     * @brief Get first row of the parent in the view
+     */
+    std::size_t first_row() const { return row_first; };
+
+    /**
+     * @brief Get number of elements in the view
+     */
+    std::size_t nnz() const { return mat ? mat->ia()[row_last] - mat->ia()[row_first] : 0; };
+
+    /**
+     * @brief Get the parent matrix
+     */
+    Matrix<T,StorageOrder,Alloc> const & parent() const { return *mat; };
+
+    T operator()(std::size_t const &i, std::size_t const &j) const;
+
+    void multiply(std::vector<T> const &v, std::vector<T> &res) const;
+
+    double norm_one() const;
+    double norm_infty() const;
+    double norm_frob() const;
+    double norm(Norm const &n) const;
+
+private:
+    Matrix<T,StorageOrder,Alloc> const *mat = nullptr;
+    std::size_t row_first = 0;
+    std::size_t row_last = 0;
+};
+
+/**
+ * @brief Construct the view of a block of rows. The range is clipped to the
+ * rows of the matrix.
+ *
+ * @param A             Matrix object, compressed CSR
+ * @param first         first row
+ * @param last          row after the last one
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+RowRangeView<T,StorageOrder,Alloc>::RowRangeView(Matrix<T,StorageOrder,Alloc> const &A,
+    std::size_t const &first, std::size_t const &last)
+{
+    if (!A.is_compressed() or A.compression_type() != Compression::CSR)
+    {
+        std::cerr << "row views require a CSR compressed matrix" << std::endl;
+        return;
+    }
+    mat = &A;
+    row_last = std::min(last, A.nrows());
+    row_first = std::min(first, row_last);
+}
+
+/**
+ * @brief Element (i, j) of the view, i relative to the first row.
+ *
+ * @param i             row index in the view
+ * @param j             column index
+ * @return T
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+T RowRangeView<T,StorageOrder,Alloc>::operator()(std::size_t const &i, std::size_t const &j) const
+{
+    if (i >= nrows() or j >= ncols())
+    {
+        std::cerr << "out of bound index" << std::endl;
+        return T(0);
+    }
+    return (*mat)[{row_first + i, j}];
+}
+
+/**
+ * @brief Product of the block of rows with a vector of size ncols().
+ *
+ * @param v             Standard vector, size ncols()
+ * @param res           Output vector, size nrows()
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+void RowRangeView<T,StorageOrder,Alloc>::multiply(std::vector<T> const &v, std::vector<T> &res) const
+{
+    if (res.size() != nrows())
+        res.resize(nrows());
+    if (!mat)
+        return;
+
+    auto const &IA = mat->ia();
+    auto const &JA = mat->ja();
+    auto const &AA = mat->aa();
+
+    #pragma omp parallel for schedule(dynamic, 256)
+    for (std::size_t i=row_first; i<row_last; ++i)
+    {
+        T sum = 0;
+        for (std::size_t k=IA[i]; k<IA[i+1]; ++k)
+            sum += AA[k] * v[ JA[k] ];
+        res[i-row_first] = sum;
+    }
+}
+
+/**
+ * @brief Compute the 1-norm of the view.
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+double RowRangeView<T,StorageOrder,Alloc>::norm_one() const
+{
+    if (!mat)
+        return 0.;
+    auto const &JA = mat->ja();
+    auto const &AA = mat->aa();
+    std::vector<double> sums(ncols(), 0.);
+    for (std::size_t k=mat->ia()[row_first]; k<mat->ia()[row_last]; ++k)
+        sums[ JA[k] ] += std::abs(AA[k]);
+    return sums.empty() ? 0. : *std::max_element(sums.cbegin(), sums.cend());
+}
+
+/**
+ * @brief Compute the infinity norm of the view.
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+double RowRangeView<T,StorageOrder,Alloc>::norm_infty() const
+{
+    if (!mat)
+        return 0.;
+    auto const &IA = mat->ia();
+    auto const &AA = mat->aa();
+    double res = 0.;
+    #pragma omp parallel for reduction(max:res)
+    for (std::size_t i=row_first; i<row_last; ++i)
+    {
+        double sum = 0.;
+        for (std::size_t k=IA[i]; k<IA[i+1]; ++k)
+            sum += std::abs(AA[k]);
+        res = std::max(res, sum);
+    }
+    return res;
+}
+
+/**
+ * @brief Compute the Frobenius norm of the view.
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+double RowRangeView<T,StorageOrder,Alloc>::norm_frob() const
+{
+    if (!mat)
+        return 0.;
+    auto const &AA = mat->aa();
+    double res = 0.;
+    #pragma omp parallel for reduction(+:res)
+    for (std::size_t k=mat->ia()[row_first]; k<mat->ia()[row_last]; ++k)
+        res += std::abs(AA[k]) * std::abs(AA[k]);
+    return std::sqrt(res);
+}
+
+/**
+ * @brief Given an enumerator, return the desired norm of the view.
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+double RowRangeView<T,StorageOrder,Alloc>::norm(Norm const &n) const
+{
+    switch (n)
+    {
+    case Norm::One:
+        return norm_one();
+    case Norm::Infinity:
+        return norm_infty();
+    case Norm::Frobenius:
+        return norm_frob();
+    } // switch(n)
+    return 0.;
+}
+
+/**
+ * @brief Extract the submatrix with the given rows and columns of a compressed
+ * CSR matrix, as a new CSR matrix: element (p, q) is a_{rows[p], cols[q]}.
+ *
+ * Columns are renumbered through a dense lookup table; the selected rows are
+ * gathered in two parallel passes (count, then fill). Rows of the result are
+ * sorted by column also when cols is not sorted. The result uses the
+ * allocator of A.
+ *
+ * @param A             Matrix object, compressed CSR
+ * @param rows          selected rows, in the order of the result
+ * @param cols          selected columns, in the order of the result, no repetitions
+ * @return Matrix<T,StorageOrder,Alloc>
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+Matrix<T,StorageOrder,Alloc> submatrix(Matrix<T,StorageOrder,Alloc> const &A,
+    std::vector<std::size_t> const &rows, std::vector<std::size_t> const &cols)
+{
+    using index_vector = typename Matrix<T,StorageOrder,Alloc>::index_vector;
+    using value_vector = typename Matrix<T,StorageOrder,Alloc>::value_vector;
+
+    if (!A.is_compressed() or A.compression_type() != Compression::CSR)
+    {
+        std::cerr << "submatrix extraction requires a CSR compressed matrix" << std::endl;
+        return Matrix<T,StorageOrder,Alloc>(A.get_allocator());
+    }
+
+    // position of each column in the result, ncol if not selected
+    std::size_t ncol = A.ncols();
+    std::vector<std::size_t> position(ncol, ncol);
+    for (std::size_t q=0; q<cols.size(); ++q)
+    {
+        if (cols[q] >= ncol or position[cols[q]] != ncol)
+        {
+            std::cerr << "submatrix columns out of bounds or repeated" << std::endl;
+            return Matrix<T,StorageOrder,Alloc>(A.get_allocator());
+        }
+        position[cols[q]] = q;
+    }
+    for (auto i : rows)
+    {
+        if (i >= A.nrows())
+        {
+            std::cerr << "submatrix rows out of bounds" << std::endl;
+            return Matrix<T,StorageOrder,Alloc>(A.get_allocator());
+        }
+    }
+    bool sorted = std::is_sorted(cols.cbegin(), cols.cend());
+
+    auto const &IA = A.ia();
+    auto const &JA = A.ja();
+    auto const &AA = A.aa();
+    std::size_t n = rows.size();
+
+    // count selected elements of each row
+    index_vector ptr(n+1, 0, A.get_allocator());
+    #pragma omp parallel for schedule(dynamic, 256)
+    for (std::size_t p=0; p<n; ++p)
+    {
+        std::size_t count = 0;
+        for (std::size_t k=IA[rows[p]]; k<IA[rows[p]+1]; ++k)
+            count += (position[JA[k]] != ncol);
+        ptr[p+1] = count;
+    }
+    for (std::size_t p=0; p<n; ++p)
+        ptr[p+1] += ptr[p];
+
+    // gather
+    index_vector ind(ptr[n], 0, A.get_allocator());
+    value_vector val(ptr[n], T(0), A.get_allocator());
+    #pragma omp parallel for schedule(dynamic, 256)
+    for (std::size_t p=0; p<n; ++p)
+    {
+        std::size_t out = ptr[p];
+        for (std::size_t k=IA[rows[p]]; k<IA[rows[p]+1]; ++k)
+        {
+            std::size_t q = position[JA[k]];
+            if (q != ncol)
+            {
+                ind[out] = q;
+                val[out++] = AA[k];
+            }
+        }
+
+        // renumbered columns are out of order only if cols is not sorted
+        if (!sorted)
+        {
+            std::vector<std::pair<std::size_t, T>> row;
+            for (std::size_t k=ptr[p]; k<ptr[p+1]; ++k)
+                row.emplace_back(ind[k], val[k]);
+            std::sort(row.begin(), row.end(), [](auto const &a, auto const &b) { return a.first < b.first; });
+            for (std::size_t k=ptr[p]; k<ptr[p+1]; ++k)
+            {
+                ind[k] = row[k-ptr[p]].first;
+                val[k] = row[k-ptr[p]].second;
+            }
+        }
+    }
+
+    return Matrix<T,StorageOrder,Alloc>(n, cols.size(), std::move(ptr), std::move(ind), std::move(val), CSR);
+}
+
+/**
+ * @brief Extract the principal submatrix with the given rows and columns.
+ *
+ * @param A             Matrix object, compressed CSR
+ * @param indices       selected rows and columns
+ * @return Matrix<T,StorageOrder,Alloc>
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+Matrix<T,StorageOrder,Alloc> submatrix(Matrix<T,StorageOrder,Alloc> const &A, std::vector<std::size_t> const &indices)
+{
+    return submatrix(A, indices, indices);
+}
+
+} // namespace algebra
+
+#endif
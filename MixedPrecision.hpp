@@ -0,0 +1,291 @@
+/**
+ * @file
+ *
+ * @brief Compressed matrix storing its values in a lower precision and its
+ * indices on 32 bits, with products accumulated in the full precision.
+ *
+ * The matrix-vector product streams the values and the column indices of each
+ * element: with float values and 32-bit indices a double element moves 8 bytes
+ * instead of 16. Values are widened to the compute type inside the kernels.
+ *
+ * @author Luca Brambilla <luca13.brambilla@mail.polimi.it>
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <limits>
+#include <complex>
+#include <cmath>
+
+#include "Matrix.hpp"
+
+#ifndef MIXED_PRECISION_HPP
+#define MIXED_PRECISION_HPP
+
+namespace algebra{
+
+/**
+ * @brief Storage type with half the bytes of T: float for double,
+ * std::complex<float> for std::complex<double>.
+ */
+template<typename T>
+struct lower_precision { typedef T type; };
+
+template<>
+struct lower_precision<double> { typedef float type; };
+
+template<>
+struct lower_precision<std::complex<double>> { typedef std::complex<float> type; };
+
+/**
+ * @brief Error introduced by rounding the values to the storage type.
+ */
+struct PrecisionLoss
+{
+    /// maximum absolute error of an element
+    double max_abs = 0.;
+    /// maximum error of an element relative to its magnitude
+    double max_rel = 0.;
+    /// Frobenius norm of the error relative to the Frobenius norm of the matrix
+    double frob_rel = 0.;
+};
+
+inline std::ostream & operator<<(std::ostream &os, PrecisionLoss const &l)
+{
+    return os << "max abs " << l.max_abs << ", max rel " << l.max_rel << ", frob rel " << l.frob_rel;
+}
+
+/**
+ * @brief CSR or CSC matrix with values stored as S and indices as I, computing
+ * in T.
+ *
+ * @tparam T        Compute type, of the vectors and of the accumulation
+ * @tparam S        Storage type of the values
+ * @tparam I        Index type, unsigned
+ */
+template<typename T, typename S = typename lower_precision<T>::type, typename I = std::uint32_t>
+class MixedPrecisionMatrix
+{
+public:
+    MixedPrecisionMatrix() = default;
+
+    /**
+     * @brief Construct from a compressed matrix, see compress().
+     */
+    template<typename StorageOrder, typename Alloc>
+    explicit MixedPrecisionMatrix(Matrix<T,StorageOrder,Alloc> const &A, double const &tol=1e-6)
+    {
+        compress(A, tol);
+    };
+
+    template<typename StorageOrder, typename Alloc>
+    PrecisionLoss compress(Matrix<T,StorageOrder,Alloc> const &A, double const &tol=1e-6);
+
+    void multiply(std::vector<T> const &v, std::vector<T> &res) const;
+
+    /**
+     * @brief Get number of rows
+     */
+    std::size_t nrows() const { return nrow; };
+
+    /**
+     * @brief Get number of columns
+     */
+    std::size_t ncols() const { return ncol; };
+
+    /**
+     * @brief Get compression type, CSR or CSC
+     */
+    Compression compression_type() const { return compression; };
+
+    /**
+     * @brief Get error of the last compression
+     */
+    PrecisionLoss const & loss() const { return precision_loss; };
+
+    /**
+     * @brief Get bytes of the compressed vectors
+     */
+    std::size_t bytes() const { return IA.size()*sizeof(I) + JA.size()*sizeof(I) + AA.size()*sizeof(S); };
+
+private:
+    std::size_t nrow = 0;
+    std::size_t ncol = 0;
+    Compression compression = CSR;
+    PrecisionLoss precision_loss;
+
+    /// pointers (CSR) or row indices (CSC)
+    std::vector<I> IA;
+    /// column indices (CSR) or pointers (CSC)
+    std::vector<I> JA;
+    std::vector<S> AA;
+};
+
+/**
+ * @brief Copy a CSR or CSC matrix rounding its values to S and its indices to
+ * I. The rounding error is measured and reported on std::cerr if the largest
+ * relative error of an element exceeds tol; indices not fitting in I are an
+ * error and leave the matrix empty.
+ *
+ * @param A             Matrix object, compressed CSR or CSC
+ * @param tol           relative error above which the loss is reported
+ * @return PrecisionLoss
+ */
+template<typename T, typename S, typename I>
+template<typename StorageOrder, typename Alloc>
+PrecisionLoss MixedPrecisionMatrix<T,S,I>::compress(Matrix<T,StorageOrder,Alloc> const &A, double const &tol)
+{
+    IA.clear();
+    JA.clear();
+    AA.clear();
+    nrow = 0;
+    ncol = 0;
+    precision_loss = PrecisionLoss();
+
+    if (!A.is_compressed() or (A.compression_type() != CSR and A.compression_type() != CSC))
+    {
+        std::cerr << "mixed precision requires a CSR or CSC compressed matrix" << std::endl;
+        return precision_loss;
+    }
+
+    constexpr std::size_t max_index = std::numeric_limits<I>::max();
+    if (A.aa().size() > max_index or A.nrows() > max_index or A.ncols() > max_index)
+    {
+        std::cerr << "matrix too large for " << 8*sizeof(I) << "-bit indices" << std::endl;
+        return precision_loss;
+    }
+
+    nrow = A.nrows();
+    ncol = A.ncols();
+    compression = A.compression_type();
+    IA.assign(A.ia().cbegin(), A.ia().cend());
+    JA.assign(A.ja().cbegin(), A.ja().cend());
+
+    auto const &values = A.aa();
+    std::size_t n = values.size();
+    AA.resize(n);
+
+    double max_abs = 0., max_rel = 0., err2 = 0., norm2 = 0.;
+    #pragma omp parallel for reduction(max:max_abs,max_rel) reduction(+:err2,norm2)
+    for (std::size_t k=0; k<n; ++k)
+    {
+        AA[k] = static_cast<S>(values[k]);
+        double a = std::abs(values[k]);
+        double e = std::abs(values[k] - static_cast<T>(AA[k]));
+        max_abs = std::max(max_abs, e);
+        if (a > 0.)
+            max_rel = std::max(max_rel, e / a);
+        err2 += e * e;
+        norm2 += a * a;
+    }
+    precision_loss.max_abs = max_abs;
+    precision_loss.max_rel = max_rel;
+    precision_loss.frob_rel = (norm2 > 0.) ? std::sqrt(err2 / norm2) : 0.;
+
+    if (precision_loss.max_rel > tol)
+        std::cerr << "mixed precision compression: " << precision_loss << std::endl;
+
+    return precision_loss;
+}
+
+/**
+ * @brief Matrix-vector product: values are widened to T and accumulated in T.
+ * Real rows are reduced with SIMD.
+ *
+ * @param v             Standard vector, size ncols()
+ * @param res           Output vector, size nrows()
+ */
+template<typename T, typename S, typename I>
+void MixedPrecisionMatrix<T,S,I>::multiply(std::vector<T> const &v, std::vector<T> &res) const
+{
+    ALGEBRA_PERF_SCOPE("MixedPrecisionMatrix::multiply");
+    if (res.size() != nrow)
+        res.resize(nrow);
+
+    if (AA.empty())
+    {
+        std::fill(res.begin(), res.end(), T(0));
+        return;
+    }
+
+    S const *values = AA.data();
+    T const *x = v.data();
+
+    switch (compression) {
+
+    case Compression::CSR:
+    {
+        I const *ptr = IA.data();
+        I const *col = JA.data();
+
+        #pragma omp parallel for schedule(dynamic, 256)
+        for (std::size_t i=0; i<nrow; ++i)
+        {
+            T sum = 0;
+            if constexpr (is_complex<T>::value)
+            {
+                for (std::size_t k=ptr[i]; k<ptr[i+1]; ++k)
+                    sum += static_cast<T>(values[k]) * x[ col[k] ];
+            }
+            else
+            {
+                #pragma omp simd reduction(+:sum)
+                for (std::size_t k=ptr[i]; k<ptr[i+1]; ++k)
+                    sum += static_cast<T>(values[k]) * x[ col[k] ];
+            }
+            res[i] = sum;
+        }
+        break;
+    }
+
+    case Compression::CSC:
+    {
+        I const *row = IA.data();
+        I const *ptr = JA.data();
+
+        std::fill(res.begin(), res.end(), T(0));
+        for (std::size_t j=0; j<ncol; ++j)
+        {
+            T xj = x[j];
+            for (std::size_t k=ptr[j]; k<ptr[j+1]; ++k)
+                res[ row[k] ] += static_cast<T>(values[k]) * xj;
+        }
+        break;
+    }
+
+    default:
+        std::cerr << "mixed precision product not available" << std::endl;
+        break;
+
+    } // switch(compression)
+}
+
+/**
+ * @brief Matrix-vector product.
+ *
+ * @param m             MixedPrecisionMatrix object
+ * @param v             Standard vector
+ * @return std::vector<T>
+ */
+template<typename T, typename S, typename I>
+std::vector<T> operator*(MixedPrecisionMatrix<T,S,I> const &m, std::vector<T> const &v)
+{
+    if (m.ncols() != v.size())
+    {
+        std::cerr << "sizes are not compatible for multiplication: ("
+            << m.nrows() << ", " << m.ncols() << ") * (" << v.size() << ", 1)"
+            << std::endl;
+        return std::vector<T>();
+    }
+
+    std::vector<T> res(m.nrows());
+    m.multiply(v, res);
+    return res;
+}
+
+} // namespace algebra
+
+#endif
@@ -0,0 +1,289 @@
+/**
+ * @file
+ *
+ * @brief Opt-in hardware performance counters around the hot kernels.
+ *
+ * Compiled with ALGEBRA_PERF_COUNTERS defined, each scoped region reads
+ * cycles, instructions, last level cache misses and data TLB misses of the
+ * calling thread with perf_event_open (Linux), and accumulates them by region
+ * name. Without the macro regions are empty and compile away to nothing.
+ *
+ * @author Luca Brambilla <luca13.brambilla@mail.polimi.it>
+ */
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <map>
+
+#ifdef ALGEBRA_PERF_COUNTERS
+#include <mutex>
+#include <chrono>
+#include <cstring>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#ifndef PERF_COUNTERS_HPP
+#define PERF_COUNTERS_HPP
+
+#define ALGEBRA_PERF_CONCAT_(a, b) a##b
+#define ALGEBRA_PERF_CONCAT(a, b) ALGEBRA_PERF_CONCAT_(a, b)
+
+#ifdef ALGEBRA_PERF_COUNTERS
+/// Open a region named name until the end of the enclosing scope
+#define ALGEBRA_PERF_SCOPE(name) \
+    algebra::perf::ScopedRegion ALGEBRA_PERF_CONCAT(perf_region_, __LINE__)(name)
+#else
+#define ALGEBRA_PERF_SCOPE(name) ((void)0)
+#endif
+
+namespace algebra{
+namespace perf{
+
+/// Enumerator for the hardware events
+enum Event {Cycles, Instructions, LLC_misses, DTLB_misses};
+/// number of hardware events
+constexpr int n_events = 4;
+
+/**
+ * @brief Values of the counters over an interval.
+ */
+struct Counts
+{
+    /// hardware events, indexed by Event (0 if not available)
+    std::uint64_t events[n_events] = {0, 0, 0, 0};
+    /// wall time in nanoseconds
+    std::uint64_t nanoseconds = 0;
+
+    Counts & operator+=(Counts const &c)
+    {
+        for (int e=0; e<n_events; ++e)
+            events[e] += c.events[e];
+        nanoseconds += c.nanoseconds;
+        return *this;
+    };
+};
+
+/**
+ * @brief Statistics of a region: number of calls, last call and total.
+ */
+struct RegionStats
+{
+    std::uint64_t calls = 0;
+    Counts last;
+    Counts total;
+};
+
+#ifdef ALGEBRA_PERF_COUNTERS
+
+/**
+ * @brief Group of counters of the calling thread, opened at the first use.
+ * Counters are never reset: regions take differences, so they can be nested.
+ */
+class ThreadCounters
+{
+public:
+    ThreadCounters()
+    {
+        std::uint64_t config[n_events] = {
+            PERF_COUNT_HW_CPU_CYCLES,
+            PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+            PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+        };
+        std::uint32_t type[n_events] = {PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+                                        PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE};
+
+        for (int e=0; e<n_events; ++e)
+        {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = type[e];
+            attr.config = config[e];
+            attr.disabled = (e == 0);
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID;
+            // current thread, any cpu, first event leads the group
+            fd[e] = syscall(__NR_perf_event_open, &attr, 0, -1, (e == 0) ? -1 : fd[0], 0);
+            if (fd[e] >= 0)
+                ioctl(fd[e], PERF_EVENT_IOC_ID, &id[e]);
+            else if (e == 0)
+            {
+                std::cerr << "perf_event_open not available, only wall time is measured" << std::endl;
+                return;
+            }
+        }
+        ioctl(fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    };
+
+    ~ThreadCounters()
+    {
+        for (int e=n_events; e-- > 0; )
+        {
+            if (fd[e] >= 0)
+                close(fd[e]);
+        }
+    };
+
+    /**
+     * @brief Current values of the counters and of the wall clock.
+     */
+    Counts read() const
+    {
+        Counts c;
+        c.nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        if (fd[0] < 0)
+            return c;
+
+        // {nr, {value, id} x nr}
+        std::uint64_t buffer[1 + 2*n_events];
+        if (::read(fd[0], buffer, sizeof(buffer)) <= 0)
+            return c;
+        for (std::uint64_t k=0; k<buffer[0]; ++k)
+        {
+            for (int e=0; e<n_events; ++e)
+            {
+                if (fd[e] >= 0 and id[e] == buffer[2+2*k])
+                    c.events[e] = buffer[1+2*k];
+            }
+        }
+        return c;
+    };
+
+private:
+    int fd[n_events] = {-1, -1, -1, -1};
+    std::uint64_t id[n_events] = {0, 0, 0, 0};
+};
+
+/**
+ * @brief Counters of the calling thread.
+ */
+inline ThreadCounters const & thread_counters()
+{
+    thread_local ThreadCounters counters;
+    return counters;
+}
+
+/**
+ * @brief Statistics of all regions, with the mutex protecting them.
+ */
+inline std::map<std::string, RegionStats> & registry()
+{
+    static std::map<std::string, RegionStats> regions;
+    return regions;
+}
+
+inline std::mutex & registry_mutex()
+{
+    static std::mutex m;
+    return m;
+}
+
+/**
+ * @brief Region measured from construction to destruction, accumulated in the
+ * registry under its name.
+ */
+class ScopedRegion
+{
+public:
+    explicit ScopedRegion(char const *n) : name(n), start(thread_counters().read()) {};
+
+    ScopedRegion(ScopedRegion const &) = delete;
+    ScopedRegion & operator=(ScopedRegion const &) = delete;
+
+    /**
+     * @brief Counts since the start of the region
+     */
+    Counts counts() const
+    {
+        Counts c = thread_counters().read();
+        for (int e=0; e<n_events; ++e)
+            c.events[e] -= start.events[e];
+        c.nanoseconds -= start.nanoseconds;
+        return c;
+    };
+
+    ~ScopedRegion()
+    {
+        Counts c = counts();
+        std::lock_guard<std::mutex> lock(registry_mutex());
+        auto &stats = registry()[name];
+        ++stats.calls;
+        stats.last = c;
+        stats.total += c;
+    };
+
+private:
+    char const *name;
+    Counts start;
+};
+
+/**
+ * @brief Get the statistics of all regions
+ */
+inline std::map<std::string, RegionStats> regions()
+{
+    std::lock_guard<std::mutex> lock(registry_mutex());
+    return registry();
+}
+
+/**
+ * @brief Clear the statistics of all regions
+ */
+inline void reset()
+{
+    std::lock_guard<std::mutex> lock(registry_mutex());
+    registry().clear();
+}
+
+#else
+
+/**
+ * @brief Empty region, performance counters are disabled.
+ */
+class ScopedRegion
+{
+public:
+    explicit ScopedRegion(char const *) {};
+    Counts counts() const { return Counts(); };
+};
+
+inline std::map<std::string, RegionStats> regions() { return {}; }
+inline void reset() {}
+
+#endif
+
+/**
+ * @brief Print the statistics of all regions: calls, totals and averages per
+ * call, instructions per cycle.
+ *
+ * @param os            output stream
+ */
+inline void report(std::ostream &os)
+{
+#ifndef ALGEBRA_PERF_COUNTERS
+    os << "performance counters disabled, compile with -D ALGEBRA_PERF_COUNTERS" << std::endl;
+#endif
+    for (auto const &[name, s] : regions())
+    {
+        auto const &t = s.total;
+        double calls = static_cast<double>(s.calls);
+        os << name << ": " << s.calls << " calls, " << t.nanoseconds / calls * 1e-3 << " us/call, "
+           << t.events[Cycles] / calls << " cycles/call, "
+           << t.events[Instructions] / calls << " instructions/call, IPC "
+           << (t.events[Cycles] ? static_cast<double>(t.events[Instructions]) / t.events[Cycles] : 0.)
+           << ", LLC misses/call " << t.events[LLC_misses] / calls
+           << ", dTLB misses/call " << t.events[DTLB_misses] / calls << std::endl;
+    }
+}
+
+} // namespace perf
+} // namespace algebra
+
+#endif
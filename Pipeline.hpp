@@ -0,0 +1,240 @@
+/**
+ * @file
+ *
+ * @brief Pipelined processing of many matrix market files: reading, parsing
+ * and compression, and computation overlap on different threads.
+ *
+ * A reader thread loads whole files in memory, parser threads build and
+ * compress the matrices, and the calling thread runs the computation on each
+ * compressed matrix. Stages are connected by bounded queues: a fast stage
+ * blocks when its output queue is full, so at most a few files are in memory
+ * and the throughput is the one of the slowest stage (disk or CPU).
+ *
+ * @author Luca Brambilla <luca13.brambilla@mail.polimi.it>
+ */
+
+#include <cstddef>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <filesystem>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <atomic>
+
+#include "Matrix.hpp"
+
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+namespace algebra{
+
+/**
+ * @brief Queue of limited capacity between two stages: push() blocks while
+ * the queue is full, pop() while it is empty and not closed.
+ *
+ * @tparam E        Element type
+ */
+template<typename E>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(std::size_t const &capacity) : capacity(std::max<std::size_t>(capacity, 1)) {};
+
+    /**
+     * @brief Add an element, waiting for space.
+     *
+     * @param e         element added
+     * @return false if the queue is closed: the element is dropped
+     */
+    bool push(E e)
+    {
+        std::unique_lock<std::mutex> lock(m);
+        not_full.wait(lock, [&]{ return items.size() < capacity or closed; });
+        if (closed)
+            return false;
+        items.push_back(std::move(e));
+        not_empty.notify_one();
+        return true;
+    };
+
+    /**
+     * @brief Remove the first element, waiting for one.
+     *
+     * @param e         element removed
+     * @return false if the queue is closed and empty
+     */
+    bool pop(E &e)
+    {
+        std::unique_lock<std::mutex> lock(m);
+        not_empty.wait(lock, [&]{ return !items.empty() or closed; });
+        if (items.empty())
+            return false;
+        e = std::move(items.front());
+        items.pop_front();
+        not_full.notify_one();
+        return true;
+    };
+
+    /**
+     * @brief No more elements will be pushed: wake up all waiting threads.
+     */
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(m);
+        closed = true;
+        not_empty.notify_all();
+        not_full.notify_all();
+    };
+
+private:
+    std::size_t capacity;
+    bool closed = false;
+    std::deque<E> items;
+    std::mutex m;
+    std::condition_variable not_full;
+    std::condition_variable not_empty;
+};
+
+/**
+ * @brief Options of the pipeline.
+ */
+struct PipelineOptions
+{
+    /// storage ordering of the matrices
+    Order order = Row_major;
+    /// compression format and block size (BSR)
+    Compression compression = CSR;
+    std::size_t block = 4;
+    /// files read ahead of the parsers, and matrices compressed ahead of the computation
+    std::size_t capacity = 2;
+    /// number of parser threads
+    std::size_t parsers = 1;
+};
+
+/**
+ * @brief Paths of the matrix market files (.mtx) in a directory, sorted.
+ *
+ * @param dir           directory
+ * @return std::vector<std::string>
+ */
+inline std::vector<std::string> mtx_files(std::string const &dir)
+{
+    std::vector<std::string> files;
+    std::error_code ec;
+    for (auto const &entry : std::filesystem::directory_iterator(dir, ec))
+    {
+        if (entry.is_regular_file() and entry.path().extension() == ".mtx")
+            files.push_back(entry.path().string());
+    }
+    if (ec)
+        std::cerr << "cannot list " << dir << ": " << ec.message() << std::endl;
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+/**
+ * @brief Load, compress and process a list of files in a pipeline: file n+2
+ * is read while file n+1 is parsed and compressed and compute runs on file n.
+ *
+ * compute(index, name, M) is called on the calling thread, with index the
+ * position of the file in the list, in file order with one parser and in
+ * order of completion with more. Files that cannot be opened are reported
+ * and skipped.
+ *
+ * @param files         paths of the files
+ * @param compute       compute(std::size_t, std::string const &, Matrix<T,StorageOrder> &)
+ * @param opt           options of the pipeline
+ * @return number of files processed
+ */
+template<typename T, typename StorageOrder = Order, typename F>
+std::size_t pipeline(std::vector<std::string> const &files, F compute, PipelineOptions const &opt = PipelineOptions())
+{
+    struct Text
+    {
+        std::size_t index = 0;
+        std::string content;
+    };
+    struct Compressed
+    {
+        std::size_t index = 0;
+        Matrix<T,StorageOrder> matrix;
+    };
+
+    BoundedQueue<Text> texts(opt.capacity);
+    BoundedQueue<Compressed> matrices(opt.capacity);
+
+    // closes the queues and joins the stages also if compute throws
+    struct Stages
+    {
+        BoundedQueue<Text> &texts;
+        BoundedQueue<Compressed> &matrices;
+        std::vector<std::thread> threads;
+        ~Stages()
+        {
+            texts.close();
+            matrices.close();
+            for (auto &t : threads)
+                t.join();
+        };
+    } stages{texts, matrices, {}};
+
+    // read: whole files in memory, until the end or a closed queue (compute threw)
+    stages.threads.emplace_back([&]
+    {
+        for (std::size_t n=0; n<files.size(); ++n)
+        {
+            std::ifstream file(files[n], std::ios::binary);
+            if (!file)
+            {
+                std::cerr << "Error opening file " << files[n] << std::endl;
+                continue;
+            }
+            std::ostringstream content;
+            content << file.rdbuf();
+            if (!texts.push({n, std::move(content).str()}))
+                break;
+        }
+        texts.close();
+    });
+
+    // parse and compress
+    std::size_t np = std::max<std::size_t>(opt.parsers, 1);
+    std::atomic<std::size_t> running{np};
+    for (std::size_t p=0; p<np; ++p)
+    {
+        stages.threads.emplace_back([&]
+        {
+            Text text;
+            while (texts.pop(text))
+            {
+                std::istringstream in(std::move(text.content));
+                Matrix<T,StorageOrder> M(in, opt.order);
+                M.compress(opt.compression, opt.block);
+                if (!matrices.push({text.index, std::move(M)}))
+                    break;
+            }
+            if (running.fetch_sub(1) == 1)
+                matrices.close();
+        });
+    }
+
+    // compute
+    std::size_t processed = 0;
+    Compressed c;
+    while (matrices.pop(c))
+    {
+        compute(c.index, files[c.index], c.matrix);
+        ++processed;
+    }
+    return processed;
+}
+
+} // namespace algebra
+
+#endif
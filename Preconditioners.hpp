@@ -0,0 +1,641 @@
+/**
+ * @file
+ *
+ * @brief Preconditioners working directly on the compressed CSR representation
+ * of algebra::Matrix: Jacobi, block Jacobi, ILU(0) and multicolor symmetric
+ * Gauss-Seidel.
+ *
+ * Setup and apply phases are parallelized with OpenMP. All preconditioners
+ * provide apply(r, z), computing z = M^{-1} r, and can be passed to the
+ * solvers in Solvers.hpp.
+ *
+ * @author Luca Brambilla <luca13.brambilla@mail.polimi.it>
+ */
+
+#include <cstddef>
+#include <vector>
+#include <iostream>
+#include <cmath>
+#include <complex>
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <atomic>
+
+#include "Matrix.hpp"
+#include "TriangularSolve.hpp"
+
+#ifndef PRECONDITIONERS_HPP
+#define PRECONDITIONERS_HPP
+
+namespace algebra{
+
+/**
+ * @brief Check that a matrix is square and compressed in CSR format, as
+ * needed by the preconditioners.
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+bool check_csr(Matrix<T,StorageOrder,Alloc> const &A)
+{
+    if (!A.is_compressed() or A.compression_type() != Compression::CSR)
+    {
+        std::cerr << "preconditioner requires a CSR compressed matrix" << std::endl;
+        return false;
+    }
+    if (A.nrows() != A.ncols())
+    {
+        std::cerr << "preconditioner requires a square matrix" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Position in AA (and JA) of the diagonal element of each row, or
+ * JA.size() if the diagonal element is not stored.
+ *
+ * @param A             Matrix object, compressed CSR
+ * @param diag          output vector of positions, size nrow
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+void diagonal_positions(Matrix<T,StorageOrder,Alloc> const &A, std::vector<std::size_t> &diag)
+{
+    auto const &IA = A.ia();
+    auto const &JA = A.ja();
+    std::size_t n = A.nrows();
+    diag.resize(n);
+
+    #pragma omp parallel for
+    for (std::size_t i=0; i<n; ++i)
+    {
+        // columns of each row are sorted
+        auto first = JA.cbegin() + IA[i];
+        auto last = JA.cbegin() + IA[i+1];
+        auto it = std::lower_bound(first, last, i);
+        diag[i] = (it != last and *it == i) ? it - JA.cbegin() : JA.size();
+    }
+}
+
+
+/**
+ * @brief Jacobi (diagonal) preconditioner.
+ *
+ * Rows without a stored (or with a zero) diagonal element are not scaled.
+ */
+template<typename T, typename StorageOrder, typename Alloc = std::allocator<T>>
+class Jacobi
+{
+public:
+    Jacobi(Matrix<T,StorageOrder,Alloc> const &A) { setup(A); };
+
+    void setup(Matrix<T,StorageOrder,Alloc> const &A);
+    void apply(std::vector<T> const &r, std::vector<T> &z) const;
+
+private:
+    /// inverse of the diagonal
+    std::vector<T> inv_diag;
+};
+
+/**
+ * @brief Extract and invert the diagonal of the matrix.
+ *
+ * @param A             Matrix object, compressed CSR
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+void Jacobi<T,StorageOrder,Alloc>::setup(Matrix<T,StorageOrder,Alloc> const &A)
+{
+    if (!check_csr(A))
+        return;
+
+    std::vector<std::size_t> diag;
+    diagonal_positions(A, diag);
+
+    auto const &AA = A.aa();
+    std::size_t n = A.nrows();
+    inv_diag.resize(n);
+    std::size_t missing = 0;
+
+    #pragma omp parallel for reduction(+:missing)
+    for (std::size_t i=0; i<n; ++i)
+    {
+        if (diag[i] == AA.size() or std::abs(AA[diag[i]]) == 0.)
+        {
+            inv_diag[i] = 1.;
+            ++missing;
+        }
+        else
+        {
+            inv_diag[i] = T(1.) / AA[diag[i]];
+        }
+    }
+
+    if (missing)
+    {
+        std::cerr << "Jacobi: " << missing << " rows with zero diagonal are not scaled" << std::endl;
+    }
+}
+
+/**
+ * @brief Apply the preconditioner: z = D^{-1} r.
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+void Jacobi<T,StorageOrder,Alloc>::apply(std::vector<T> const &r, std::vector<T> &z) const
+{
+    std::size_t n = inv_diag.size();
+    z.resize(n);
+
+    #pragma omp parallel for
+    for (std::size_t i=0; i<n; ++i)
+    {
+        z[i] = inv_diag[i] * r[i];
+    }
+}
+
+
+/**
+ * @brief Block Jacobi preconditioner with dense diagonal blocks of fixed size
+ * (the last block can be smaller).
+ *
+ * The inverse of each block is computed explicitly during setup, so that
+ * the apply phase is a set of independent small dense products.
+ */
+template<typename T, typename StorageOrder, typename Alloc = std::allocator<T>>
+class BlockJacobi
+{
+public:
+    BlockJacobi(Matrix<T,StorageOrder,Alloc> const &A, std::size_t const &bs=4) :
+        block_size(std::max<std::size_t>(bs, 1)) { setup(A); };
+
+    void setup(Matrix<T,StorageOrder,Alloc> const &A);
+    void apply(std::vector<T> const &r, std::vector<T> &z) const;
+
+private:
+    /// size of the diagonal blocks
+    std::size_t block_size;
+    /// number of rows
+    std::size_t n = 0;
+    /// inverse of the blocks, row-major, block_size*block_size each
+    std::vector<T> inv_blocks;
+};
+
+/**
+ * @brief Extract and invert the diagonal blocks with Gauss-Jordan elimination
+ * and partial pivoting. Singular blocks are replaced by the identity.
+ *
+ * @param A             Matrix object, compressed CSR
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+void BlockJacobi<T,StorageOrder,Alloc>::setup(Matrix<T,StorageOrder,Alloc> const &A)
+{
+    if (!check_csr(A))
+        return;
+
+    auto const &IA = A.ia();
+    auto const &JA = A.ja();
+    auto const &AA = A.aa();
+    n = A.nrows();
+    std::size_t bs = block_size;
+    std::size_t nblocks = (n + bs - 1) / bs;
+    inv_blocks.assign(nblocks*bs*bs, T(0));
+    std::size_t singular = 0;
+
+    #pragma omp parallel reduction(+:singular)
+    {
+        // work block, local to each thread
+        std::vector<T> work(bs*bs);
+
+        #pragma omp for
+        for (std::size_t b=0; b<nblocks; ++b)
+        {
+            std::size_t first = b*bs;
+            std::size_t sz = std::min(bs, n-first);
+            T *inv = &inv_blocks[b*bs*bs];
+
+            // extract the block and initialize the inverse to the identity
+            std::fill(work.begin(), work.end(), T(0));
+            for (std::size_t i=0; i<sz; ++i)
+            {
+                inv[i*bs+i] = 1.;
+                auto it = std::lower_bound(JA.cbegin()+IA[first+i], JA.cbegin()+IA[first+i+1], first);
+                for (std::size_t k=it-JA.cbegin(); k<IA[first+i+1] and JA[k]<first+sz; ++k)
+                {
+                    work[i*bs + JA[k]-first] = AA[k];
+                }
+            }
+
+            // Gauss-Jordan elimination with partial pivoting
+            bool ok = true;
+            for (std::size_t c=0; c<sz and ok; ++c)
+            {
+                std::size_t piv = c;
+                for (std::size_t i=c+1; i<sz; ++i)
+                {
+                    if (std::abs(work[i*bs+c]) > std::abs(work[piv*bs+c]))
+                        piv = i;
+                }
+                if (std::abs(work[piv*bs+c]) == 0.)
+                {
+                    ok = false;
+                    break;
+                }
+                if (piv != c)
+                {
+                    for (std::size_t j=0; j<sz; ++j)
+                    {
+                        std::swap(work[c*bs+j], work[piv*bs+j]);
+                        std::swap(inv[c*bs+j], inv[piv*bs+j]);
+                    }
+                }
+                T p = T(1.) / work[c*bs+c];
+                for (std::size_t j=0; j<sz; ++j)
+                {
+                    work[c*bs+j] *= p;
+                    inv[c*bs+j] *= p;
+                }
+                for (std::size_t i=0; i<sz; ++i)
+                {
+                    if (i == c)
+                        continue;
+                    T f = work[i*bs+c];
+                    for (std::size_t j=0; j<sz; ++j)
+                    {
+                        work[i*bs+j] -= f * work[c*bs+j];
+                        inv[i*bs+j] -= f * inv[c*bs+j];
+                    }
+                }
+            }
+
+            if (!ok)
+            {
+                ++singular;
+                std::fill(inv, inv+bs*bs, T(0));
+                for (std::size_t i=0; i<sz; ++i)
+                    inv[i*bs+i] = 1.;
+            }
+        }
+    }
+
+    if (singular)
+    {
+        std::cerr << "BlockJacobi: " << singular << " singular blocks replaced by identity" << std::endl;
+    }
+}
+
+/**
+ * @brief Apply the preconditioner: z = D_B^{-1} r, one dense product per block.
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+void BlockJacobi<T,StorageOrder,Alloc>::apply(std::vector<T> const &r, std::vector<T> &z) const
+{
+    std::size_t bs = block_size;
+    std::size_t nblocks = (n + bs - 1) / bs;
+    z.resize(n);
+
+    #pragma omp parallel for
+    for (std::size_t b=0; b<nblocks; ++b)
+    {
+        std::size_t first = b*bs;
+        std::size_t sz = std::min(bs, n-first);
+        T const *inv = &inv_blocks[b*bs*bs];
+        for (std::size_t i=0; i<sz; ++i)
+        {
+            T sum = 0;
+            for (std::size_t j=0; j<sz; ++j)
+            {
+                sum += inv[i*bs+j] * r[first+j];
+            }
+            z[first+i] = sum;
+        }
+    }
+}
+
+
+/**
+ * @brief Incomplete LU factorization with zero fill-in, ILU(0).
+ *
+ * The factors L (unit lower) and U share the sparsity pattern of the matrix:
+ * only a copy of the values AA is stored, while the index vectors IA and JA
+ * are used directly from the Matrix, which must outlive the preconditioner.
+ *
+ * Factorization and triangular solves follow the dependency levels of the
+ * level-scheduled SparseTriangularSolver: rows of the same level are
+ * processed in parallel.
+ */
+template<typename T, typename StorageOrder, typename Alloc = std::allocator<T>>
+class ILU0
+{
+public:
+    ILU0(Matrix<T,StorageOrder,Alloc> const &A, TriangularSchedule const &s=Level_scheduled) :
+        schedule(s) { setup(A); };
+
+    void setup(Matrix<T,StorageOrder,Alloc> const &A);
+    void apply(std::vector<T> const &r, std::vector<T> &z) const;
+
+private:
+    /// scheduling of the triangular solves
+    TriangularSchedule schedule;
+    /// factorized matrix, pattern of IA and JA
+    Matrix<T,StorageOrder,Alloc> const *mat = nullptr;
+    /// values of L (strictly lower part) and U (upper part)
+    std::vector<T> LU;
+    /// triangular solvers for L and U
+    SparseTriangularSolver<T,StorageOrder,Alloc> lower, upper;
+};
+
+/**
+ * @brief Compute the ILU(0) factorization (IKJ variant), level by level.
+ *
+ * @param A             Matrix object, compressed CSR with all diagonal elements stored
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+void ILU0<T,StorageOrder,Alloc>::setup(Matrix<T,StorageOrder,Alloc> const &A)
+{
+    mat = nullptr;
+    if (!check_csr(A))
+        return;
+
+    auto const &IA = A.ia();
+    auto const &JA = A.ja();
+    std::size_t n = A.nrows();
+
+    lower.analyse(A, Lower, true, schedule);
+    auto const &diag = lower.diagonal();
+    if (std::find(diag.cbegin(), diag.cend(), JA.size()) != diag.cend())
+    {
+        std::cerr << "ILU0: missing diagonal elements, factorization not computed" << std::endl;
+        return;
+    }
+    upper.analyse(A, Upper, false, schedule);
+
+    LU.assign(A.aa().cbegin(), A.aa().cend());
+    auto const &level_ptr = lower.levels();
+    auto const &level_rows = lower.rows();
+    std::size_t zero_pivots = 0;
+
+    #pragma omp parallel reduction(+:zero_pivots)
+    {
+        // position in LU of each column of the current row, local to each thread
+        std::vector<std::size_t> pos(n, JA.size());
+
+        for (std::size_t l=0; l+1<level_ptr.size(); ++l)
+        {
+            #pragma omp for
+            for (std::size_t p=level_ptr[l]; p<level_ptr[l+1]; ++p)
+            {
+                std::size_t i = level_rows[p];
+                for (std::size_t k=IA[i]; k<IA[i+1]; ++k)
+                    pos[JA[k]] = k;
+
+                // eliminate with the previous rows k<i
+                for (std::size_t q=IA[i]; q<diag[i]; ++q)
+                {
+                    std::size_t k = JA[q];
+                    T pivot = LU[diag[k]];
+                    if (std::abs(pivot) == 0.)
+                    {
+                        ++zero_pivots;
+                        continue;
+                    }
+                    LU[q] /= pivot;
+                    for (std::size_t s=diag[k]+1; s<IA[k+1]; ++s)
+                    {
+                        if (pos[JA[s]] != JA.size())
+                            LU[ pos[JA[s]] ] -= LU[q] * LU[s];
+                    }
+                }
+
+                for (std::size_t k=IA[i]; k<IA[i+1]; ++k)
+                    pos[JA[k]] = JA.size();
+            }
+            // implicit barrier: next level starts when this one is complete
+        }
+    }
+
+    if (zero_pivots)
+    {
+        std::cerr << "ILU0: " << zero_pivots << " zero pivots encountered" << std::endl;
+    }
+
+    mat = &A;
+}
+
+/**
+ * @brief Apply the preconditioner: z = U^{-1} L^{-1} r, with parallel forward
+ * and backward substitution.
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+void ILU0<T,StorageOrder,Alloc>::apply(std::vector<T> const &r, std::vector<T> &z) const
+{
+    if (!mat)
+    {
+        z = r;
+        return;
+    }
+
+    lower.solve(LU, r, z);
+    upper.solve(LU, z, z);
+}
+
+
+/**
+ * @brief Multicolor symmetric Gauss-Seidel preconditioner.
+ *
+ * Rows are colored so that rows of the same color are not coupled, in either
+ * direction, by the matrix. A forward sweep over the colors followed by a
+ * backward sweep, starting from z = 0, is applied; rows of each color are
+ * updated in parallel.
+ */
+template<typename T, typename StorageOrder, typename Alloc = std::allocator<T>>
+class MulticolorGaussSeidel
+{
+public:
+    MulticolorGaussSeidel(Matrix<T,StorageOrder,Alloc> const &A) { setup(A); };
+
+    void setup(Matrix<T,StorageOrder,Alloc> const &A);
+    void apply(std::vector<T> const &r, std::vector<T> &z) const;
+
+    /**
+     * @brief Get number of colors
+     */
+    std::size_t ncolors() const { return color_ptr.empty() ? 0 : color_ptr.size()-1; };
+
+private:
+    /// matrix, must outlive the preconditioner
+    Matrix<T,StorageOrder,Alloc> const *mat = nullptr;
+    /// inverse of the diagonal
+    std::vector<T> inv_diag;
+    /// rows sorted by color, and pointers to each color
+    std::vector<std::size_t> color_rows, color_ptr;
+};
+
+/**
+ * @brief Color the graph of A + A^T with a parallel speculative greedy
+ * algorithm: rows are colored concurrently, conflicts between adjacent rows
+ * are then detected and recolored until none is left.
+ *
+ * @param A             Matrix object, compressed CSR
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+void MulticolorGaussSeidel<T,StorageOrder,Alloc>::setup(Matrix<T,StorageOrder,Alloc> const &A)
+{
+    if (!check_csr(A))
+        return;
+
+    mat = &A;
+    auto const &IA = A.ia();
+    auto const &JA = A.ja();
+    auto const &AA = A.aa();
+    std::size_t n = A.nrows();
+
+    // inverse diagonal
+    std::vector<std::size_t> diag;
+    diagonal_positions(A, diag);
+    inv_diag.resize(n);
+    #pragma omp parallel for
+    for (std::size_t i=0; i<n; ++i)
+    {
+        bool zero = (diag[i] == AA.size() or std::abs(AA[diag[i]]) == 0.);
+        inv_diag[i] = zero ? T(0) : T(1.) / AA[diag[i]];
+    }
+
+    // adjacency of A + A^T: the transpose pattern is built with a counting sort
+    std::vector<std::size_t> TP(n+1, 0), TJ(JA.size());
+    for (std::size_t k=0; k<JA.size(); ++k)
+        ++TP[JA[k]+1];
+    for (std::size_t j=0; j<n; ++j)
+        TP[j+1] += TP[j];
+    {
+        std::vector<std::size_t> next(TP.cbegin(), TP.cend()-1);
+        for (std::size_t i=0; i<n; ++i)
+            for (std::size_t k=IA[i]; k<IA[i+1]; ++k)
+                TJ[ next[JA[k]]++ ] = i;
+    }
+
+    constexpr std::size_t none = std::numeric_limits<std::size_t>::max();
+    std::vector<std::size_t> color(n, none);
+    std::vector<std::size_t> work(n), conflicts;
+    std::iota(work.begin(), work.end(), 0);
+
+    while (!work.empty())
+    {
+        // tentative coloring: smallest color not used by the neighbours. Colors
+        // of neighbours are read while other threads write them: accesses are
+        // relaxed atomics, stale values are caught by the conflict pass
+        #pragma omp parallel
+        {
+            std::vector<char> used;
+
+            #pragma omp for
+            for (std::size_t w=0; w<work.size(); ++w)
+            {
+                std::size_t i = work[w];
+                used.assign(used.size(), 0);
+                auto mark = [&](std::size_t j)
+                {
+                    std::size_t c = std::atomic_ref<std::size_t>(color[j]).load(std::memory_order_relaxed);
+                    if (j == i or c == none)
+                        return;
+                    if (c >= used.size())
+                        used.resize(c+1, 0);
+                    used[c] = 1;
+                };
+                for (std::size_t k=IA[i]; k<IA[i+1]; ++k)
+                    mark(JA[k]);
+                for (std::size_t k=TP[i]; k<TP[i+1]; ++k)
+                    mark(TJ[k]);
+
+                std::size_t c = 0;
+                while (c < used.size() and used[c])
+                    ++c;
+                std::atomic_ref<std::size_t>(color[i]).store(c, std::memory_order_relaxed);
+            }
+        }
+
+        // detect conflicts: the row with larger index is recolored
+        conflicts.clear();
+        #pragma omp parallel
+        {
+            std::vector<std::size_t> local;
+
+            #pragma omp for nowait
+            for (std::size_t w=0; w<work.size(); ++w)
+            {
+                std::size_t i = work[w];
+                bool conflict = false;
+                for (std::size_t k=IA[i]; k<IA[i+1] and !conflict; ++k)
+                    conflict = (JA[k] < i and color[JA[k]] == color[i]);
+                for (std::size_t k=TP[i]; k<TP[i+1] and !conflict; ++k)
+                    conflict = (TJ[k] < i and color[TJ[k]] == color[i]);
+                if (conflict)
+                    local.push_back(i);
+            }
+
+            #pragma omp critical
+            conflicts.insert(conflicts.end(), local.cbegin(), local.cend());
+        }
+        for (auto i : conflicts)
+            color[i] = none;
+        std::sort(conflicts.begin(), conflicts.end());
+        work.swap(conflicts);
+    }
+
+    // sort rows by color
+    std::size_t nc = n ? *std::max_element(color.cbegin(), color.cend()) + 1 : 0;
+    color_ptr.assign(nc+1, 0);
+    for (std::size_t i=0; i<n; ++i)
+        ++color_ptr[color[i]+1];
+    for (std::size_t c=0; c<nc; ++c)
+        color_ptr[c+1] += color_ptr[c];
+    color_rows.resize(n);
+    std::vector<std::size_t> next(color_ptr.cbegin(), color_ptr.cend()-1);
+    for (std::size_t i=0; i<n; ++i)
+        color_rows[ next[color[i]]++ ] = i;
+}
+
+/**
+ * @brief Apply one symmetric sweep starting from z = 0.
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+void MulticolorGaussSeidel<T,StorageOrder,Alloc>::apply(std::vector<T> const &r, std::vector<T> &z) const
+{
+    if (!mat)
+    {
+        z = r;
+        return;
+    }
+
+    auto const &IA = mat->ia();
+    auto const &JA = mat->ja();
+    auto const &AA = mat->aa();
+    std::size_t nc = ncolors();
+    z.assign(r.size(), T(0));
+
+    // update all rows of a color
+    auto sweep = [&](std::size_t c)
+    {
+        #pragma omp for
+        for (std::size_t p=color_ptr[c]; p<color_ptr[c+1]; ++p)
+        {
+            std::size_t i = color_rows[p];
+            T sum = r[i];
+            for (std::size_t k=IA[i]; k<IA[i+1]; ++k)
+            {
+                if (JA[k] != i)
+                    sum -= AA[k] * z[JA[k]];
+            }
+            z[i] = inv_diag[i] * sum;
+        }
+    };
+
+    #pragma omp parallel
+    {
+        for (std::size_t c=0; c<nc; ++c)
+            sweep(c);
+        for (std::size_t c=nc; c-- > 0; )
+            sweep(c);
+    }
+}
+
+} // namespace algebra
+
+#endif
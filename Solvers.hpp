@@ -0,0 +1,678 @@
+/**
+ * @file
+ *
+ * @brief Iterative solvers for sparse linear systems built on algebra::Matrix:
+ * Conjugate Gradient, BiCGSTAB and restarted GMRES.
+ *
+ * The inner loops use fused kernels (matrix-vector product with dot product,
+ * axpy with norm) to reduce the number of passes over memory. All the work
+ * vectors are allocated once at the beginning of solve(), never inside the
+ * iterations.
+ *
+ * @author Luca Brambilla <luca13.brambilla@mail.polimi.it>
+ */
+
+#include <cstddef>
+#include <vector>
+#include <utility>
+#include <iostream>
+#include <cmath>
+#include <complex>
+
+#include "Matrix.hpp"
+
+#ifndef SOLVERS_HPP
+#define SOLVERS_HPP
+
+namespace algebra{
+
+/// Parameters of the iterative solvers
+struct SolverParameters
+{
+    /// maximum number of iterations
+    std::size_t max_iter = 1000;
+    /// tolerance on the relative residual ||r|| / ||b||
+    double tol = 1e-8;
+    /// dimension of the Krylov subspace before restart (GMRES only)
+    std::size_t restart = 30;
+};
+
+/// Outcome of an iterative solver
+struct SolverResult
+{
+    /// true if the tolerance has been reached
+    bool converged = false;
+    /// number of iterations performed
+    std::size_t iterations = 0;
+    /// final relative residual
+    double residual = 0.;
+};
+
+/**
+ * @brief Identity preconditioner, default when no preconditioner is given.
+ *
+ * Any preconditioner passed to the solvers must provide the same method
+ * apply(r, z) computing z = M^{-1} r.
+ */
+template<typename T>
+struct IdentityPreconditioner
+{
+    void apply(std::vector<T> const &r, std::vector<T> &z) const { z = r; };
+};
+
+// ---------------------------------------------------------------------------
+// fused kernels
+// ---------------------------------------------------------------------------
+
+/**
+ * @brief Dot product conj(x)^T y.
+ */
+template<typename T>
+T dot(std::vector<T> const &x, std::vector<T> const &y)
+{
+    T res = 0;
+    for (std::size_t i=0; i<x.size(); ++i)
+    {
+        res += conjugate(x[i]) * y[i];
+    }
+    return res;
+}
+
+/**
+ * @brief Squared euclidean norm of a vector.
+ */
+template<typename T>
+double norm2_squared(std::vector<T> const &x)
+{
+    double res = 0.;
+    for (std::size_t i=0; i<x.size(); ++i)
+    {
+        res += std::norm(x[i]);
+    }
+    return res;
+}
+
+/**
+ * @brief Fused matrix-vector product and dot product: y = A x, returns conj(w)^T y.
+ *
+ * For a CSR matrix the dot product is accumulated row by row while y is
+ * written, so y is never read back. Other formats fall back to two passes.
+ *
+ * @param A             Matrix object
+ * @param x             input vector
+ * @param y             output vector, y = A x
+ * @param w             vector for the dot product
+ * @return T
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+T spmv_dot(Matrix<T,StorageOrder,Alloc> const &A, std::vector<T> const &x,
+           std::vector<T> &y, std::vector<T> const &w)
+{
+    if (!A.is_compressed() or A.compression_type() != Compression::CSR)
+    {
+        A.multiply(x, y);
+        return dot(w, y);
+    }
+
+    auto const &IA = A.ia();
+    auto const &JA = A.ja();
+    auto const &AA = A.aa();
+
+    T res = 0;
+    for (std::size_t i=0; i<A.nrows(); ++i)
+    {
+        T sum = 0;
+        for (std::size_t k=IA[i]; k<IA[i+1]; ++k)
+        {
+            sum += AA[k] * x[ JA[k] ];
+        }
+        y[i] = sum;
+        res += conjugate(w[i]) * sum;
+    }
+    return res;
+}
+
+/**
+ * @brief Fused matrix-vector product, dot product and norm: y = A x, returns
+ * the pair ( conj(w)^T y, ||y||^2 ).
+ *
+ * @param A             Matrix object
+ * @param x             input vector
+ * @param y             output vector, y = A x
+ * @param w             vector for the dot product
+ * @return std::pair<T,double>
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+std::pair<T,double> spmv_dot_norm(Matrix<T,StorageOrder,Alloc> const &A, std::vector<T> const &x,
+                                  std::vector<T> &y, std::vector<T> const &w)
+{
+    if (!A.is_compressed() or A.compression_type() != Compression::CSR)
+    {
+        A.multiply(x, y);
+        return {dot(w, y), norm2_squared(y)};
+    }
+
+    auto const &IA = A.ia();
+    auto const &JA = A.ja();
+    auto const &AA = A.aa();
+
+    T res = 0;
+    double nrm = 0.;
+    for (std::size_t i=0; i<A.nrows(); ++i)
+    {
+        T sum = 0;
+        for (std::size_t k=IA[i]; k<IA[i+1]; ++k)
+        {
+            sum += AA[k] * x[ JA[k] ];
+        }
+        y[i] = sum;
+        res += conjugate(w[i]) * sum;
+        nrm += std::norm(sum);
+    }
+    return {res, nrm};
+}
+
+/**
+ * @brief Fused axpy and norm: y = y + a x, returns ||y||^2.
+ */
+template<typename T>
+double axpy_norm(T const &a, std::vector<T> const &x, std::vector<T> &y)
+{
+    double res = 0.;
+    for (std::size_t i=0; i<y.size(); ++i)
+    {
+        y[i] += a * x[i];
+        res += std::norm(y[i]);
+    }
+    return res;
+}
+
+/**
+ * @brief Fused axpy and dot product: y = y + a x, returns conj(z)^T y.
+ *
+ * Used by modified Gram-Schmidt to subtract a projection and compute the
+ * next one in the same pass.
+ */
+template<typename T>
+T axpy_dot(T const &a, std::vector<T> const &x, std::vector<T> &y, std::vector<T> const &z)
+{
+    T res = 0;
+    for (std::size_t i=0; i<y.size(); ++i)
+    {
+        y[i] += a * x[i];
+        res += conjugate(z[i]) * y[i];
+    }
+    return res;
+}
+
+/**
+ * @brief Fused waxpy, dot product and norm: w = y + a x, returns the pair
+ * ( conj(z)^T w, ||w||^2 ).
+ */
+template<typename T>
+std::pair<T,double> waxpy_dot_norm(T const &a, std::vector<T> const &x, std::vector<T> const &y,
+                                   std::vector<T> &w, std::vector<T> const &z)
+{
+    T res = 0;
+    double nrm = 0.;
+    for (std::size_t i=0; i<y.size(); ++i)
+    {
+        w[i] = y[i] + a * x[i];
+        res += conjugate(z[i]) * w[i];
+        nrm += std::norm(w[i]);
+    }
+    return {res, nrm};
+}
+
+/**
+ * @brief Residual r = b - A x, returns ||r||^2.
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+double residual_norm(Matrix<T,StorageOrder,Alloc> const &A, std::vector<T> const &b,
+                     std::vector<T> const &x, std::vector<T> &r)
+{
+    A.multiply(x, r);
+    double res = 0.;
+    for (std::size_t i=0; i<r.size(); ++i)
+    {
+        r[i] = b[i] - r[i];
+        res += std::norm(r[i]);
+    }
+    return res;
+}
+
+/**
+ * @brief Check that matrix and vectors have compatible sizes for a solve.
+ * The initial guess x is resized (and set to zero) if needed.
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+bool check_system(Matrix<T,StorageOrder,Alloc> const &A, std::vector<T> const &b, std::vector<T> &x)
+{
+    if (A.nrows() != A.ncols() or b.size() != A.nrows())
+    {
+        std::cerr << "sizes are not compatible for solve: ("
+            << A.nrows() << ", " << A.ncols() << ") x = (" << b.size() << ", 1)"
+            << std::endl;
+        return false;
+    }
+    if (x.size() != b.size())
+    {
+        x.assign(b.size(), T(0));
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// solvers
+// ---------------------------------------------------------------------------
+
+/**
+ * @brief Preconditioned Conjugate Gradient for symmetric (hermitian) positive
+ * definite matrices.
+ *
+ * @tparam T                Data type
+ * @tparam StorageOrder     Storage ordering of the Matrix
+ * @tparam Alloc            Allocator of the Matrix
+ */
+template<typename T, typename StorageOrder, typename Alloc = std::allocator<T>>
+class ConjugateGradient
+{
+public:
+    ConjugateGradient(SolverParameters const &p = SolverParameters()) : param(p) {};
+
+    template<typename Preconditioner = IdentityPreconditioner<T>>
+    SolverResult solve(Matrix<T,StorageOrder,Alloc> const &A, std::vector<T> const &b,
+                       std::vector<T> &x, Preconditioner const &M = Preconditioner());
+
+private:
+    /// solver parameters
+    SolverParameters param;
+    /// work vectors: residual, preconditioned residual, direction, A*direction
+    std::vector<T> r, z, p, q;
+};
+
+/**
+ * @brief Solve A x = b. The content of x is used as initial guess.
+ *
+ * @param A             Matrix object, compressed CSR for the fused kernels
+ * @param b             right hand side
+ * @param x             initial guess and solution
+ * @param M             preconditioner
+ * @return SolverResult
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+template<typename Preconditioner>
+SolverResult ConjugateGradient<T,StorageOrder,Alloc>::solve(Matrix<T,StorageOrder,Alloc> const &A,
+    std::vector<T> const &b, std::vector<T> &x, Preconditioner const &M)
+{
+    SolverResult res;
+    if (!check_system(A, b, x))
+        return res;
+
+    std::size_t n = b.size();
+    r.resize(n);
+    z.resize(n);
+    p.resize(n);
+    q.resize(n);
+
+    double b_norm = std::sqrt(norm2_squared(b));
+    if (b_norm == 0.)
+        b_norm = 1.;
+
+    double rr = residual_norm(A, b, x, r);
+    res.residual = std::sqrt(rr) / b_norm;
+    if (res.residual <= param.tol)
+    {
+        res.converged = true;
+        return res;
+    }
+
+    M.apply(r, z);
+    p = z;
+    T rz = dot(r, z);
+
+    for (std::size_t it=1; it<=param.max_iter; ++it)
+    {
+        // q = A p, <p, A p>
+        T pq = spmv_dot(A, p, q, p);
+        T alpha = rz / pq;
+
+        // fused update of solution and residual
+        rr = 0.;
+        for (std::size_t i=0; i<n; ++i)
+        {
+            x[i] += alpha * p[i];
+            r[i] -= alpha * q[i];
+            rr += std::norm(r[i]);
+        }
+
+        res.iterations = it;
+        res.residual = std::sqrt(rr) / b_norm;
+        if (res.residual <= param.tol)
+        {
+            res.converged = true;
+            break;
+        }
+
+        M.apply(r, z);
+        T rz_new = dot(r, z);
+        T beta = rz_new / rz;
+        rz = rz_new;
+
+        for (std::size_t i=0; i<n; ++i)
+        {
+            p[i] = z[i] + beta * p[i];
+        }
+    }
+
+    return res;
+}
+
+
+/**
+ * @brief Right-preconditioned BiCGSTAB for general matrices.
+ *
+ * @tparam T                Data type
+ * @tparam StorageOrder     Storage ordering of the Matrix
+ * @tparam Alloc            Allocator of the Matrix
+ */
+template<typename T, typename StorageOrder, typename Alloc = std::allocator<T>>
+class BiCGSTAB
+{
+public:
+    BiCGSTAB(SolverParameters const &p = SolverParameters()) : param(p) {};
+
+    template<typename Preconditioner = IdentityPreconditioner<T>>
+    SolverResult solve(Matrix<T,StorageOrder,Alloc> const &A, std::vector<T> const &b,
+                       std::vector<T> &x, Preconditioner const &M = Preconditioner());
+
+private:
+    /// solver parameters
+    SolverParameters param;
+    /// work vectors
+    std::vector<T> r, r_hat, p, p_hat, v, s, s_hat, t;
+};
+
+/**
+ * @brief Solve A x = b. The content of x is used as initial guess.
+ *
+ * @param A             Matrix object, compressed CSR for the fused kernels
+ * @param b             right hand side
+ * @param x             initial guess and solution
+ * @param M             preconditioner
+ * @return SolverResult
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+template<typename Preconditioner>
+SolverResult BiCGSTAB<T,StorageOrder,Alloc>::solve(Matrix<T,StorageOrder,Alloc> const &A,
+    std::vector<T> const &b, std::vector<T> &x, Preconditioner const &M)
+{
+    SolverResult res;
+    if (!check_system(A, b, x))
+        return res;
+
+    std::size_t n = b.size();
+    r.resize(n);
+    p.assign(n, T(0));
+    p_hat.resize(n);
+    v.assign(n, T(0));
+    s.resize(n);
+    s_hat.resize(n);
+    t.resize(n);
+
+    double b_norm = std::sqrt(norm2_squared(b));
+    if (b_norm == 0.)
+        b_norm = 1.;
+
+    double rr = residual_norm(A, b, x, r);
+    res.residual = std::sqrt(rr) / b_norm;
+    if (res.residual <= param.tol)
+    {
+        res.converged = true;
+        return res;
+    }
+    r_hat = r;
+
+    T rho = 1.;
+    T alpha = 1.;
+    T omega = 1.;
+    T rho_new = rr;
+
+    for (std::size_t it=1; it<=param.max_iter; ++it)
+    {
+        res.iterations = it;
+
+        if (std::abs(rho_new) == 0.)
+        {
+            std::cerr << "BiCGSTAB breakdown: rho = 0" << std::endl;
+            break;
+        }
+
+        T beta = (rho_new / rho) * (alpha / omega);
+        rho = rho_new;
+        for (std::size_t i=0; i<n; ++i)
+        {
+            p[i] = r[i] + beta * (p[i] - omega * v[i]);
+        }
+
+        // v = A M^{-1} p, <r_hat, v>
+        M.apply(p, p_hat);
+        alpha = rho / spmv_dot(A, p_hat, v, r_hat);
+
+        // s = r - alpha v
+        double ss = waxpy_dot_norm(-alpha, v, r, s, r_hat).second;
+        if (std::sqrt(ss) / b_norm <= param.tol)
+        {
+            axpy_norm(alpha, p_hat, x);
+            res.residual = std::sqrt(ss) / b_norm;
+            res.converged = true;
+            break;
+        }
+
+        // t = A M^{-1} s, <s, t>, <t, t>
+        M.apply(s, s_hat);
+        auto [st, tt] = spmv_dot_norm(A, s_hat, t, s);
+        omega = conjugate(st) / tt;
+
+        for (std::size_t i=0; i<n; ++i)
+        {
+            x[i] += alpha * p_hat[i] + omega * s_hat[i];
+        }
+
+        // r = s - omega t, <r_hat, r>, ||r||^2
+        std::tie(rho_new, rr) = waxpy_dot_norm(-omega, t, s, r, r_hat);
+
+        res.residual = std::sqrt(rr) / b_norm;
+        if (res.residual <= param.tol)
+        {
+            res.converged = true;
+            break;
+        }
+
+        if (std::abs(omega) == 0.)
+        {
+            std::cerr << "BiCGSTAB breakdown: omega = 0" << std::endl;
+            break;
+        }
+    }
+
+    return res;
+}
+
+
+/**
+ * @brief Right-preconditioned restarted GMRES(m) for general matrices.
+ *
+ * The Arnoldi basis is orthogonalized with modified Gram-Schmidt and the
+ * least squares problem is solved with Givens rotations.
+ *
+ * @tparam T                Data type
+ * @tparam StorageOrder     Storage ordering of the Matrix
+ * @tparam Alloc            Allocator of the Matrix
+ */
+template<typename T, typename StorageOrder, typename Alloc = std::allocator<T>>
+class GMRES
+{
+public:
+    GMRES(SolverParameters const &p = SolverParameters()) : param(p) {};
+
+    template<typename Preconditioner = IdentityPreconditioner<T>>
+    SolverResult solve(Matrix<T,StorageOrder,Alloc> const &A, std::vector<T> const &b,
+                       std::vector<T> &x, Preconditioner const &M = Preconditioner());
+
+private:
+    /// solver parameters
+    SolverParameters param;
+    /// Krylov basis, restart+1 vectors
+    std::vector<std::vector<T>> V;
+    /// Hessenberg matrix, stored by columns: H[j*(m+1) + i]
+    std::vector<T> H;
+    /// Givens rotations: cosines (real) and sines
+    std::vector<double> cs;
+    std::vector<T> sn;
+    /// right hand side of the least squares problem, and its solution
+    std::vector<T> g, y;
+    /// work vectors
+    std::vector<T> w, z;
+};
+
+/**
+ * @brief Solve A x = b. The content of x is used as initial guess.
+ *
+ * @param A             Matrix object, compressed CSR for the fused kernels
+ * @param b             right hand side
+ * @param x             initial guess and solution
+ * @param M             preconditioner
+ * @return SolverResult
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+template<typename Preconditioner>
+SolverResult GMRES<T,StorageOrder,Alloc>::solve(Matrix<T,StorageOrder,Alloc> const &A,
+    std::vector<T> const &b, std::vector<T> &x, Preconditioner const &M)
+{
+    SolverResult res;
+    if (!check_system(A, b, x))
+        return res;
+
+    std::size_t n = b.size();
+    std::size_t m = std::max<std::size_t>(param.restart, 1);
+    V.resize(m+1);
+    for (auto &vi : V)
+        vi.resize(n);
+    H.assign((m+1)*m, T(0));
+    cs.resize(m);
+    sn.resize(m);
+    g.resize(m+1);
+    y.resize(m);
+    w.resize(n);
+    z.resize(n);
+
+    double b_norm = std::sqrt(norm2_squared(b));
+    if (b_norm == 0.)
+        b_norm = 1.;
+
+    while (res.iterations < param.max_iter)
+    {
+        // V_0 = r / ||r||
+        double beta = std::sqrt(residual_norm(A, b, x, V[0]));
+        res.residual = beta / b_norm;
+        if (res.residual <= param.tol)
+        {
+            res.converged = true;
+            break;
+        }
+        for (std::size_t i=0; i<n; ++i)
+            V[0][i] /= beta;
+
+        std::fill(g.begin(), g.end(), T(0));
+        g[0] = beta;
+
+        std::size_t k = 0;
+        while (k<m and res.iterations<param.max_iter)
+        {
+            T *h = &H[k*(m+1)];
+
+            // w = A M^{-1} V_k, first projection
+            M.apply(V[k], z);
+            h[0] = spmv_dot(A, z, w, V[0]);
+
+            // modified Gram-Schmidt: subtract projection and compute the next
+            for (std::size_t i=0; i<k; ++i)
+            {
+                h[i+1] = axpy_dot(-h[i], V[i], w, V[i+1]);
+            }
+            double ww = axpy_norm(-h[k], V[k], w);
+            h[k+1] = std::sqrt(ww);
+
+            if (std::abs(h[k+1]) > 0.)
+            {
+                T inv = T(1.) / h[k+1];
+                for (std::size_t i=0; i<n; ++i)
+                    V[k+1][i] = w[i] * inv;
+            }
+
+            // apply previous rotations to the new column
+            for (std::size_t i=0; i<k; ++i)
+            {
+                T tmp = cs[i] * h[i] + sn[i] * h[i+1];
+                h[i+1] = -conjugate(sn[i]) * h[i] + cs[i] * h[i+1];
+                h[i] = tmp;
+            }
+
+            // new rotation eliminating h[k+1]
+            double a_abs = std::abs(h[k]);
+            double den = std::sqrt(a_abs*a_abs + std::norm(h[k+1]));
+            if (a_abs == 0.)
+            {
+                cs[k] = 0.;
+                sn[k] = 1.;
+                h[k] = h[k+1];
+            }
+            else
+            {
+                T phase = h[k] / a_abs;
+                cs[k] = a_abs / den;
+                sn[k] = phase * conjugate(h[k+1]) / den;
+                h[k] = phase * den;
+            }
+            h[k+1] = 0.;
+
+            g[k+1] = -conjugate(sn[k]) * g[k];
+            g[k] = cs[k] * g[k];
+
+            ++k;
+            ++res.iterations;
+            res.residual = std::abs(g[k]) / b_norm;
+            if (res.residual <= param.tol or ww == 0.)
+                break;
+        }
+
+        // solve the upper triangular system H y = g
+        for (std::size_t i=k; i-- > 0; )
+        {
+            T sum = g[i];
+            for (std::size_t j=i+1; j<k; ++j)
+                sum -= H[j*(m+1)+i] * y[j];
+            y[i] = sum / H[i*(m+1)+i];
+        }
+
+        // x = x + M^{-1} V y
+        std::fill(w.begin(), w.end(), T(0));
+        for (std::size_t j=0; j<k; ++j)
+            axpy_norm(y[j], V[j], w);
+        M.apply(w, z);
+        axpy_norm(T(1.), z, x);
+
+        if (res.residual <= param.tol)
+        {
+            res.converged = true;
+            break;
+        }
+    }
+
+    return res;
+}
+
+} // namespace algebra
+
+#endif
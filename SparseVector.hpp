@@ -0,0 +1,236 @@
+/**
+ * @file
+ *
+ * @brief Sparse vectors and sparse matrix - sparse vector product.
+ *
+ * The product visits only the columns of a CSC matrix matching the elements
+ * of the vector, and merges them with a heap: the work depends on the number
+ * of elements touched, not on the number of rows.
+ *
+ * @author Luca Brambilla <luca13.brambilla@mail.polimi.it>
+ */
+
+#include <cstddef>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <queue>
+#include <utility>
+#include <functional>
+#include <cmath>
+
+#include "Matrix.hpp"
+
+#ifndef SPARSE_VECTOR_HPP
+#define SPARSE_VECTOR_HPP
+
+namespace algebra{
+
+/**
+ * @brief Sparse vector: indices sorted in increasing order and their values.
+ *
+ * @tparam T        Data type
+ */
+template<typename T>
+class SparseVector
+{
+public:
+    SparseVector() = default;
+
+    /**
+     * @brief Construct an empty vector of given size.
+     *
+     * @param n         size
+     */
+    explicit SparseVector(std::size_t const &n) : n(n) {};
+
+    explicit SparseVector(std::vector<T> const &v);
+
+    /**
+     * @brief Construct from the indices, sorted in increasing order, and the
+     * values of the elements.
+     *
+     * @param n         size
+     * @param i         indices
+     * @param v         values
+     */
+    SparseVector(std::size_t const &n, std::vector<std::size_t> i, std::vector<T> v) :
+        n(n), ind(std::move(i)), val(std::move(v)) {};
+
+    /**
+     * @brief Append element (i, v), i larger than the indices already present.
+     */
+    void push_back(std::size_t const &i, T const &v)
+    {
+        if (i >= n or (!ind.empty() and i <= ind.back()))
+        {
+            std::cerr << "sparse vector index " << i << " out of bounds or not increasing" << std::endl;
+            return;
+        }
+        ind.push_back(i);
+        val.push_back(v);
+    };
+
+    /**
+     * @brief Get size of the vector
+     */
+    std::size_t size() const { return n; };
+
+    /**
+     * @brief Get number of elements stored
+     */
+    std::size_t nnz() const { return ind.size(); };
+
+    /**
+     * @brief Get indices of the elements
+     */
+    std::vector<std::size_t> const & indices() const { return ind; };
+
+    /**
+     * @brief Get values of the elements
+     */
+    std::vector<T> const & values() const { return val; };
+
+    std::vector<T> dense() const;
+
+    void clear();
+
+private:
+    std::size_t n = 0;
+    std::vector<std::size_t> ind;
+    std::vector<T> val;
+};
+
+/**
+ * @brief Construct from a dense vector, keeping the values above ZERO_TOL.
+ *
+ * @param v             Standard vector
+ */
+template<typename T>
+SparseVector<T>::SparseVector(std::vector<T> const &v) : n(v.size())
+{
+    for (std::size_t i=0; i<n; ++i)
+    {
+        if (std::abs(v[i]) > ZERO_TOL)
+        {
+            ind.push_back(i);
+            val.push_back(v[i]);
+        }
+    }
+}
+
+/**
+ * @brief Dense copy of the vector.
+ *
+ * @return std::vector<T>
+ */
+template<typename T>
+std::vector<T> SparseVector<T>::dense() const
+{
+    std::vector<T> res(n, T(0));
+    for (std::size_t k=0; k<ind.size(); ++k)
+        res[ ind[k] ] = val[k];
+    return res;
+}
+
+/**
+ * @brief Remove all elements, keeping the size.
+ */
+template<typename T>
+void SparseVector<T>::clear()
+{
+    ind.clear();
+    val.clear();
+}
+
+/**
+ * @brief Product of a CSC matrix with a sparse vector, as a sparse vector.
+ *
+ * Only the columns j of the elements x_j are visited. Their rows are sorted,
+ * so the columns are merged by row with a heap holding the next element of
+ * each column: elements of the same row are summed as they leave the heap.
+ * The cost is O(f log k), f elements visited and k elements of x.
+ *
+ * @param A             Matrix object, compressed CSC
+ * @param x             sparse vector, size A.ncols()
+ * @param res           sparse result, size A.nrows()
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+void multiply(Matrix<T,StorageOrder,Alloc> const &A, SparseVector<T> const &x, SparseVector<T> &res)
+{
+    ALGEBRA_PERF_SCOPE("multiply(SparseVector)");
+    res = SparseVector<T>(A.nrows());
+
+    if (!A.is_compressed() or A.compression_type() != CSC)
+    {
+        std::cerr << "sparse vector product requires a CSC compressed matrix" << std::endl;
+        return;
+    }
+    if (x.size() != A.ncols())
+    {
+        std::cerr << "sizes are not compatible for multiplication: ("
+            << A.nrows() << ", " << A.ncols() << ") * (" << x.size() << ", 1)"
+            << std::endl;
+        return;
+    }
+
+    // CSC: IA holds the rows, JA the column pointers
+    auto const &IA = A.ia();
+    auto const &JA = A.ja();
+    auto const &AA = A.aa();
+    auto const &xi = x.indices();
+    auto const &xv = x.values();
+
+    // (row, position in AA) of the next element of each column, plus its element of x
+    typedef std::pair<std::size_t, std::size_t> head;
+    std::vector<std::size_t> column_end(xi.size());
+    std::priority_queue<std::pair<head, std::size_t>, std::vector<std::pair<head, std::size_t>>,
+                        std::greater<std::pair<head, std::size_t>>> heap;
+    for (std::size_t e=0; e<xi.size(); ++e)
+    {
+        std::size_t k = JA[ xi[e] ];
+        column_end[e] = JA[ xi[e]+1 ];
+        if (k < column_end[e])
+            heap.push({{IA[k], k}, e});
+    }
+
+    std::vector<std::size_t> ind;
+    std::vector<T> val;
+    while (!heap.empty())
+    {
+        auto [h, e] = heap.top();
+        heap.pop();
+        auto [i, k] = h;
+
+        if (!ind.empty() and ind.back() == i)
+            val.back() += AA[k] * xv[e];
+        else
+        {
+            ind.push_back(i);
+            val.push_back(AA[k] * xv[e]);
+        }
+
+        if (++k < column_end[e])
+            heap.push({{IA[k], k}, e});
+    }
+    res = SparseVector<T>(A.nrows(), std::move(ind), std::move(val));
+}
+
+/**
+ * @brief Product of a CSC matrix with a sparse vector.
+ *
+ * @param A             Matrix object, compressed CSC
+ * @param x             sparse vector
+ * @return SparseVector<T>
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+SparseVector<T> operator*(Matrix<T,StorageOrder,Alloc> const &A, SparseVector<T> const &x)
+{
+    SparseVector<T> res;
+    multiply(A, x, res);
+    return res;
+}
+
+} // namespace algebra
+
+#endif
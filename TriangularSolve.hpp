@@ -0,0 +1,337 @@
+/**
+ * @file
+ *
+ * @brief Parallel sparse triangular solve (SpTRSV) on the lower or upper part
+ * of a compressed CSR algebra::Matrix.
+ *
+ * A one-time analysis groups the rows into dependency levels, then each
+ * level is solved in parallel. A synchronization-free variant is also
+ * available, where each row waits only for the rows it depends on.
+ *
+ * @author Luca Brambilla <luca13.brambilla@mail.polimi.it>
+ */
+
+#include <cstddef>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "Matrix.hpp"
+
+#ifndef TRIANGULAR_SOLVE_HPP
+#define TRIANGULAR_SOLVE_HPP
+
+namespace algebra{
+
+/// Enumerator for the triangular part of a matrix
+enum Triangle {Lower, Upper};
+/// Enumerator for the scheduling of the triangular solve
+enum TriangularSchedule {Level_scheduled, Sync_free};
+
+/**
+ * @brief Sparse triangular solver for the lower or upper part of a CSR matrix.
+ *
+ * Entries of the other triangle are ignored, so the factors of an incomplete
+ * LU stored in a single matrix can be solved directly. The values can also
+ * be passed separately, as long as they share the pattern of IA and JA.
+ * The Matrix must outlive the solver.
+ *
+ * @tparam T                Data type
+ * @tparam StorageOrder     Storage ordering of the Matrix
+ * @tparam Alloc            Allocator of the Matrix
+ */
+template<typename T, typename StorageOrder, typename Alloc = std::allocator<T>>
+class SparseTriangularSolver
+{
+public:
+    SparseTriangularSolver() = default;
+
+    SparseTriangularSolver(Matrix<T,StorageOrder,Alloc> const &A, Triangle const &t=Lower,
+                           bool const &unit=false, TriangularSchedule const &s=Level_scheduled)
+    {
+        analyse(A, t, unit, s);
+    };
+
+    void analyse(Matrix<T,StorageOrder,Alloc> const &A, Triangle const &t=Lower,
+                 bool const &unit=false, TriangularSchedule const &s=Level_scheduled);
+
+    void solve(std::vector<T> const &b, std::vector<T> &x) const;
+    void solve(std::vector<T> const &values, std::vector<T> const &b, std::vector<T> &x) const;
+
+    /**
+     * @brief Get number of levels
+     */
+    std::size_t nlevels() const { return level_ptr.empty() ? 0 : level_ptr.size()-1; };
+
+    /**
+     * @brief Get pointers to the first row of each level in level_rows()
+     */
+    std::vector<std::size_t> const & levels() const { return level_ptr; };
+
+    /**
+     * @brief Get rows sorted by level
+     */
+    std::vector<std::size_t> const & rows() const { return level_rows; };
+
+    /**
+     * @brief Get position of the diagonal element of each row (JA.size() if not stored)
+     */
+    std::vector<std::size_t> const & diagonal() const { return diag; };
+
+private:
+    void solve_values(T const *values, std::vector<T> const &b, std::vector<T> &x) const;
+    void solve_levels(T const *values, std::vector<T> const &b, std::vector<T> &x) const;
+    void solve_sync_free(T const *values, std::vector<T> const &b, std::vector<T> &x) const;
+
+    /// analysed matrix
+    Matrix<T,StorageOrder,Alloc> const *mat = nullptr;
+    /// triangular part
+    Triangle triangle = Lower;
+    /// unit diagonal, not read from the values
+    bool unit_diagonal = false;
+    /// scheduling of the solve
+    TriangularSchedule schedule = Level_scheduled;
+
+    /// position of the first element of each row with column >= row
+    std::vector<std::size_t> split;
+    /// position of the diagonal element of each row
+    std::vector<std::size_t> diag;
+    /// rows sorted by level, and pointers to each level
+    std::vector<std::size_t> level_rows, level_ptr;
+};
+
+/**
+ * @brief Analyse the pattern of the matrix: row i of the lower part depends on
+ * rows j<i with a_ij != 0, row i of the upper part on rows j>i with a_ij != 0.
+ * Rows are grouped into levels so that each row only depends on rows of
+ * previous levels.
+ *
+ * @param A             Matrix object, compressed CSR
+ * @param t             triangular part to solve
+ * @param unit          true if the diagonal is unitary (and not read)
+ * @param s             scheduling of the solve
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+void SparseTriangularSolver<T,StorageOrder,Alloc>::analyse(Matrix<T,StorageOrder,Alloc> const &A,
+    Triangle const &t, bool const &unit, TriangularSchedule const &s)
+{
+    mat = nullptr;
+    if (!A.is_compressed() or A.compression_type() != Compression::CSR or A.nrows() != A.ncols())
+    {
+        std::cerr << "triangular solve requires a square CSR compressed matrix" << std::endl;
+        return;
+    }
+
+    auto const &IA = A.ia();
+    auto const &JA = A.ja();
+    std::size_t n = A.nrows();
+    triangle = t;
+    unit_diagonal = unit;
+    schedule = s;
+
+    split.resize(n);
+    diag.resize(n);
+    std::size_t missing = 0;
+
+    #pragma omp parallel for reduction(+:missing)
+    for (std::size_t i=0; i<n; ++i)
+    {
+        // columns of each row are sorted
+        auto first = JA.cbegin() + IA[i];
+        auto last = JA.cbegin() + IA[i+1];
+        auto it = std::lower_bound(first, last, i);
+        split[i] = it - JA.cbegin();
+        diag[i] = (it != last and *it == i) ? split[i] : JA.size();
+        if (diag[i] == JA.size())
+            ++missing;
+    }
+
+    if (missing and !unit)
+    {
+        std::cerr << "triangular solve: " << missing << " missing diagonal elements" << std::endl;
+        return;
+    }
+
+    // level of each row
+    std::vector<std::size_t> level(n);
+    switch (triangle)
+    {
+    case Triangle::Lower:
+    {
+        for (std::size_t i=0; i<n; ++i)
+        {
+            std::size_t l = 0;
+            for (std::size_t k=IA[i]; k<split[i]; ++k)
+                l = std::max(l, level[JA[k]]+1);
+            level[i] = l;
+        }
+        break;
+    }
+    case Triangle::Upper:
+    {
+        for (std::size_t i=n; i-- > 0; )
+        {
+            std::size_t l = 0;
+            std::size_t first = (diag[i] == split[i]) ? split[i]+1 : split[i];
+            for (std::size_t k=first; k<IA[i+1]; ++k)
+                l = std::max(l, level[JA[k]]+1);
+            level[i] = l;
+        }
+        break;
+    }
+    } // switch(triangle)
+
+    // sort rows by level with a counting sort
+    std::size_t nlev = n ? *std::max_element(level.cbegin(), level.cend()) + 1 : 0;
+    level_ptr.assign(nlev+1, 0);
+    for (std::size_t i=0; i<n; ++i)
+        ++level_ptr[level[i]+1];
+    for (std::size_t l=0; l<nlev; ++l)
+        level_ptr[l+1] += level_ptr[l];
+    level_rows.resize(n);
+    std::vector<std::size_t> next(level_ptr.cbegin(), level_ptr.cend()-1);
+    for (std::size_t i=0; i<n; ++i)
+        level_rows[ next[level[i]]++ ] = i;
+
+    mat = &A;
+}
+
+/**
+ * @brief Solve the triangular system with the values of the analysed matrix.
+ * b and x can be the same vector.
+ *
+ * @param b             right hand side
+ * @param x             solution
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+void SparseTriangularSolver<T,StorageOrder,Alloc>::solve(std::vector<T> const &b, std::vector<T> &x) const
+{
+    if (!mat)
+    {
+        std::cerr << "triangular solve: matrix not analysed" << std::endl;
+        return;
+    }
+    solve_values(mat->aa().data(), b, x);
+}
+
+/**
+ * @brief Solve the triangular system with values sharing the pattern of the
+ * analysed matrix. b and x can be the same vector.
+ *
+ * @param values        values, same size and pattern of AA
+ * @param b             right hand side
+ * @param x             solution
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+void SparseTriangularSolver<T,StorageOrder,Alloc>::solve(std::vector<T> const &values,
+    std::vector<T> const &b, std::vector<T> &x) const
+{
+    if (!mat)
+    {
+        std::cerr << "triangular solve: matrix not analysed" << std::endl;
+        return;
+    }
+    solve_values(values.data(), b, x);
+}
+
+/**
+ * @brief Solve with the values pointed by values, dispatching on the schedule.
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+void SparseTriangularSolver<T,StorageOrder,Alloc>::solve_values(T const *values,
+    std::vector<T> const &b, std::vector<T> &x) const
+{
+    if (x.size() != b.size())
+        x.resize(b.size());
+
+    switch (schedule)
+    {
+    case TriangularSchedule::Level_scheduled:
+        solve_levels(values, b, x);
+        break;
+    case TriangularSchedule::Sync_free:
+        solve_sync_free(values, b, x);
+        break;
+    } // switch(schedule)
+}
+
+/**
+ * @brief Level-scheduled solve: rows of each level in parallel, with a
+ * barrier between levels.
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+void SparseTriangularSolver<T,StorageOrder,Alloc>::solve_levels(T const *values,
+    std::vector<T> const &b, std::vector<T> &x) const
+{
+    auto const &IA = mat->ia();
+    auto const &JA = mat->ja();
+    std::size_t nlev = nlevels();
+
+    #pragma omp parallel
+    {
+        for (std::size_t l=0; l<nlev; ++l)
+        {
+            #pragma omp for
+            for (std::size_t p=level_ptr[l]; p<level_ptr[l+1]; ++p)
+            {
+                std::size_t i = level_rows[p];
+                T sum = b[i];
+                std::size_t first = (triangle == Lower) ? IA[i] : split[i];
+                std::size_t last = (triangle == Lower) ? split[i] : IA[i+1];
+                for (std::size_t k=first; k<last; ++k)
+                {
+                    if (k != diag[i])
+                        sum -= values[k] * x[JA[k]];
+                }
+                x[i] = unit_diagonal ? sum : sum / values[diag[i]];
+            }
+        }
+    }
+}
+
+/**
+ * @brief Synchronization-free solve: rows are taken in dependency order from
+ * a shared counter, and each row waits only for the completion flags of the
+ * rows it depends on. The flags are allocated by each call, so the solver can
+ * be shared by concurrent solves.
+ */
+template<typename T, typename StorageOrder, typename Alloc>
+void SparseTriangularSolver<T,StorageOrder,Alloc>::solve_sync_free(T const *values,
+    std::vector<T> const &b, std::vector<T> &x) const
+{
+    auto const &IA = mat->ia();
+    auto const &JA = mat->ja();
+    std::size_t n = mat->nrows();
+    // completion flags, local to the call: concurrent solves do not share them
+    std::vector<int> ready(n, 0);
+    std::atomic<std::size_t> counter{0};
+
+    #pragma omp parallel
+    {
+        for (std::size_t p=counter.fetch_add(1); p<n; p=counter.fetch_add(1))
+        {
+            std::size_t i = (triangle == Lower) ? p : n-1-p;
+            T sum = b[i];
+            std::size_t first = (triangle == Lower) ? IA[i] : split[i];
+            std::size_t last = (triangle == Lower) ? split[i] : IA[i+1];
+            for (std::size_t k=first; k<last; ++k)
+            {
+                if (k == diag[i])
+                    continue;
+                std::size_t j = JA[k];
+                // rows are handed out in dependency order: j is being solved
+                while (!std::atomic_ref<int>(ready[j]).load(std::memory_order_acquire))
+                    std::this_thread::yield();
+                sum -= values[k] * x[j];
+            }
+            x[i] = unit_diagonal ? sum : sum / values[diag[i]];
+            std::atomic_ref<int>(ready[i]).store(1, std::memory_order_release);
+        }
+    }
+}
+
+} // namespace algebra
+
+#endif
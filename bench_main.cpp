@@ -0,0 +1,190 @@
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <complex>
+#include "Matrix.hpp"
+#include "Benchmark.hpp"
+#include "Allocators.hpp"
+#include "Pipeline.hpp"
+
+// Benchmark of load, compress, uncompress, matrix-vector product, norms and
+// element access for every storage format and every matrix in data/.
+// Usage: bench_main [output.json] [repetitions]
+
+/// floating point operations of a multiply-add and of an absolute value
+template<typename T>
+constexpr double fma_flops = algebra::is_complex<T>::value ? 8. : 2.;
+template<typename T>
+constexpr double abs_flops = algebra::is_complex<T>::value ? 4. : 1.;
+
+/// values written by the kernels, so that they are not optimized away
+volatile double sink = 0.;
+
+template<typename T>
+void bench_matrix(algebra::BenchmarkSuite &suite, std::string const &file,
+                  std::string const &type, std::size_t const &reps)
+{
+    using Mat = algebra::Matrix<T, algebra::Order>;
+
+    // slow kernels are repeated less
+    std::size_t slow_reps = std::max<std::size_t>(reps/10, 3);
+
+    Mat coo_row(file);
+    Mat coo_col(file, algebra::Column_major);
+    Mat csr(coo_row);
+    csr.compress(algebra::CSR);
+
+    algebra::BenchmarkRecord base;
+    base.matrix = file.substr(file.find_last_of('/')+1);
+    base.type = type;
+    base.nrow = csr.nrows();
+    base.ncol = csr.ncols();
+    base.nnz = csr.aa().size();
+    double nnz = base.nnz;
+
+    // load: bytes of the coordinate representation built
+    {
+        auto rec = base;
+        rec.format = "COO";
+        rec.kernel = "load";
+        rec.bytes = algebra::storage_bytes(coo_row, base.nnz);
+        suite.run(rec, slow_reps, []{}, [&]{ Mat M(file); sink = M.nrows(); });
+    }
+
+    // assembly through the subscript operator, nodes from the heap or an arena
+    {
+        auto rec = base;
+        rec.kernel = "assemble";
+        rec.bytes = algebra::storage_bytes(coo_row, base.nnz);
+        auto const &IA = csr.ia();
+        auto const &JA = csr.ja();
+        auto const &AA = csr.aa();
+        auto assemble = [&](auto &M)
+        {
+            for (std::size_t i=0; i<base.nrow; ++i)
+                for (std::size_t k=IA[i]; k<IA[i+1]; ++k)
+                    M[{i, JA[k]}] = AA[k];
+            M.compress(algebra::CSR);
+            sink = M.nrows();
+        };
+
+        rec.format = "COO";
+        suite.run(rec, slow_reps, []{}, [&]{ Mat M(base.nrow, base.ncol); assemble(M); });
+
+        rec.format = "arena";
+        suite.run(rec, slow_reps, []{}, [&]
+        {
+            algebra::Arena arena;
+            algebra::Matrix<T, algebra::Order, std::pmr::polymorphic_allocator<T>>
+                M(base.nrow, base.ncol, arena.allocator<T>());
+            assemble(M);
+        });
+    }
+
+    // keys of the elements for the access kernel, {col, row} if column-major
+    std::vector<typename Mat::indexes> keys_row, keys_col;
+    for (std::size_t i=0; i<csr.nrows(); ++i)
+    {
+        for (std::size_t k=csr.ia()[i]; k<csr.ia()[i+1]; ++k)
+        {
+            keys_row.push_back({i, csr.ja()[k]});
+            keys_col.push_back({csr.ja()[k], i});
+        }
+    }
+
+    std::vector<T> x(base.ncol), y(base.nrow);
+    for (std::size_t j=0; j<x.size(); ++j)
+        x[j] = T(1. + 1e-3*j);
+
+    struct Format { std::string name; algebra::Compression c; bool row_major; };
+    std::vector<Format> formats{ {"COO", algebra::CSR, true}, {"CSR", algebra::CSR, true},
+        {"CSC", algebra::CSC, false}, {"ELL", algebra::ELL, true},
+        {"BSR", algebra::BSR, true}, {"DIA", algebra::DIA, true} };
+
+    for (auto const &f : formats)
+    {
+        Mat const &coo = f.row_major ? coo_row : coo_col;
+        bool compressed = (f.name != "COO");
+        Mat M(coo), work;
+        if (compressed)
+            M.compress(f.c);
+        double bytes = algebra::storage_bytes(M, base.nnz);
+
+        auto rec = base;
+        rec.format = f.name;
+
+        if (compressed)
+        {
+            rec.kernel = "compress";
+            rec.bytes = bytes;
+            suite.run(rec, slow_reps, [&]{ work = coo; }, [&]{ work.compress(f.c); });
+
+            rec.kernel = "uncompress";
+            suite.run(rec, slow_reps, [&]{ work = M; }, [&]{ work.uncompress(); });
+        }
+
+        // product: matrix, input and output vectors
+        rec.kernel = "spmv";
+        rec.flops = fma_flops<T> * nnz;
+        rec.bytes = bytes + (base.nrow + base.ncol) * sizeof(T);
+        suite.run(rec, reps, []{}, [&]{ M.multiply(x, y); sink = std::abs(y[0]); });
+
+        rec.flops = (abs_flops<T> + 1.) * nnz;
+        rec.bytes = bytes;
+        rec.kernel = "norm_one";
+        suite.run(rec, reps, []{}, [&]{ sink = M.norm(algebra::One); });
+        rec.kernel = "norm_infty";
+        suite.run(rec, reps, []{}, [&]{ sink = M.norm(algebra::Infinity); });
+        rec.kernel = "norm_frob";
+        suite.run(rec, reps, []{}, [&]{ sink = M.norm(algebra::Frobenius); });
+
+        // const access of every element
+        rec.kernel = "access";
+        rec.flops = nnz;
+        rec.bytes = nnz * sizeof(T);
+        Mat const &C = M;
+        auto const &keys = f.row_major ? keys_row : keys_col;
+        suite.run(rec, slow_reps, []{}, [&]
+        {
+            T sum = 0;
+            for (auto const &k : keys)
+                sum += C[k];
+            sink = std::abs(sum);
+        });
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    std::string output = (argc > 1) ? argv[1] : "bench.json";
+    std::size_t reps = (argc > 2) ? std::strtoul(argv[2], nullptr, 10) : 50;
+
+    algebra::BenchmarkSuite suite;
+    for (auto const &name : algebra::mtx_files("data"))
+    {
+        // field from the header line
+        std::ifstream in(name);
+        std::string header;
+        getline(in, header);
+        if (header.find("complex") != std::string::npos)
+            bench_matrix<std::complex<double>>(suite, name, "complex<double>", reps);
+        else
+            bench_matrix<double>(suite, name, "double", reps);
+    }
+
+    suite.print(std::cout);
+
+    std::ofstream file(output);
+    if (!file)
+    {
+        std::cerr << "cannot write " << output << std::endl;
+        return 1;
+    }
+    suite.write_json(file);
+    std::cout << "results written to " << output << std::endl;
+
+    return 0;
+}
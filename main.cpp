@@ -1,9 +1,28 @@
 #include <cstddef>
+#include <cstdint>
 #include <iostream>
 #include <vector>
 #include "Matrix.hpp"
+#include "Solvers.hpp"
+#include "Preconditioners.hpp"
+#include "TriangularSolve.hpp"
+#include "Eigensolvers.hpp"
+#include "Autotuner.hpp"
+#include "PerfCounters.hpp"
+#include "Allocators.hpp"
+#include "Assembly.hpp"
+#include "MatrixView.hpp"
+#include "MixedPrecision.hpp"
+#include "EncodedMatrix.hpp"
+#include "Batched.hpp"
+#include "SparseVector.hpp"
+#include "MatrixPowers.hpp"
+#include "FixedMatrix.hpp"
+#include "SplitComplex.hpp"
+#include "Pipeline.hpp"
 #include <chrono>
 #include <complex>
+#include <filesystem>
 
 int main()
 {
@@ -180,5 +199,901 @@ int main()
         std::cout << "Time taken: " << duration.count() << " microseconds" << std::endl;
 
     }
+    //! iterative solvers
+    if (true)
+    {
+        std::cout << "*** ITERATIVE SOLVERS ***" << std::endl;
+
+        // 1D laplacian, symmetric positive definite
+        std::size_t n = 100;
+        algebra::Matrix<double, algebra::Order> M_lap(n, n);
+        for (std::size_t i=0; i<n; ++i)
+        {
+            M_lap[ {i,i} ] = 2.;
+            if (i>0)
+                M_lap[ {i,i-1} ] = -1.;
+            if (i<n-1)
+                M_lap[ {i,i+1} ] = -1.;
+        }
+        M_lap.compress(algebra::Compression::CSR);
+        std::vector<double> b_lap(n, 1.);
+
+        algebra::SolverParameters param;
+        param.tol = 1e-10;
+
+        std::vector<double> x_cg;
+        algebra::ConjugateGradient<double, algebra::Order> cg(param);
+        auto res_cg = cg.solve(M_lap, b_lap, x_cg);
+        std::cout << "CG: converged " << res_cg.converged << " iterations " << res_cg.iterations
+                  << " residual " << res_cg.residual << std::endl;
+
+        std::vector<double> x_bicg;
+        algebra::BiCGSTAB<double, algebra::Order> bicgstab(param);
+        auto res_bicg = bicgstab.solve(M_lap, b_lap, x_bicg);
+        std::cout << "BiCGSTAB: converged " << res_bicg.converged << " iterations " << res_bicg.iterations
+                  << " residual " << res_bicg.residual << std::endl;
+
+        std::vector<double> x_gmres;
+        algebra::GMRES<double, algebra::Order> gmres(param);
+        auto res_gmres = gmres.solve(M_lap, b_lap, x_gmres);
+        std::cout << "GMRES: converged " << res_gmres.converged << " iterations " << res_gmres.iterations
+                  << " residual " << res_gmres.residual << std::endl;
+
+        // complex general matrix
+        algebra::Matrix<std::complex<double>, algebra::Order> M_mhd("data/mhd1280a.mtx");
+        M_mhd.compress(algebra::Compression::CSR);
+        std::vector<std::complex<double>> b_mhd(M_mhd.nrows(), 1.);
+        std::vector<std::complex<double>> x_mhd;
+        param.restart = 50;
+        param.max_iter = 500;
+        algebra::GMRES<std::complex<double>, algebra::Order> gmres_c(param);
+        auto res_mhd = gmres_c.solve(M_mhd, b_mhd, x_mhd);
+        std::cout << "GMRES complex: converged " << res_mhd.converged << " iterations " << res_mhd.iterations
+                  << " residual " << res_mhd.residual << std::endl;
+
+        x_mhd.clear();
+        algebra::BiCGSTAB<std::complex<double>, algebra::Order> bicgstab_c(param);
+        res_mhd = bicgstab_c.solve(M_mhd, b_mhd, x_mhd);
+        std::cout << "BiCGSTAB complex: converged " << res_mhd.converged << " iterations " << res_mhd.iterations
+                  << " residual " << res_mhd.residual << std::endl;
+    }
+    //! preconditioners
+    if (true)
+    {
+        std::cout << "*** PRECONDITIONERS ***" << std::endl;
+
+        // 2D convection-diffusion on a m x m grid, non-symmetric
+        std::size_t m = 40;
+        std::size_t n = m*m;
+        algebra::Matrix<double, algebra::Order> M_cd(n, n);
+        for (std::size_t i=0; i<m; ++i)
+        {
+            for (std::size_t j=0; j<m; ++j)
+            {
+                std::size_t k = i*m + j;
+                M_cd[ {k,k} ] = 4.;
+                if (i>0)   M_cd[ {k,k-m} ] = -1.3;
+                if (i<m-1) M_cd[ {k,k+m} ] = -0.7;
+                if (j>0)   M_cd[ {k,k-1} ] = -1.;
+                if (j<m-1) M_cd[ {k,k+1} ] = -1.;
+            }
+        }
+        M_cd.compress(algebra::Compression::CSR);
+        std::vector<double> b_cd(n, 1.);
+
+        algebra::SolverParameters param;
+        param.tol = 1e-10;
+        algebra::BiCGSTAB<double, algebra::Order> bicgstab(param);
+
+        std::vector<double> x_cd;
+        auto res = bicgstab.solve(M_cd, b_cd, x_cd);
+        std::cout << "BiCGSTAB: iterations " << res.iterations << " residual " << res.residual << std::endl;
+
+        x_cd.clear();
+        algebra::Jacobi<double, algebra::Order> jacobi(M_cd);
+        res = bicgstab.solve(M_cd, b_cd, x_cd, jacobi);
+        std::cout << "BiCGSTAB + Jacobi: iterations " << res.iterations << " residual " << res.residual << std::endl;
+
+        x_cd.clear();
+        algebra::BlockJacobi<double, algebra::Order> block_jacobi(M_cd, 8);
+        res = bicgstab.solve(M_cd, b_cd, x_cd, block_jacobi);
+        std::cout << "BiCGSTAB + block Jacobi: iterations " << res.iterations << " residual " << res.residual << std::endl;
+
+        x_cd.clear();
+        algebra::ILU0<double, algebra::Order> ilu(M_cd);
+        res = bicgstab.solve(M_cd, b_cd, x_cd, ilu);
+        std::cout << "BiCGSTAB + ILU(0): iterations " << res.iterations << " residual " << res.residual << std::endl;
+
+        x_cd.clear();
+        algebra::MulticolorGaussSeidel<double, algebra::Order> sgs(M_cd);
+        res = bicgstab.solve(M_cd, b_cd, x_cd, sgs);
+        std::cout << "BiCGSTAB + SGS (" << sgs.ncolors() << " colors): iterations " << res.iterations
+                  << " residual " << res.residual << std::endl;
+
+        // complex tridiagonal matrix: ILU(0) is the exact LU factorization
+        n = 300;
+        std::complex<double> d(3., 1.), l(-1., 0.5), u(-1.2, 0.);
+        algebra::Matrix<std::complex<double>, algebra::Order> M_tri(n, n);
+        for (std::size_t i=0; i<n; ++i)
+        {
+            M_tri[ {i,i} ] = d;
+            if (i>0)   M_tri[ {i,i-1} ] = l;
+            if (i<n-1) M_tri[ {i,i+1} ] = u;
+        }
+        M_tri.compress(algebra::Compression::CSR);
+        std::vector<std::complex<double>> b_tri(n, 1.), x_tri;
+        algebra::ILU0<std::complex<double>, algebra::Order> ilu_c(M_tri);
+        algebra::GMRES<std::complex<double>, algebra::Order> gmres_c(param);
+        auto res_c = gmres_c.solve(M_tri, b_tri, x_tri, ilu_c);
+        std::cout << "GMRES complex + ILU(0): iterations " << res_c.iterations << " residual " << res_c.residual << std::endl;
+    }
+    //! sparse triangular solve
+    if (true)
+    {
+        std::cout << "*** TRIANGULAR SOLVE ***" << std::endl;
+
+        // 2D laplacian on a m x m grid
+        std::size_t m = 30;
+        std::size_t n = m*m;
+        algebra::Matrix<double, algebra::Order> M_lap(n, n);
+        for (std::size_t k=0; k<n; ++k)
+        {
+            M_lap[ {k,k} ] = 4.;
+            if (k>=m)          M_lap[ {k,k-m} ] = -1.;
+            if (k+m<n)         M_lap[ {k,k+m} ] = -1.;
+            if (k%m != 0)      M_lap[ {k,k-1} ] = -1.;
+            if ((k+1)%m != 0)  M_lap[ {k,k+1} ] = -1.;
+        }
+        M_lap.compress(algebra::Compression::CSR);
+        std::vector<double> b(n, 1.), x_lev, x_free;
+
+        algebra::SparseTriangularSolver<double, algebra::Order> lower(M_lap, algebra::Lower);
+        lower.solve(b, x_lev);
+        algebra::SparseTriangularSolver<double, algebra::Order> lower_free(M_lap, algebra::Lower,
+                                                                          false, algebra::Sync_free);
+        lower_free.solve(b, x_free);
+
+        double diff = 0.;
+        for (std::size_t i=0; i<n; ++i)
+            diff = std::max(diff, std::abs(x_lev[i] - x_free[i]));
+        std::cout << "levels: " << lower.nlevels() << ", difference level-scheduled / sync-free: "
+                  << diff << std::endl;
+    }
+
+    //! eigensolvers
+    if (true)
+    {
+        std::cout << "*** EIGENSOLVERS ***" << std::endl;
+
+        algebra::EigenParameters param;
+        param.nev = 4;
+        param.ncv = 30;
+
+        // symmetric matrix: spectral bounds
+        algebra::Matrix<double, algebra::Order> M_zenios("data/zenios.mtx");
+        M_zenios.compress(algebra::Compression::CSR);
+        param.which = algebra::Largest_real;
+        algebra::Lanczos<double, algebra::Order> lanczos(param);
+        auto res = lanczos.solve(M_zenios);
+        std::cout << "Lanczos: converged " << res.converged << " restarts " << res.restarts
+                  << " products " << res.products << std::endl;
+        for (auto l : lanczos.eigenvalues())
+            std::cout << l << std::endl;
+
+        // complex general matrix
+        algebra::Matrix<std::complex<double>, algebra::Order> M_mhd("data/mhd1280a.mtx");
+        M_mhd.compress(algebra::Compression::CSR);
+        param.which = algebra::Largest_magnitude;
+        algebra::Arnoldi<std::complex<double>, algebra::Order> arnoldi(param);
+        res = arnoldi.solve(M_mhd);
+        std::cout << "Arnoldi: converged " << res.converged << " restarts " << res.restarts
+                  << " products " << res.products << std::endl;
+        for (auto l : arnoldi.eigenvalues())
+            std::cout << l << std::endl;
+    }
+
+    //! storage formats and autotuner
+    if (true)
+    {
+        std::cout << "*** STORAGE FORMATS ***" << std::endl;
+
+        // every format gives the same product, norms and elements of CSR
+        algebra::Matrix<double, algebra::Order> M_csr("data/lnsp_131.mtx");
+        M_csr.compress(algebra::Compression::CSR);
+        std::vector<double> x(M_csr.ncols()), y_csr, y;
+        for (std::size_t i=0; i<x.size(); ++i)
+            x[i] = 1. + 0.01*i;
+        M_csr.multiply(x, y_csr);
+
+        std::vector<std::pair<algebra::Compression, const char *>> formats{
+            {algebra::ELL, "ELL"}, {algebra::BSR, "BSR"}, {algebra::DIA, "DIA"} };
+        for (auto [format, name] : formats)
+        {
+            algebra::Matrix<double, algebra::Order> M("data/lnsp_131.mtx");
+            M.compress(format, 3);
+            M.multiply(x, y);
+            double diff = 0.;
+            for (std::size_t i=0; i<y.size(); ++i)
+                diff = std::max(diff, std::abs(y[i] - y_csr[i]));
+            std::cout << name << ": stored " << M.aa().size() << " values, product difference " << diff
+                      << ", norms " << M.norm(algebra::One) - M_csr.norm(algebra::One) << " "
+                      << M.norm(algebra::Infinity) - M_csr.norm(algebra::Infinity) << " "
+                      << M.norm(algebra::Frobenius) - M_csr.norm(algebra::Frobenius)
+                      << ", element (5,5) " << M[{5,5}] << " " << M_csr[{5,5}] << std::endl;
+        }
+
+        // tune twice: the second decision comes from the cache
+        algebra::TunerParameters param;
+        param.cache = (std::filesystem::temp_directory_path() / "apsc_format_tuning.cache").string();
+        std::filesystem::remove(param.cache);
+        const char *names[] = {"CSR", "CSC", "ELL", "BSR", "DIA"};
+        for (int pass=0; pass<2; ++pass)
+        {
+            for (auto file : {"data/lnsp_131.mtx", "data/zenios.mtx"})
+            {
+                algebra::Matrix<double, algebra::Order> M(file);
+                M.compress(algebra::Compression::CSR);
+                algebra::FormatTuner<double, algebra::Order> tuner(param);
+                auto res = tuner.tune(M);
+                std::cout << file << ": " << names[res.format] << " (block " << res.block << ") "
+                          << (res.cached ? "cached" : "timed") << ", candidates " << res.candidates
+                          << ", ELL fill " << tuner.features().ell_fill
+                          << ", DIA fill " << tuner.features().diag_fill << std::endl;
+            }
+
+            algebra::Matrix<std::complex<double>, algebra::Order> M_mhd("data/mhd1280a.mtx");
+            M_mhd.compress(algebra::Compression::CSR);
+            algebra::FormatTuner<std::complex<double>, algebra::Order> tuner(param);
+            auto res = tuner.tune(M_mhd);
+            std::cout << "data/mhd1280a.mtx: " << names[res.format] << " (block " << res.block << ") "
+                      << (res.cached ? "cached" : "timed") << ", candidates " << res.candidates << std::endl;
+        }
+        std::filesystem::remove(param.cache);
+    }
+
+    //! performance counters
+    if (true)
+    {
+        std::cout << "*** PERFORMANCE COUNTERS ***" << std::endl;
+
+        algebra::perf::reset();
+        algebra::Matrix<double, algebra::Order> M_perf("data/zenios.mtx");
+        M_perf.compress(algebra::Compression::CSR);
+        std::vector<double> x(M_perf.ncols(), 1.), y;
+        {
+            ALGEBRA_PERF_SCOPE("main::products");
+            for (int k=0; k<100; ++k)
+                M_perf.multiply(x, y);
+        }
+        algebra::perf::report(std::cout);
+    }
+
+    //! memory usage
+    if (true)
+    {
+        std::cout << "*** MEMORY USAGE ***" << std::endl;
+
+        // allocations of the matrix counted by the tracking allocator
+        using Alloc = algebra::TrackingAllocator<double>;
+        auto &tracker = Alloc::tracker();
+        algebra::Matrix<double, algebra::Order, Alloc> M_mem("data/zenios.mtx");
+        std::cout << M_mem.memory_usage() << std::endl;
+        std::cout << "tracked live " << tracker.live() << ", peak " << tracker.peak() << std::endl;
+
+        tracker.reset_peak();
+        M_mem.compress(algebra::Compression::CSR);
+        std::cout << M_mem.memory_usage() << std::endl;
+        std::cout << "tracked live " << tracker.live() << ", peak during compress " << tracker.peak() << std::endl;
+
+        tracker.reset_peak();
+        M_mem.uncompress();
+        std::cout << "tracked live " << tracker.live() << ", peak during uncompress " << tracker.peak() << std::endl;
+
+        // moving does not allocate
+        std::size_t allocations = tracker.allocations();
+        auto M_moved = std::move(M_mem);
+        std::cout << "moved: " << M_moved.nrows() << " rows, source " << M_mem.nrows()
+                  << " rows, new allocations " << tracker.allocations() - allocations << std::endl;
+    }
+
+    //! arena allocator for the assembly
+    if (true)
+    {
+        std::cout << "*** ARENA ASSEMBLY ***" << std::endl;
+
+        // 2D Laplacian assembled element by element
+        std::size_t m = 150, n = m*m;
+        auto assemble = [m, n](auto &A)
+        {
+            for (std::size_t i=0; i<n; ++i)
+            {
+                A[{i,i}] = 4.;
+                if (i%m) A[{i,i-1}] = -1.;
+                if ((i+1)%m) A[{i,i+1}] = -1.;
+                if (i>=m) A[{i,i-m}] = -1.;
+                if (i+m<n) A[{i,i+m}] = -1.;
+            }
+            A.compress(algebra::Compression::CSR);
+        };
+
+        auto start = std::chrono::steady_clock::now();
+        algebra::Matrix<double, algebra::Order> M_heap(n, n);
+        assemble(M_heap);
+        auto t_heap = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        start = std::chrono::steady_clock::now();
+        algebra::Arena arena;
+        algebra::Matrix<double, algebra::Order, std::pmr::polymorphic_allocator<double>>
+            M_arena(n, n, arena.allocator<double>());
+        assemble(M_arena);
+        auto t_arena = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << "heap assembly " << t_heap << " s, arena assembly " << t_arena << " s, same values "
+                  << (M_heap.aa() == std::vector<double>(M_arena.aa().cbegin(), M_arena.aa().cend())) << std::endl;
+    }
+
+    //! concurrent assembly
+    if (true)
+    {
+        std::cout << "*** CONCURRENT ASSEMBLY ***" << std::endl;
+
+        // bilinear elements on a square grid: each element adds a 4x4 block
+        std::size_t m = 120, n = (m+1)*(m+1);
+        double K[4][4] = { { 4,-1,-2,-1}, {-1, 4,-1,-2}, {-2,-1, 4,-1}, {-1,-2,-1, 4} };
+        auto nodes = [m](std::size_t e, std::size_t *v)
+        {
+            std::size_t x = e % m, y = e / m;
+            v[0] = y*(m+1)+x; v[1] = v[0]+1; v[2] = v[1]+m+1; v[3] = v[0]+m+1;
+        };
+
+        auto start = std::chrono::steady_clock::now();
+        algebra::ConcurrentAssembler<double, algebra::Order> assembler(n, n);
+        #pragma omp parallel for
+        for (std::size_t e=0; e<m*m; ++e)
+        {
+            std::size_t v[4];
+            nodes(e, v);
+            for (int a=0; a<4; ++a)
+                for (int b=0; b<4; ++b)
+                    assembler.add(v[a], v[b], K[a][b]/6.);
+        }
+        std::size_t contributions = assembler.size();
+        auto M_par = assembler.finalize();
+        auto t_par = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        // serial reference through the subscript operator
+        start = std::chrono::steady_clock::now();
+        algebra::Matrix<double, algebra::Order> M_ser(n, n);
+        for (std::size_t e=0; e<m*m; ++e)
+        {
+            std::size_t v[4];
+            nodes(e, v);
+            for (int a=0; a<4; ++a)
+                for (int b=0; b<4; ++b)
+                    M_ser[{v[a], v[b]}] += K[a][b]/6.;
+        }
+        M_ser.compress(algebra::Compression::CSR);
+        auto t_ser = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        double diff = 0.;
+        for (std::size_t k=0; k<M_ser.aa().size(); ++k)
+            diff = std::max(diff, std::abs(M_ser.aa()[k] - M_par.aa()[k]));
+        std::cout << contributions << " contributions, " << M_par.aa().size() << " elements, same pattern "
+                  << (M_ser.ia() == M_par.ia() and M_ser.ja() == M_par.ja()) << ", difference " << diff
+                  << ", concurrent " << t_par << " s, serial " << t_ser << " s" << std::endl;
+    }
+
+    //! matrix market export
+    if (true)
+    {
+        std::cout << "*** MATRIX MARKET EXPORT ***" << std::endl;
+
+        // write and read back: same elements, whatever the format
+        std::string path = (std::filesystem::temp_directory_path() / "apsc_export.mtx").string();
+        algebra::Matrix<std::complex<double>, algebra::Order> M_mhd("data/mhd1280a.mtx");
+        algebra::Matrix<std::complex<double>, algebra::Order> M_ref(M_mhd);
+        M_ref.compress(algebra::Compression::CSR);
+
+        for (auto format : {algebra::CSR, algebra::ELL, algebra::DIA})
+        {
+            algebra::Matrix<std::complex<double>, algebra::Order> M_out(M_mhd);
+            M_out.compress(format);
+            auto start = std::chrono::steady_clock::now();
+            M_out.save_mtx(path);
+            auto t = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            algebra::Matrix<std::complex<double>, algebra::Order> M_in(path);
+            M_in.compress(algebra::Compression::CSR);
+            std::cout << "format " << format << ": written in " << t << " s, read back equal "
+                      << (M_in.ia() == M_ref.ia() and M_in.ja() == M_ref.ja() and M_in.aa() == M_ref.aa())
+                      << std::endl;
+        }
+
+        // column-major coordinate state
+        algebra::Matrix<double, algebra::Order> M_col("data/lnsp_131.mtx", algebra::Column_major);
+        M_col.save_mtx(path);
+        algebra::Matrix<double, algebra::Order> M_back(path), M_row("data/lnsp_131.mtx");
+        M_back.compress(algebra::Compression::CSR);
+        M_row.compress(algebra::Compression::CSR);
+        std::cout << "column-major read back equal "
+                  << (M_back.ja() == M_row.ja() and M_back.aa() == M_row.aa()) << std::endl;
+        std::filesystem::remove(path);
+    }
+
+    //! dense ingestion
+    if (true)
+    {
+        std::cout << "*** DENSE INGESTION ***" << std::endl;
+
+        // dense block with about 5% of values above tolerance
+        std::size_t r = 1500, c = 1200;
+        std::vector<double> dense(r*c, 0.), dense_t(r*c, 0.);
+        algebra::Matrix<double, algebra::Order>::fullmatrix full(r, std::vector<double>(c, 0.));
+        for (std::size_t i=0; i<r; ++i)
+        {
+            for (std::size_t j=0; j<c; ++j)
+            {
+                double v = ((i*7919 + j*104729) % 97 < 5) ? 1. + 0.001*(i+j) : 1e-12;
+                dense[i*c+j] = v;
+                dense_t[j*r+i] = v;
+                full[i][j] = v;
+            }
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        algebra::Matrix<double, algebra::Order> M_full(full);
+        M_full.compress(algebra::Compression::CSR);
+        auto t_full = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        start = std::chrono::steady_clock::now();
+        algebra::Matrix<double, algebra::Order> M_dense(r, c, dense.data());
+        auto t_dense = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        // column-major buffer to CSR, and to CSC compared with the column-major full matrix
+        algebra::Matrix<double, algebra::Order> M_dense_t(r, c, dense_t.data(), algebra::Column_major);
+        algebra::Matrix<double, algebra::Order> M_csc(r, c, dense_t.data(), algebra::Column_major, algebra::CSC);
+        algebra::Matrix<double, algebra::Order> M_full_col(full, algebra::Column_major);
+        M_full_col.compress(algebra::Compression::CSC);
+
+        std::cout << M_dense.aa().size() << " elements, equal to fullmatrix "
+                  << (M_dense.ia() == M_full.ia() and M_dense.ja() == M_full.ja() and M_dense.aa() == M_full.aa())
+                  << ", column-major buffer " << (M_dense_t.ja() == M_full.ja() and M_dense_t.aa() == M_full.aa())
+                  << ", CSC " << (M_csc.ia() == M_full_col.ia() and M_csc.ja() == M_full_col.ja())
+                  << ", fullmatrix " << t_full << " s, dense buffer " << t_dense << " s" << std::endl;
+    }
+
+    //! sparse addition
+    if (true)
+    {
+        std::cout << "*** SPARSE ADDITION ***" << std::endl;
+
+        algebra::Matrix<double, algebra::Order> A("data/lnsp_131.mtx");
+        A.compress(algebra::Compression::CSR);
+        std::size_t n = A.nrows();
+        std::vector<double> x(n), y_a, y_s;
+        for (std::size_t i=0; i<n; ++i)
+            x[i] = 1. + 0.1*i;
+
+        // shifted operator A - sigma I, compared with A x - sigma x
+        double sigma = 2.5;
+        auto S = A - algebra::identity<double, algebra::Order>(n, sigma);
+        A.multiply(x, y_a);
+        S.multiply(x, y_s);
+        double diff = 0.;
+        for (std::size_t i=0; i<n; ++i)
+            diff = std::max(diff, std::abs(y_s[i] - (y_a[i] - sigma*x[i])));
+        std::cout << "A - sigma I: " << S.aa().size() << " elements (A has " << A.aa().size()
+                  << "), product difference " << diff << std::endl;
+
+        // A + A = 2 A, and axpy back to A
+        auto A2 = A + A;
+        algebra::Matrix<double, algebra::Order> B(A);
+        B *= 2.;
+        std::cout << "A + A equal 2 A " << (A2.ja() == B.ja() and A2.aa() == B.aa());
+        A2.axpy(-1., A);
+        std::cout << ", A + A - A equal A " << (A2.ja() == A.ja() and A2.aa() == A.aa()) << std::endl;
+
+        // CSC, complex
+        algebra::Matrix<std::complex<double>, algebra::Order> C("data/mhd1280a.mtx", algebra::Column_major);
+        C.compress(algebra::Compression::CSC);
+        auto D = C - C;
+        std::cout << "complex CSC C - C: Frobenius norm " << D.norm(algebra::Frobenius) << std::endl;
+    }
+
+    //! views and submatrices
+    if (true)
+    {
+        std::cout << "*** VIEWS AND SUBMATRICES ***" << std::endl;
+
+        algebra::Matrix<double, algebra::Order> A("data/zenios.mtx");
+        A.compress(algebra::Compression::CSR);
+        std::vector<double> x(A.ncols()), y, y_view;
+        for (std::size_t j=0; j<x.size(); ++j)
+            x[j] = 1. + 0.01*j;
+        A.multiply(x, y);
+
+        // row blocks: products match the rows of the full product
+        std::size_t first = 1000, last = 2000;
+        algebra::RowRangeView<double, algebra::Order> view(A, first, last);
+        view.multiply(x, y_view);
+        double diff = 0.;
+        for (std::size_t i=0; i<view.nrows(); ++i)
+            diff = std::max(diff, std::abs(y_view[i] - y[first+i]));
+
+        // the same block extracted: same norms
+        std::vector<std::size_t> rows(last-first), cols(A.ncols());
+        for (std::size_t i=0; i<rows.size(); ++i)
+            rows[i] = first + i;
+        for (std::size_t j=0; j<cols.size(); ++j)
+            cols[j] = j;
+        auto block = algebra::submatrix(A, rows, cols);
+        std::cout << "view: " << view.nnz() << " elements, product difference " << diff
+                  << ", norms " << view.norm(algebra::One) - block.norm(algebra::One) << " "
+                  << view.norm(algebra::Infinity) - block.norm(algebra::Infinity) << " "
+                  << view.norm(algebra::Frobenius) - block.norm(algebra::Frobenius) << std::endl;
+
+        // principal submatrix on reversed indices: same elements as the gather through operator[]
+        std::vector<std::size_t> idx;
+        for (std::size_t i=A.nrows(); i > 2; i -= 3)
+            idx.push_back(i-1);
+        auto P = algebra::submatrix(A, idx);
+        std::size_t mismatch = 0;
+        for (std::size_t p=0; p<idx.size(); ++p)
+        {
+            for (std::size_t k=A.ia()[idx[p]]; k<A.ia()[idx[p]+1]; ++k)
+            {
+                std::size_t j = A.ja()[k];
+                auto q = std::find(idx.cbegin(), idx.cend(), j);
+                if (q != idx.cend() and P[{p, std::size_t(q - idx.cbegin())}] != A.aa()[k])
+                    ++mismatch;
+            }
+        }
+        std::cout << "principal submatrix " << P.nrows() << " x " << P.ncols() << ", " << P.aa().size()
+                  << " elements, mismatches " << mismatch << std::endl;
+    }
+
+    //! mixed precision storage
+    if (true)
+    {
+        std::cout << "*** MIXED PRECISION ***" << std::endl;
+
+        algebra::Matrix<double, algebra::Order> A("data/lnsp_131.mtx");
+        A.compress(algebra::Compression::CSR);
+        algebra::MixedPrecisionMatrix<double> F(A, 1e-6);
+        std::cout << "precision loss: " << F.loss() << std::endl;
+
+        std::vector<double> x(A.ncols());
+        for (std::size_t j=0; j<x.size(); ++j)
+            x[j] = 1. + 0.01*j;
+        auto y = A * x;
+        auto y_mixed = F * x;
+        double diff = 0., ref = 0.;
+        for (std::size_t i=0; i<y.size(); ++i)
+        {
+            diff = std::max(diff, std::abs(y[i] - y_mixed[i]));
+            ref = std::max(ref, std::abs(y[i]));
+        }
+        std::cout << "bytes " << F.bytes() << " instead of " << A.memory_usage().ia_bytes + A.memory_usage().ja_bytes + A.memory_usage().aa_bytes
+                  << ", relative product difference " << diff / ref << std::endl;
+
+        algebra::Matrix<std::complex<double>, algebra::Order> B("data/mhd1280a.mtx", algebra::Column_major);
+        B.compress(algebra::Compression::CSC);
+        algebra::MixedPrecisionMatrix<std::complex<double>> G(B);
+        std::vector<std::complex<double>> z(B.ncols(), {1., -1.});
+        auto w = B * z;
+        auto w_mixed = G * z;
+        diff = 0.;
+        ref = 0.;
+        for (std::size_t i=0; i<w.size(); ++i)
+        {
+            diff = std::max(diff, std::abs(w[i] - w_mixed[i]));
+            ref = std::max(ref, std::abs(w[i]));
+        }
+        std::cout << "complex CSC: bytes " << G.bytes() << ", relative product difference " << diff / ref << std::endl;
+    }
+
+    //! dictionary and delta encoding
+    if (true)
+    {
+        std::cout << "*** ENCODED MATRIX ***" << std::endl;
+
+        for (std::string name : {"data/lnsp_131.mtx", "data/zenios.mtx"})
+        {
+            algebra::Matrix<double, algebra::Order> A(name);
+            A.compress(algebra::Compression::CSR);
+            algebra::EncodedMatrix<double> E;
+            if (!E.encode(A))
+            {
+                std::cout << name << ": not encoded, kept as CSR" << std::endl;
+                continue;
+            }
+
+            std::vector<double> x(A.ncols());
+            for (std::size_t j=0; j<x.size(); ++j)
+                x[j] = 1. + 0.01*j;
+            auto y = A * x;
+            auto y_encoded = E * x;
+            double diff = 0.;
+            for (std::size_t i=0; i<y.size(); ++i)
+                diff = std::max(diff, std::abs(y[i] - y_encoded[i]));
+            std::cout << name << ": " << E.dictionary().size() << " distinct values, bytes " << E.bytes()
+                      << " instead of " << E.csr_bytes() << ", product difference " << diff << std::endl;
+        }
+
+        algebra::Matrix<std::complex<double>, algebra::Order> B("data/mhd1280a.mtx");
+        B.compress(algebra::Compression::CSR);
+        algebra::EncodedMatrix<std::complex<double>> E;
+        if (E.encode(B))
+        {
+            std::vector<std::complex<double>> z(B.ncols(), {1., -1.});
+            auto w = B * z;
+            auto w_encoded = E * z;
+            double diff = 0.;
+            for (std::size_t i=0; i<w.size(); ++i)
+                diff = std::max(diff, std::abs(w[i] - w_encoded[i]));
+            std::cout << "complex: " << E.dictionary().size() << " distinct values, product difference " << diff << std::endl;
+        }
+    }
+
+    //! aligned and huge page storage
+    if (true)
+    {
+        std::cout << "*** ALIGNED STORAGE ***" << std::endl;
+
+        // tridiagonal matrix whose vectors are larger than a huge page
+        std::size_t n = 100000;
+        algebra::Matrix<double, algebra::Order> A(n, n);
+        algebra::Matrix<double, algebra::Order, algebra::AlignedAllocator<double>> B(n, n);
+        for (std::size_t i=0; i<n; ++i)
+        {
+            for (std::size_t j=(i ? i-1 : 0); j<std::min(i+2, n); ++j)
+            {
+                A[{i, j}] = (i == j) ? 4. : -1.;
+                B[{i, j}] = (i == j) ? 4. : -1.;
+            }
+        }
+        A.compress(algebra::Compression::CSR);
+        B.compress(algebra::Compression::CSR);
+
+        std::vector<double> x(n, 1.), y, y_aligned;
+        auto time = [&](auto const &M, std::vector<double> &res)
+        {
+            auto t0 = std::chrono::steady_clock::now();
+            for (int r=0; r<20; ++r)
+                M.multiply(x, res);
+            return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count() / 20;
+        };
+        double t = time(A, y);
+        double t_aligned = time(B, y_aligned);
+
+        bool aligned = reinterpret_cast<std::uintptr_t>(B.aa().data()) % 64 == 0
+                   and reinterpret_cast<std::uintptr_t>(B.ja().data()) % 64 == 0;
+        std::cout << "aligned " << aligned << ", same product " << (y == y_aligned)
+                  << ", product " << t << " us, aligned " << t_aligned << " us" << std::endl;
+    }
+
+    //! batched products of small matrices
+    if (true)
+    {
+        std::cout << "*** BATCHED PRODUCTS ***" << std::endl;
+
+        algebra::Matrix<double, algebra::Order> A("data/lnsp_131.mtx");
+        A.compress(algebra::Compression::CSR);
+
+        std::size_t n_batch = 2000;
+        std::vector<algebra::Matrix<double, algebra::Order>> mats(n_batch, A);
+        std::vector<std::vector<double>> x(n_batch, std::vector<double>(A.ncols())), y, y_loop(n_batch), y_packed;
+        algebra::MatrixBatch<double> batch;
+        batch.reserve(n_batch, n_batch * A.nrows(), n_batch * A.aa().size());
+        for (std::size_t b=0; b<n_batch; ++b)
+        {
+            mats[b] *= 1. + 1e-3*b;
+            batch.add(mats[b]);
+            for (std::size_t j=0; j<x[b].size(); ++j)
+                x[b][j] = 1. + 1e-2*((b+j) % 7);
+        }
+
+        auto time = [](auto f)
+        {
+            auto t0 = std::chrono::steady_clock::now();
+            for (int r=0; r<10; ++r)
+                f();
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count() / 10;
+        };
+        double t_loop = time([&]{ for (std::size_t b=0; b<n_batch; ++b) y_loop[b] = mats[b] * x[b]; });
+        double t_batched = time([&]{ algebra::batched_multiply(mats, x, y); });
+        double t_packed = time([&]{ batch.multiply(x, y_packed); });
+
+        std::cout << n_batch << " matrices: loop " << t_loop << " ms, batched " << t_batched
+                  << " ms, packed " << t_packed << " ms, same results " << (y == y_loop and y_packed == y_loop) << std::endl;
+    }
+
+    //! sparse matrix - sparse vector product
+    if (true)
+    {
+        std::cout << "*** SPARSE VECTOR PRODUCT ***" << std::endl;
+
+        algebra::Matrix<double, algebra::Order> A("data/zenios.mtx", algebra::Column_major);
+        A.compress(algebra::Compression::CSC);
+
+        // a few elements, as the frontier of a graph traversal
+        algebra::SparseVector<double> x(A.ncols());
+        for (std::size_t j=0; j<A.ncols(); j+=97)
+            x.push_back(j, 1. + 0.1*j);
+
+        auto y = A * x;
+        auto y_dense = A * x.dense();
+        double diff = 0.;
+        for (std::size_t i=0; i<y_dense.size(); ++i)
+            diff = std::max(diff, std::abs(y_dense[i] - y.dense()[i]));
+        std::cout << "x: " << x.nnz() << " elements, y: " << y.nnz() << " elements, difference from dense product "
+                  << diff << std::endl;
+    }
+
+    //! matrix powers kernel
+    if (true)
+    {
+        std::cout << "*** MATRIX POWERS ***" << std::endl;
+
+        // pentadiagonal matrix larger than the cache
+        std::size_t n = 400000, s = 4;
+        algebra::Matrix<double, algebra::Order> A(n, n);
+        for (std::size_t i=0; i<n; ++i)
+            for (std::size_t j=(i > 1 ? i-2 : 0); j<std::min(i+3, n); ++j)
+                A[{i, j}] = (i == j) ? 0.5 : -0.1;
+        A.compress(algebra::Compression::CSR);
+
+        std::vector<double> x(n);
+        for (std::size_t i=0; i<n; ++i)
+            x[i] = 1. + 1e-3*(i % 11);
+
+        algebra::MatrixPowers<double, algebra::Order> powers(A, s);
+        std::vector<std::vector<double>> basis, reference(s+1);
+
+        auto t0 = std::chrono::steady_clock::now();
+        powers.compute(x, basis);
+        auto t1 = std::chrono::steady_clock::now();
+        reference[0] = x;
+        for (std::size_t p=1; p<=s; ++p)
+            A.multiply(reference[p-1], reference[p]);
+        auto t2 = std::chrono::steady_clock::now();
+
+        std::cout << powers.blocks() << " blocks, " << powers.ghost_rows() << " ghost rows, same basis "
+                  << (basis == reference) << ", blocked "
+                  << std::chrono::duration<double, std::milli>(t1 - t0).count() << " ms, "
+                  << s << " products " << std::chrono::duration<double, std::milli>(t2 - t1).count() << " ms" << std::endl;
+    }
+
+    //! fixed pattern matrices
+    if (true)
+    {
+        std::cout << "*** FIXED PATTERN ***" << std::endl;
+
+        // 5 x 5 tridiagonal stencil, pattern and shape known at compile time
+        static constexpr std::array<std::array<bool, 5>, 5> mask{{
+            {1, 1, 0, 0, 0},
+            {1, 1, 1, 0, 0},
+            {0, 1, 1, 1, 0},
+            {0, 0, 1, 1, 1},
+            {0, 0, 0, 1, 1} }};
+        static constexpr auto stencil = algebra::make_pattern<algebra::nonzeros(mask)>(mask);
+
+        algebra::Matrix<double, algebra::Order> A(5, 5);
+        for (std::size_t i=0; i<5; ++i)
+            for (std::size_t j=(i ? i-1 : 0); j<std::min<std::size_t>(i+2, 5); ++j)
+                A[{i, j}] = (i == j) ? 2. : -1. - 0.1*i;
+        algebra::FixedMatrix<double, stencil> F(A);
+        F.value<0, 1>() = A[{0, 1}];
+
+        std::vector<double> x{1., 2., 3., 4., 5.}, y_fixed;
+        F.multiply(x, y_fixed);
+        bool same = (y_fixed == A * x) and F.norm(algebra::One) == A.norm(algebra::One)
+                and F.norm(algebra::Frobenius) == A.norm(algebra::Frobenius);
+
+        // many applications: fixed arrays, no allocation, no index loads
+        std::array<double, 5> u{1., 1., 1., 1., 1.}, w;
+        double sum = 0.;
+        auto t0 = std::chrono::steady_clock::now();
+        for (int r=0; r<1000000; ++r)
+        {
+            u[2] = 1. + 1e-6*r;
+            F.multiply(u, w);
+            sum += w[2];
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        std::cout << "same product and norms " << same << ", 1e6 products "
+                  << std::chrono::duration<double, std::milli>(t1 - t0).count() << " ms (sum " << sum << ")" << std::endl;
+    }
+
+    //! complex kernels
+    if (true)
+    {
+        std::cout << "*** COMPLEX KERNELS ***" << std::endl;
+
+        using C = std::complex<double>;
+        algebra::Matrix<C, algebra::Order> A("data/mhd1280a.mtx");
+        A.compress(algebra::Compression::CSR);
+        algebra::SplitComplexMatrix<double> S(A);
+
+        std::vector<C> x(A.ncols()), y, y_split;
+        for (std::size_t j=0; j<x.size(); ++j)
+            x[j] = C(1. + 1e-3*j, -0.5 + 1e-4*j);
+
+        // reference: std::complex operations in a plain loop
+        std::vector<C> y_ref(A.nrows(), C(0));
+        double frob = 0.;
+        for (std::size_t i=0; i<A.nrows(); ++i)
+        {
+            for (std::size_t k=A.ia()[i]; k<A.ia()[i+1]; ++k)
+            {
+                y_ref[i] += A.aa()[k] * x[ A.ja()[k] ];
+                frob += std::abs(A.aa()[k]) * std::abs(A.aa()[k]);
+            }
+        }
+        frob = std::sqrt(frob);
+
+        auto time = [](auto f)
+        {
+            auto t0 = std::chrono::steady_clock::now();
+            for (int r=0; r<50; ++r)
+                f();
+            return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count() / 50;
+        };
+        double t_aos = time([&]{ A.multiply(x, y); });
+        double t_soa = time([&]{ S.multiply(x, y_split); });
+
+        double diff = 0., diff_split = 0., ref = 0.;
+        for (std::size_t i=0; i<y_ref.size(); ++i)
+        {
+            diff = std::max(diff, std::abs(y[i] - y_ref[i]));
+            diff_split = std::max(diff_split, std::abs(y_split[i] - y_ref[i]));
+            ref = std::max(ref, std::abs(y_ref[i]));
+        }
+        std::cout << "relative difference CSR " << diff / ref << ", split " << diff_split / ref
+                  << "; product CSR " << t_aos << " us, split " << t_soa << " us" << std::endl;
+        std::cout << "norms: frob " << A.norm(algebra::Frobenius) / frob - 1. << ", split "
+                  << S.norm(algebra::Frobenius) / frob - 1. << ", one " << S.norm(algebra::One) - A.norm(algebra::One)
+                  << ", infinity " << S.norm(algebra::Infinity) - A.norm(algebra::Infinity) << std::endl;
+    }
+
+    //! pipelined processing of files
+    if (true)
+    {
+        std::cout << "*** PIPELINE ***" << std::endl;
+
+        using C = std::complex<double>;
+        using Mat = algebra::Matrix<C, algebra::Order>;
+
+        // each file twice, to have a longer pipeline
+        std::vector<std::string> distinct = algebra::mtx_files("data"), files = distinct;
+        files.insert(files.end(), distinct.cbegin(), distinct.cend());
+
+        // computation: norms and a few products
+        auto work = [](Mat const &M)
+        {
+            std::vector<C> x(M.ncols(), C(1., 0.5)), y;
+            for (int r=0; r<20; ++r)
+                M.multiply(x, y);
+            return M.norm(algebra::Frobenius) + std::abs(y[0]);
+        };
+
+        std::vector<double> sequential(files.size()), pipelined(files.size());
+        auto t0 = std::chrono::steady_clock::now();
+        for (std::size_t n=0; n<files.size(); ++n)
+        {
+            Mat M(files[n]);
+            M.compress(algebra::Compression::CSR);
+            sequential[n] = work(M);
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        std::size_t processed = algebra::pipeline<C>(files,
+            [&](std::size_t n, std::string const &, Mat &M) { pipelined[n] = work(M); });
+        auto t2 = std::chrono::steady_clock::now();
+
+        std::cout << processed << " files, same results " << (sequential == pipelined) << ", sequential "
+                  << std::chrono::duration<double, std::milli>(t1 - t0).count() << " ms, pipelined "
+                  << std::chrono::duration<double, std::milli>(t2 - t1).count() << " ms" << std::endl;
+    }
+
     return 0;
 }
\ No newline at end of file
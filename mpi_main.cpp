@@ -0,0 +1,77 @@
+#include <cstddef>
+#include <iostream>
+#include <vector>
+#include <complex>
+#include <cmath>
+#include <mpi.h>
+#include "Matrix.hpp"
+#include "DistributedMatrix.hpp"
+
+/**
+ * @brief Compare the distributed product with the serial one on rank 0.
+ */
+template<typename T>
+void check_product(std::string const &name, MPI_Comm comm)
+{
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    algebra::DistributedMatrix<T, algebra::Order> M_dist(name, comm);
+
+    // local block of x: x_i = 1 + i/n
+    std::size_t n = M_dist.ncols();
+    std::vector<T> x(M_dist.local_rows()), y;
+    for (std::size_t i=0; i<x.size(); ++i)
+        x[i] = 1. + double(M_dist.first_row() + i) / n;
+
+    double start = MPI_Wtime();
+    M_dist.multiply(x, y);
+    double time = MPI_Wtime() - start;
+
+    // gather the result on rank 0
+    std::vector<int> counts(size), displ(size+1, 0);
+    int nloc = y.size() * sizeof(T);
+    MPI_Gather(&nloc, 1, MPI_INT, counts.data(), 1, MPI_INT, 0, comm);
+    for (int r=0; r<size; ++r)
+        displ[r+1] = displ[r] + counts[r];
+    std::vector<T> y_all(M_dist.nrows());
+    MPI_Gatherv(y.data(), nloc, MPI_BYTE, y_all.data(), counts.data(), displ.data(), MPI_BYTE, 0, comm);
+
+    std::size_t ghosts = M_dist.ghosts();
+    std::size_t max_ghosts = 0;
+    MPI_Reduce(&ghosts, &max_ghosts, 1, MPI_UNSIGNED_LONG, MPI_MAX, 0, comm);
+
+    if (rank == 0)
+    {
+        algebra::Matrix<T, algebra::Order> M(name);
+        M.compress(algebra::Compression::CSR);
+        std::vector<T> x_all(n);
+        for (std::size_t i=0; i<n; ++i)
+            x_all[i] = 1. + double(i) / n;
+        auto y_ref = M * x_all;
+
+        double diff = 0.;
+        for (std::size_t i=0; i<y_ref.size(); ++i)
+            diff = std::max(diff, std::abs(y_ref[i] - y_all[i]));
+        std::cout << name << ": " << size << " ranks, max ghosts " << max_ghosts
+                  << ", difference from serial product " << diff
+                  << ", time " << time*1e6 << " microseconds" << std::endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    MPI_Init(&argc, &argv);
+
+    //! distributed matrix-vector product
+    if (true)
+    {
+        check_product<double>("data/lnsp_131.mtx", MPI_COMM_WORLD);
+        check_product<double>("data/zenios.mtx", MPI_COMM_WORLD);
+        check_product<std::complex<double>>("data/mhd1280a.mtx", MPI_COMM_WORLD);
+    }
+
+    MPI_Finalize();
+    return 0;
+}